@@ -0,0 +1,293 @@
+//////////////////////////////////////////////////////
+///
+/// Batch conversion of tiff files with overlapped reading, conversion and writing
+///
+const char* usage = R"(
+Converts a batch of uint16_t tiff images to APRs (saved as hdf5 with blosc compression, as Example_get_apr). Reading the
+tiffs, computing the APRs and writing them run as concurrent stages connected by bounded queues, so the conversion does
+not have to wait for the disk. Reports the throughput of each stage, the occupancy of the queues and the end-to-end
+frames per second.
+
+Usage:
+
+Example_batch_convert -d input_directory [-i file_pattern] [-od output_directory] [-queue queue_size]
+
+-i file_pattern (glob pattern of the files in the input directory, default: *.tif)
+-queue queue_size (number of images / APRs that can wait between two stages, default: 2)
+
+Parameters (as Example_get_apr, the automatic parameters are computed for each image):
+
+-I_th intensity_threshold
+-SNR_min minimal_snr
+-lambda lambda_value
+-min_signal min_signal_val
+-rel_error rel_error_value
+
+e.g. Example_batch_convert -d /data/timelapse/ -i "t*.tif" -od /data/apr/ -queue 4
+)";
+
+#include <algorithm>
+#include <glob.h>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <thread>
+
+#include "Example_batch_convert.hpp"
+#include "io/TiffUtils.hpp"
+
+
+struct DecodedImage {
+    std::string name;
+    MeshData<uint16_t> image;
+};
+
+struct ConvertedAPR {
+    std::string name;
+    std::unique_ptr<APR<uint16_t>> apr;
+};
+
+struct StageStatistics {
+    std::string name;
+    uint64_t number_items = 0;
+    double busy_time = 0;
+    double pixels = 0;
+};
+
+std::vector<std::string> find_input_files(const std::string &pattern) {
+    std::vector<std::string> files;
+    glob_t glob_result;
+    if (glob(pattern.c_str(), 0, nullptr, &glob_result) == 0) {
+        for (size_t i = 0; i < glob_result.gl_pathc; ++i) {
+            files.push_back(glob_result.gl_pathv[i]);
+        }
+    }
+    globfree(&glob_result);
+    return files;
+}
+
+std::string output_name(const std::string &file) {
+    //file name without the directory and extension
+    std::string name = file.substr(file.find_last_of("/\\") + 1);
+    return name.substr(0, name.find_last_of('.'));
+}
+
+void print_statistics(const StageStatistics &stage, const double wall_time) {
+    std::cout << std::setw(10) << stage.name << ": " << stage.number_items << " images, busy " << stage.busy_time << " s ("
+              << (100.0*stage.busy_time/wall_time) << "% of the run), "
+              << (stage.busy_time > 0 ? stage.number_items/stage.busy_time : 0) << " images/s, "
+              << (stage.busy_time > 0 ? stage.pixels/stage.busy_time/1000000.0 : 0) << " Mpixels/s" << std::endl;
+}
+
+template<typename T>
+void print_statistics(const std::string &name, const BoundedQueue<T> &queue) {
+    std::cout << std::setw(10) << name << ": capacity " << queue.capacity << ", mean occupancy "
+              << (queue.number_pushes > 0 ? (1.0*queue.occupancy_sum)/queue.number_pushes : 0) << ", max " << queue.occupancy_max
+              << ", producer waited " << queue.push_wait << " s, consumer waited " << queue.pop_wait << " s" << std::endl;
+}
+
+int main(int argc, char **argv) {
+
+    // INPUT PARSING
+
+    cmdLineOptions options = read_command_line_options(argc, argv);
+
+    const std::vector<std::string> files = find_input_files(options.directory + options.input);
+
+    if (files.empty()) {
+        std::cerr << "No files matching " << options.directory + options.input << std::endl;
+        return 1;
+    }
+
+    std::cout << "Converting " << files.size() << " files" << std::endl;
+
+    APRParameters par;
+    par.Ip_th = options.Ip_th;
+    par.rel_error = options.rel_error;
+    par.lambda = options.lambda;
+    par.mask_file = "";
+    par.min_signal = options.min_signal;
+    par.SNR_min = options.SNR_min;
+
+    BoundedQueue<DecodedImage> decoded_queue(options.queue_size);
+    BoundedQueue<ConvertedAPR> converted_queue(options.queue_size);
+
+    StageStatistics read_stage, convert_stage, write_stage;
+    read_stage.name = "read";
+    convert_stage.name = "convert";
+    write_stage.name = "write";
+
+    APRTimer total_timer;
+    total_timer.start_timer("batch conversion");
+
+    //tiff decoding
+    std::thread read_thread([&]() {
+        APRTimer timer;
+        for (auto const &file : files) {
+            TiffUtils::TiffInfo tiff(file);
+
+            if (tiff.iType != TiffUtils::TiffInfo::TiffType::TIFF_UINT16) {
+                std::cerr << "Skipping " << file << " (not an uint16_t tiff)" << std::endl;
+                continue;
+            }
+
+            DecodedImage decoded;
+            decoded.name = output_name(file);
+
+            timer.start_timer("read");
+            decoded.image = TiffUtils::getMesh<uint16_t>(tiff);
+            timer.stop_timer();
+
+            read_stage.busy_time += timer.timings.back();
+            read_stage.number_items++;
+            read_stage.pixels += decoded.image.mesh.size();
+
+            decoded_queue.push(std::move(decoded));
+        }
+        decoded_queue.close();
+    });
+
+    //APR computation (the converter keeps its buffers between the images)
+    std::thread convert_thread([&]() {
+        APRConverter<uint16_t> apr_converter;
+        apr_converter.reuse_workspace = true;
+
+        APRTimer timer;
+        DecodedImage decoded;
+        while (decoded_queue.pop(decoded)) {
+            ConvertedAPR converted;
+            converted.name = decoded.name;
+            converted.apr.reset(new APR<uint16_t>);
+
+            //the automatic parameters are computed for each image
+            apr_converter.par = par;
+
+            timer.start_timer("convert");
+            const bool success = apr_converter.get_apr(*converted.apr, decoded.image);
+            timer.stop_timer();
+
+            if (!success) {
+                std::cerr << "Conversion of " << decoded.name << " failed" << std::endl;
+                continue;
+            }
+
+            convert_stage.busy_time += timer.timings.back();
+            convert_stage.number_items++;
+            convert_stage.pixels += decoded.image.mesh.size();
+
+            converted_queue.push(std::move(converted));
+        }
+        converted_queue.close();
+    });
+
+    //writing with blosc compression
+    std::thread write_thread([&]() {
+        APRTimer timer;
+        ConvertedAPR converted;
+        while (converted_queue.pop(converted)) {
+            timer.start_timer("write");
+            converted.apr->write_apr(options.output_dir, converted.name);
+            timer.stop_timer();
+
+            write_stage.busy_time += timer.timings.back();
+            write_stage.number_items++;
+            write_stage.pixels += 1.0*converted.apr->orginal_dimensions(0)*converted.apr->orginal_dimensions(1)*converted.apr->orginal_dimensions(2);
+        }
+    });
+
+    read_thread.join();
+    convert_thread.join();
+    write_thread.join();
+
+    total_timer.stop_timer();
+    const double wall_time = total_timer.timings.back();
+
+    std::cout << std::endl << "Stages:" << std::endl;
+    print_statistics(read_stage, wall_time);
+    print_statistics(convert_stage, wall_time);
+    print_statistics(write_stage, wall_time);
+
+    std::cout << std::endl << "Queues:" << std::endl;
+    print_statistics("decoded", decoded_queue);
+    print_statistics("converted", converted_queue);
+
+    std::cout << std::endl << "End-to-end: " << write_stage.number_items << " images in " << wall_time << " s, "
+              << write_stage.number_items/wall_time << " frames/s" << std::endl;
+}
+
+
+bool command_option_exists(char **begin, char **end, const std::string &option)
+{
+    return std::find(begin, end, option) != end;
+}
+
+char* get_command_option(char **begin, char **end, const std::string &option)
+{
+    char ** itr = std::find(begin, end, option);
+    if (itr != end && ++itr != end)
+    {
+        return *itr;
+    }
+    return 0;
+}
+
+cmdLineOptions read_command_line_options(int argc, char **argv){
+
+    cmdLineOptions result;
+
+    if(argc == 1) {
+        std::cerr << "Usage: \"Example_batch_convert -d input_directory [-i file_pattern] [-od output_directory] [-queue queue_size]\"" << std::endl;
+        std::cerr << usage << std::endl;
+        exit(1);
+    }
+
+    if(command_option_exists(argv, argv + argc, "-i"))
+    {
+        result.input = std::string(get_command_option(argv, argv + argc, "-i"));
+    }
+
+    if(command_option_exists(argv, argv + argc, "-d"))
+    {
+        result.directory = std::string(get_command_option(argv, argv + argc, "-d"));
+    }
+
+    if(command_option_exists(argv, argv + argc, "-od"))
+    {
+        result.output_dir = std::string(get_command_option(argv, argv + argc, "-od"));
+    } else {
+        result.output_dir = result.directory;
+    }
+
+    if(command_option_exists(argv, argv + argc, "-queue"))
+    {
+        result.queue_size = std::max(std::stoi(std::string(get_command_option(argv, argv + argc, "-queue"))), 1);
+    }
+
+    if(command_option_exists(argv, argv + argc, "-lambda"))
+    {
+        result.lambda = std::stof(std::string(get_command_option(argv, argv + argc, "-lambda")));
+    }
+
+    if(command_option_exists(argv, argv + argc, "-I_th"))
+    {
+        result.Ip_th = std::stof(std::string(get_command_option(argv, argv + argc, "-I_th")));
+    }
+
+    if(command_option_exists(argv, argv + argc, "-SNR_min"))
+    {
+        result.SNR_min = std::stof(std::string(get_command_option(argv, argv + argc, "-SNR_min")));
+    }
+
+    if(command_option_exists(argv, argv + argc, "-min_signal"))
+    {
+        result.min_signal = std::stof(std::string(get_command_option(argv, argv + argc, "-min_signal")));
+    }
+
+    if(command_option_exists(argv, argv + argc, "-rel_error"))
+    {
+        result.rel_error = std::stof(std::string(get_command_option(argv, argv + argc, "-rel_error")));
+    }
+
+    return result;
+
+}
@@ -0,0 +1,103 @@
+//
+// Converts a batch of tiff files with the reading, conversion and writing running as concurrent pipeline stages
+//
+
+#ifndef PARTPLAY_EXAMPLE_BATCH_CONVERT_HPP
+#define PARTPLAY_EXAMPLE_BATCH_CONVERT_HPP
+
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <string>
+
+#include "algorithm/APRParameters.hpp"
+#include "data_structures/Mesh/MeshData.hpp"
+#include "algorithm/APRConverter.hpp"
+#include "data_structures/APR/APR.hpp"
+
+
+struct cmdLineOptions{
+    std::string output_dir = "";
+    std::string directory = "";
+    std::string input = "*.tif";
+
+    size_t queue_size = 2;
+
+    float Ip_th = -1;
+    float SNR_min = -1;
+    float lambda = -1;
+    float min_signal = -1;
+    float rel_error = 0.1;
+};
+
+template<typename T>
+class BoundedQueue {
+    //
+    //  Queue between two pipeline stages, push blocks while it is full and pop while it is empty (until it is closed).
+    //  Records the occupancy seen at each push and the time the stages spent waiting on it.
+    //
+
+public:
+    explicit BoundedQueue(size_t aCapacity) : capacity(std::max(aCapacity, (size_t)1)) {}
+
+    void push(T &&aItem) {
+        std::unique_lock<std::mutex> lock(mutex);
+        const auto wait_begin = std::chrono::steady_clock::now();
+        not_full.wait(lock, [this]{ return items.size() < capacity; });
+        push_wait += std::chrono::duration<double>(std::chrono::steady_clock::now() - wait_begin).count();
+
+        items.push_back(std::move(aItem));
+        occupancy_sum += items.size();
+        occupancy_max = std::max(occupancy_max, items.size());
+        number_pushes++;
+        not_empty.notify_one();
+    }
+
+    //returns false once the queue is closed and empty
+    bool pop(T &aItem) {
+        std::unique_lock<std::mutex> lock(mutex);
+        const auto wait_begin = std::chrono::steady_clock::now();
+        not_empty.wait(lock, [this]{ return !items.empty() || closed; });
+        pop_wait += std::chrono::duration<double>(std::chrono::steady_clock::now() - wait_begin).count();
+
+        if (items.empty()) return false;
+
+        aItem = std::move(items.front());
+        items.pop_front();
+        not_full.notify_one();
+        return true;
+    }
+
+    void close() {
+        std::lock_guard<std::mutex> lock(mutex);
+        closed = true;
+        not_empty.notify_all();
+    }
+
+    const size_t capacity;
+
+    //statistics (read once the stages are done)
+    double push_wait = 0;
+    double pop_wait = 0;
+    uint64_t occupancy_sum = 0;
+    size_t occupancy_max = 0;
+    uint64_t number_pushes = 0;
+
+private:
+    std::deque<T> items;
+    std::mutex mutex;
+    std::condition_variable not_empty;
+    std::condition_variable not_full;
+    bool closed = false;
+};
+
+cmdLineOptions read_command_line_options(int argc, char **argv);
+
+bool command_option_exists(char **begin, char **end, const std::string &option);
+
+char* get_command_option(char **begin, char **end, const std::string &option);
+
+
+#endif //PARTPLAY_EXAMPLE_BATCH_CONVERT_HPP
@@ -0,0 +1,186 @@
+//////////////////////////////////////////////////////
+///
+/// Benchmark of the passes of the recursive b-spline smoothing filter
+///
+const char* usage = R"(
+Times each pass of the b-spline smoothing (as run on the offset image in the APR conversion), the y pass one line at a
+time (the previous implementation) and on interleaved blocks of 8 and 16 lines (the simd lanes), the x and z passes (on
+y-tiles), and the passes of the inverse b-spline transform. Reports the best time of the repeats, the throughput, the
+speed-up of the y pass and the time of the x and z passes relative to the y pass.
+
+Usage:
+
+Example_bspline_benchmark [-i input_image_tiff -d input_directory] [-dims y_num x_num z_num] [-repeats number_of_repeats] [-lambda lambda]
+
+(without an input image a random uint16_t image of size dims is used, default 512 512 128)
+
+)";
+
+
+#include <algorithm>
+#include <iomanip>
+#include <iostream>
+#include <limits>
+#include <random>
+
+#include "Example_bspline_benchmark.hpp"
+
+
+template<typename T>
+double time_pass(const MeshData<T> &input_image, MeshData<T> &image, unsigned int repeats, const std::function<void(MeshData<T>&)> &pass) {
+    //best time of the repeats, each on a fresh copy of the image
+    double best = std::numeric_limits<double>::max();
+    for (unsigned int r = 0; r < repeats; ++r) {
+        image.copyFromMesh(input_image);
+        APRTimer timer;
+        timer.start_timer("pass");
+        pass(image);
+        timer.stop_timer();
+        best = std::min(best, timer.timings.back());
+    }
+    return best;
+}
+
+template<typename T>
+void benchmark(const MeshData<T> &input_image, const cmdLineOptions &options, const std::string &type_name) {
+    ComputeGradient compute_gradient;
+    const float lambda = options.lambda;
+    const float tol = 0.0001;
+
+    MeshData<T> image(input_image.y_num, input_image.x_num, input_image.z_num);
+
+    struct Pass {
+        std::string name;
+        std::function<void(MeshData<T>&)> pass;
+    };
+
+    const std::vector<Pass> passes = {
+            {"y (1 line)", [&](MeshData<T> &m) { compute_gradient.template bspline_filt_rec_y_lines<1>(m, lambda, tol); }},
+            {"y (8 lines)", [&](MeshData<T> &m) { compute_gradient.template bspline_filt_rec_y_lines<8>(m, lambda, tol); }},
+            {"y (16 lines)", [&](MeshData<T> &m) { compute_gradient.template bspline_filt_rec_y_lines<16>(m, lambda, tol); }},
+            {"x", [&](MeshData<T> &m) { compute_gradient.bspline_filt_rec_x(m, lambda, tol); }},
+            {"z", [&](MeshData<T> &m) { compute_gradient.bspline_filt_rec_z(m, lambda, tol); }},
+            {"inverse y", [&](MeshData<T> &m) { compute_gradient.calc_inv_bspline_y(m); }},
+            {"inverse x", [&](MeshData<T> &m) { compute_gradient.calc_inv_bspline_x(m); }},
+            {"inverse z", [&](MeshData<T> &m) { compute_gradient.calc_inv_bspline_z(m); }}};
+
+    std::cout << std::endl << type_name << " " << input_image.y_num << "x" << input_image.x_num << "x" << input_image.z_num << std::endl;
+
+    double y_reference = 0;
+    double y_time = 0;
+    double inverse_y_time = 0;
+    for (auto const &p : passes) {
+        const double time = time_pass(input_image, image, options.repeats, p.pass);
+        if (p.name == "y (1 line)") {
+            y_reference = time;
+        } else if (p.name == "y (16 lines)") {
+            y_time = time;
+        } else if (p.name == "inverse y") {
+            inverse_y_time = time;
+        }
+
+        std::cout << std::setw(14) << p.name << ": " << std::setw(10) << time << " s, "
+                  << std::setw(8) << input_image.mesh.size()/time/1000000.0 << " Mpixels/s";
+        if (p.name.front() == 'y') {
+            std::cout << ", speed-up " << y_reference/time;
+        } else if ((p.name == "x") || (p.name == "z")) {
+            std::cout << ", relative to y " << time/y_time;
+        } else if (p.name != "inverse y") {
+            std::cout << ", relative to y " << time/inverse_y_time;
+        }
+        std::cout << std::endl;
+    }
+}
+
+int main(int argc, char **argv) {
+
+    // INPUT PARSING
+
+    cmdLineOptions options = read_command_line_options(argc, argv);
+
+    MeshData<uint16_t> input_image;
+    if (options.input != "") {
+        input_image = TiffUtils::getMesh<uint16_t>(options.directory + options.input);
+        if (input_image.mesh.size() == 0) {
+            std::cerr << "Could not read the input image" << std::endl;
+            return 1;
+        }
+    } else {
+        input_image.init(options.y_num, options.x_num, options.z_num);
+        std::mt19937 generator(0);
+        std::uniform_int_distribution<int> distribution(100, 2000);
+        for (size_t i = 0; i < input_image.mesh.size(); ++i) {
+            input_image.mesh[i] = distribution(generator);
+        }
+    }
+
+    //offset as in the conversion
+    for (size_t i = 0; i < input_image.mesh.size(); ++i) {
+        input_image.mesh[i] += 100;
+    }
+
+    benchmark(input_image, options, "uint16_t");
+
+    MeshData<float> input_image_float = input_image.toType<float>();
+    benchmark(input_image_float, options, "float");
+}
+
+
+bool command_option_exists(char **begin, char **end, const std::string &option)
+{
+    return std::find(begin, end, option) != end;
+}
+
+char* get_command_option(char **begin, char **end, const std::string &option)
+{
+    char ** itr = std::find(begin, end, option);
+    if (itr != end && ++itr != end)
+    {
+        return *itr;
+    }
+    return 0;
+}
+
+cmdLineOptions read_command_line_options(int argc, char **argv){
+
+    cmdLineOptions result;
+
+    if(command_option_exists(argv, argv + argc, "-h"))
+    {
+        std::cerr << usage << std::endl;
+        exit(1);
+    }
+
+    if(command_option_exists(argv, argv + argc, "-i"))
+    {
+        result.input = std::string(get_command_option(argv, argv + argc, "-i"));
+    }
+
+    if(command_option_exists(argv, argv + argc, "-d"))
+    {
+        result.directory = std::string(get_command_option(argv, argv + argc, "-d"));
+    }
+
+    if(command_option_exists(argv, argv + argc, "-dims"))
+    {
+        char **itr = std::find(argv, argv + argc, std::string("-dims"));
+        if(itr + 3 < argv + argc) {
+            result.y_num = std::stoi(std::string(itr[1]));
+            result.x_num = std::stoi(std::string(itr[2]));
+            result.z_num = std::stoi(std::string(itr[3]));
+        }
+    }
+
+    if(command_option_exists(argv, argv + argc, "-repeats"))
+    {
+        result.repeats = std::max(std::stoi(std::string(get_command_option(argv, argv + argc, "-repeats"))), 1);
+    }
+
+    if(command_option_exists(argv, argv + argc, "-lambda"))
+    {
+        result.lambda = std::stof(std::string(get_command_option(argv, argv + argc, "-lambda")));
+    }
+
+    return result;
+
+}
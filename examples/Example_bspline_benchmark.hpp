@@ -0,0 +1,32 @@
+//
+// Benchmark of the passes of the recursive b-spline smoothing filter
+//
+
+#ifndef PARTPLAY_EXAMPLE_BSPLINE_BENCHMARK_HPP
+#define PARTPLAY_EXAMPLE_BSPLINE_BENCHMARK_HPP
+
+#include <functional>
+#include <string>
+
+#include "data_structures/Mesh/MeshData.hpp"
+#include "algorithm/ComputeGradient.hpp"
+#include "io/TiffUtils.hpp"
+
+struct cmdLineOptions{
+    std::string directory = "";
+    std::string input = "";
+    unsigned int y_num = 512;
+    unsigned int x_num = 512;
+    unsigned int z_num = 128;
+    unsigned int repeats = 5;
+    float lambda = 3;
+};
+
+cmdLineOptions read_command_line_options(int argc, char **argv);
+
+bool command_option_exists(char **begin, char **end, const std::string &option);
+
+char* get_command_option(char **begin, char **end, const std::string &option);
+
+
+#endif //PARTPLAY_EXAMPLE_BSPLINE_BENCHMARK_HPP
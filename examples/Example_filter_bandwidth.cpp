@@ -0,0 +1,158 @@
+//////////////////////////////////////////////////////
+///
+/// Memory bandwidth of the filter stages of the APR conversion
+///
+const char* usage = R"(
+Converts an image with the filter passes run separately and fused (APRConverter::fuse_filter_passes), and reports the
+time, nominal memory traffic (bytes read and written by each pass) and bandwidth of each filter stage, for the fastest
+of the repeats. The workspace is re-used, so the buffers are already allocated when the stages are timed.
+
+Usage:
+
+Example_filter_bandwidth [-i input_image_tiff -d input_directory] [-dims y_num x_num z_num] [-repeats number_of_repeats]
+
+(without an input image a random uint16_t image of size dims is used, default 512 512 128)
+
+)";
+
+
+#include <algorithm>
+#include <iostream>
+#include <limits>
+#include <random>
+
+#include "Example_filter_bandwidth.hpp"
+
+
+std::vector<APRConverter<uint16_t>::FilterStage> convert(MeshData<uint16_t> &input_image, const bool fuse_filter_passes, const unsigned int repeats) {
+    APRConverter<uint16_t> apr_converter;
+    apr_converter.fuse_filter_passes = fuse_filter_passes;
+    apr_converter.reuse_workspace = true;
+    apr_converter.par.Ip_th = 1000;
+    apr_converter.par.sigma_th = 100;
+    apr_converter.par.sigma_th_max = 50;
+    apr_converter.par.rel_error = 0.1;
+    apr_converter.par.lambda = 3;
+
+    //first run allocates the workspace
+    APR<uint16_t> apr;
+    apr_converter.get_apr_method(apr, input_image);
+
+    double best_time = std::numeric_limits<double>::max();
+    std::vector<APRConverter<uint16_t>::FilterStage> best_stages;
+
+    for (unsigned int r = 0; r < repeats; ++r) {
+        apr_converter.get_apr_method(apr, input_image);
+
+        double time = 0;
+        for (auto const &stage : apr_converter.filter_stages) {
+            time += stage.time;
+        }
+        if (time < best_time) {
+            best_time = time;
+            best_stages = apr_converter.filter_stages;
+        }
+    }
+
+    std::cout << std::endl << (fuse_filter_passes ? "fused" : "separate") << " passes:" << std::endl;
+    apr_converter.filter_stages = best_stages;
+    apr_converter.print_filter_bandwidth();
+
+    return best_stages;
+}
+
+int main(int argc, char **argv) {
+
+    // INPUT PARSING
+
+    cmdLineOptions options = read_command_line_options(argc, argv);
+
+    MeshData<uint16_t> input_image;
+    if (options.input != "") {
+        input_image = TiffUtils::getMesh<uint16_t>(options.directory + options.input);
+        if (input_image.mesh.size() == 0) {
+            std::cerr << "Could not read the input image" << std::endl;
+            return 1;
+        }
+    } else {
+        input_image.init(options.y_num, options.x_num, options.z_num);
+        std::mt19937 generator(0);
+        std::uniform_int_distribution<int> distribution(100, 2000);
+        for (size_t i = 0; i < input_image.mesh.size(); ++i) {
+            input_image.mesh[i] = distribution(generator);
+        }
+    }
+
+    auto totals = [](const std::vector<APRConverter<uint16_t>::FilterStage> &stages, double &time, uint64_t &bytes) {
+        time = 0;
+        bytes = 0;
+        for (auto const &stage : stages) {
+            time += stage.time;
+            bytes += stage.bytes;
+        }
+    };
+
+    double separate_time, fused_time;
+    uint64_t separate_bytes, fused_bytes;
+    totals(convert(input_image, false, options.repeats), separate_time, separate_bytes);
+    totals(convert(input_image, true, options.repeats), fused_time, fused_bytes);
+
+    std::cout << std::endl << "fusing saves " << (separate_bytes - fused_bytes)/1e6 << " MB of "
+              << separate_bytes/1e6 << " MB (" << 100.0*(separate_bytes - fused_bytes)/separate_bytes << "%), filter time "
+              << separate_time << " s -> " << fused_time << " s" << std::endl;
+}
+
+
+bool command_option_exists(char **begin, char **end, const std::string &option)
+{
+    return std::find(begin, end, option) != end;
+}
+
+char* get_command_option(char **begin, char **end, const std::string &option)
+{
+    char ** itr = std::find(begin, end, option);
+    if (itr != end && ++itr != end)
+    {
+        return *itr;
+    }
+    return 0;
+}
+
+cmdLineOptions read_command_line_options(int argc, char **argv){
+
+    cmdLineOptions result;
+
+    if(command_option_exists(argv, argv + argc, "-h"))
+    {
+        std::cerr << usage << std::endl;
+        exit(1);
+    }
+
+    if(command_option_exists(argv, argv + argc, "-i"))
+    {
+        result.input = std::string(get_command_option(argv, argv + argc, "-i"));
+    }
+
+    if(command_option_exists(argv, argv + argc, "-d"))
+    {
+        result.directory = std::string(get_command_option(argv, argv + argc, "-d"));
+    }
+
+    if(command_option_exists(argv, argv + argc, "-dims"))
+    {
+        char **itr = std::find(argv, argv + argc, std::string("-dims"));
+        if(itr + 3 < argv + argc) {
+            result.y_num = std::stoi(std::string(itr[1]));
+            result.x_num = std::stoi(std::string(itr[2]));
+            result.z_num = std::stoi(std::string(itr[3]));
+        }
+    }
+
+    if(command_option_exists(argv, argv + argc, "-repeats"))
+    {
+        result.repeats = std::max(std::stoi(std::string(get_command_option(argv, argv + argc, "-repeats"))), 1);
+    }
+
+    return result;
+
+}
@@ -0,0 +1,30 @@
+//
+// Memory bandwidth of the filter stages of the APR conversion, with and without fusing the passes
+//
+
+#ifndef PARTPLAY_EXAMPLE_FILTER_BANDWIDTH_HPP
+#define PARTPLAY_EXAMPLE_FILTER_BANDWIDTH_HPP
+
+#include <string>
+
+#include "data_structures/Mesh/MeshData.hpp"
+#include "algorithm/APRConverter.hpp"
+#include "io/TiffUtils.hpp"
+
+struct cmdLineOptions{
+    std::string directory = "";
+    std::string input = "";
+    unsigned int y_num = 512;
+    unsigned int x_num = 512;
+    unsigned int z_num = 128;
+    unsigned int repeats = 3;
+};
+
+cmdLineOptions read_command_line_options(int argc, char **argv);
+
+bool command_option_exists(char **begin, char **end, const std::string &option);
+
+char* get_command_option(char **begin, char **end, const std::string &option);
+
+
+#endif //PARTPLAY_EXAMPLE_FILTER_BANDWIDTH_HPP
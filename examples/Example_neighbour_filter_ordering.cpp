@@ -0,0 +1,173 @@
+//////////////////////////////////////////////////////
+///
+/// Benchmark of the neighbour filters under the canonical and Morton particle orderings
+///
+const char* usage = R"(
+Times the separable face neighbour smoothing filter using the iterators, the neighbour cache in the canonical
+(level -> z -> x -> y) particle order, and the neighbour cache with the particles in Morton order (within levels
+and across levels).
+
+Usage:
+
+(using *_apr.h5 output of Example_get_apr)
+
+Example_neighbour_filter_ordering -i input_apr_hdf5 -d input_directory [-repeats number_of_filter_repeats]
+
+)";
+
+
+#include <algorithm>
+#include <iostream>
+
+#include "Example_neighbour_filter_ordering.hpp"
+
+
+int main(int argc, char **argv) {
+
+    // INPUT PARSING
+
+    cmdLineOptions options = read_command_line_options(argc, argv);
+
+    // Filename
+    std::string file_name = options.directory + options.input;
+
+    APRTimer timer;
+    timer.verbose_flag = true;
+
+    // APR datastructure
+    APR<uint16_t> apr;
+
+    //read file
+    apr.read_apr(file_name);
+
+    std::cout << "Number of particles: " << apr.total_number_particles() << " filter repeats: " << options.repeats << std::endl;
+
+    APRNumerics apr_numerics;
+    const std::vector<float> filter = {0.1f, 0.8f, 0.1f};
+
+    ///////////////////////////
+    ///
+    /// Filter using the iterators to find the neighbours
+    ///
+    /////////////////////////////////
+
+    ExtraParticleData<float> smooth_iterator;
+
+    timer.start_timer("filter (iterators)");
+    apr_numerics.seperable_smooth_filter(apr, apr.particles_intensities, smooth_iterator, filter, options.repeats);
+    timer.stop_timer();
+
+    ///////////////////////////
+    ///
+    /// Filter using the neighbour cache, canonical order
+    ///
+    /////////////////////////////////
+
+    std::cout << "Estimated neighbour cache size: " << APRNeighbourCache::estimate_memory_usage(apr.total_number_particles())/1000000.0 << " MB" << std::endl;
+
+    APRNeighbourCache neighbour_cache;
+
+    timer.start_timer("build neighbour cache");
+    neighbour_cache.initialize(apr);
+    timer.stop_timer();
+
+    std::cout << "Neighbour cache size: " << neighbour_cache.memory_usage()/1000000.0 << " MB" << std::endl;
+
+    ExtraParticleData<float> smooth_canonical;
+
+    timer.start_timer("filter (cache, canonical order)");
+    apr_numerics.seperable_smooth_filter(apr, apr.particles_intensities, smooth_canonical, filter, neighbour_cache, options.repeats);
+    timer.stop_timer();
+
+    ///////////////////////////
+    ///
+    /// Filter using the neighbour cache, Morton order
+    ///
+    /////////////////////////////////
+
+    const std::vector<std::string> order_names = {"within levels", "across levels"};
+
+    for (int across_levels = 0; across_levels < 2; ++across_levels) {
+
+        APRMortonOrder morton_order;
+
+        timer.start_timer("compute Morton order (" + order_names[across_levels] + ")");
+        morton_order.initialize(apr, across_levels);
+        timer.stop_timer();
+
+        APRNeighbourCache neighbour_cache_morton;
+        ExtraParticleData<uint16_t> intensities_morton;
+
+        timer.start_timer("permute cache and intensities (" + order_names[across_levels] + ")");
+        morton_order.remap_neighbour_cache(neighbour_cache, neighbour_cache_morton);
+        morton_order.to_morton(apr.particles_intensities, intensities_morton);
+        timer.stop_timer();
+
+        ExtraParticleData<float> smooth_morton;
+
+        timer.start_timer("filter (cache, Morton order " + order_names[across_levels] + ")");
+        apr_numerics.seperable_smooth_filter(apr, intensities_morton, smooth_morton, filter, neighbour_cache_morton, options.repeats);
+        timer.stop_timer();
+
+        ExtraParticleData<float> smooth_check;
+        morton_order.to_canonical(smooth_morton, smooth_check);
+
+        if (smooth_check.data != smooth_canonical.data) {
+            std::cout << "Morton order result differs from the canonical order" << std::endl;
+        }
+    }
+
+}
+
+
+bool command_option_exists(char **begin, char **end, const std::string &option)
+{
+    return std::find(begin, end, option) != end;
+}
+
+char* get_command_option(char **begin, char **end, const std::string &option)
+{
+    char ** itr = std::find(begin, end, option);
+    if (itr != end && ++itr != end)
+    {
+        return *itr;
+    }
+    return 0;
+}
+
+cmdLineOptions read_command_line_options(int argc, char **argv){
+
+    cmdLineOptions result;
+
+    if(argc == 1) {
+        std::cerr << "Usage: \"Example_neighbour_filter_ordering -i input_apr_file -d directory [-repeats number_of_filter_repeats]\"" << std::endl;
+        std::cerr << usage << std::endl;
+        exit(1);
+    }
+
+    if(command_option_exists(argv, argv + argc, "-i"))
+    {
+        result.input = std::string(get_command_option(argv, argv + argc, "-i"));
+    } else {
+        std::cout << "Input file required" << std::endl;
+        exit(2);
+    }
+
+    if(command_option_exists(argv, argv + argc, "-d"))
+    {
+        result.directory = std::string(get_command_option(argv, argv + argc, "-d"));
+    }
+
+    if(command_option_exists(argv, argv + argc, "-o"))
+    {
+        result.output = std::string(get_command_option(argv, argv + argc, "-o"));
+    }
+
+    if(command_option_exists(argv, argv + argc, "-repeats"))
+    {
+        result.repeats = std::stoi(std::string(get_command_option(argv, argv + argc, "-repeats")));
+    }
+
+    return result;
+
+}
@@ -0,0 +1,31 @@
+//
+// Benchmark of the neighbour filters with the canonical and Morton particle orderings
+//
+
+#ifndef PARTPLAY_EXAMPLE_NEIGHBOUR_FILTER_ORDERING_HPP
+#define PARTPLAY_EXAMPLE_NEIGHBOUR_FILTER_ORDERING_HPP
+
+#include <functional>
+#include <string>
+
+#include "data_structures/APR/APR.hpp"
+#include "data_structures/APR/APRNeighbourCache.hpp"
+#include "data_structures/APR/APRMortonOrder.hpp"
+#include "numerics/APRNumerics.hpp"
+
+struct cmdLineOptions{
+    std::string output = "output";
+    std::string stats = "";
+    std::string directory = "";
+    std::string input = "";
+    unsigned int repeats = 5;
+};
+
+cmdLineOptions read_command_line_options(int argc, char **argv);
+
+bool command_option_exists(char **begin, char **end, const std::string &option);
+
+char* get_command_option(char **begin, char **end, const std::string &option);
+
+
+#endif //PARTPLAY_EXAMPLE_NEIGHBOUR_FILTER_ORDERING_HPP
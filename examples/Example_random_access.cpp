@@ -13,6 +13,10 @@ Usage:
 
 Example_random_accesss -i input_apr_hdf5 -d input_directory
 
+Options:
+
+-n number_points (number of random points used to compare the scalar and the batch random access, default 1000000)
+
 Note: There is no output, this file is best utilized by looking at the source code for example (test/Examples/Example_random_access.cpp) of how to code different
 random access strategies on the APR.
 
@@ -119,6 +123,54 @@ int main(int argc, char **argv) {
         std::cout << "Particle Cell found is at level: " << apr_iterator.level() << " with x: " << apr_iterator.x() << " y: " << apr_iterator.y() << " z: " << apr_iterator.z() << std::endl;
         std::cout << "type: " << std::to_string((uint16_t)apr_iterator.type()) << " with global index: " << apr_iterator.global_index() << " and intensity " << apr.particles_intensities[apr_iterator] << std::endl;
     }
+
+    ///////////////////////
+    ///
+    /// Batch random access, sampling the particles at many points at once (the points are bucketed by row internally
+    /// and searched in parallel), compared to setting the iterator point by point.
+    ///
+    ////////////////////////
+
+    std::cout << std::endl;
+    std::cout << "Sampling the particle intensities at " << options.number_points << " random points" << std::endl;
+    std::cout << "--------------------" << std::endl;
+
+    std::vector<float> x_points(options.number_points);
+    std::vector<float> y_points(options.number_points);
+    std::vector<float> z_points(options.number_points);
+
+    for (uint64_t i = 0; i < options.number_points; ++i) {
+        x_points[i] = (apr.orginal_dimensions(1)-1)*((rand() % 10000)/10000.0f);
+        y_points[i] = (apr.orginal_dimensions(0)-1)*((rand() % 10000)/10000.0f);
+        z_points[i] = (apr.orginal_dimensions(2)-1)*((rand() % 10000)/10000.0f);
+    }
+
+    std::vector<uint16_t> scalar_values(options.number_points);
+
+    timer.start_timer("scalar random access");
+    for (uint64_t i = 0; i < options.number_points; ++i) {
+        if(apr_iterator.set_iterator_by_global_coordinate(x_points[i],y_points[i],z_points[i])){
+            scalar_values[i] = apr.particles_intensities[apr_iterator];
+        }
+    }
+    timer.stop_timer();
+
+    std::vector<uint16_t> batch_values;
+
+    timer.start_timer("batch random access");
+    apr.apr_access.sample_particles_by_global_coordinate(x_points,y_points,z_points,apr.particles_intensities,batch_values);
+    timer.stop_timer();
+
+    const double scalar_time = timer.timings[timer.timings.size()-2];
+    const double batch_time = timer.timings.back();
+
+    uint64_t number_different = 0;
+    for (uint64_t i = 0; i < options.number_points; ++i) {
+        number_different += (scalar_values[i] != batch_values[i]);
+    }
+
+    std::cout << "scalar: " << options.number_points/scalar_time << " points/s, batch: " << options.number_points/batch_time << " points/s (speed-up " << scalar_time/batch_time << ")" << std::endl;
+    std::cout << "number of points sampled differently: " << number_different << std::endl;
 }
 bool command_option_exists(char **begin, char **end, const std::string &option)
 {
@@ -163,6 +215,11 @@ cmdLineOptions read_command_line_options(int argc, char **argv){
         result.output = std::string(get_command_option(argv, argv + argc, "-o"));
     }
 
+    if(command_option_exists(argv, argv + argc, "-n"))
+    {
+        result.number_points = std::stoull(std::string(get_command_option(argv, argv + argc, "-n")));
+    }
+
     return result;
 
 }
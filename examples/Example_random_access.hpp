@@ -16,6 +16,7 @@ struct cmdLineOptions{
     std::string directory = "";
     std::string input = "";
     bool stats_file = false;
+    uint64_t number_points = 1000000;
 };
 
 cmdLineOptions read_command_line_options(int argc, char **argv);
@@ -0,0 +1,159 @@
+//////////////////////////////////////////////////////
+///
+/// Benchmark of converting a time series with and without re-using the converter workspace
+///
+const char* usage = R"(
+Converts a series of frames (copies of the input image, loaded into the same frame buffer as a camera would) and
+reports the per frame latency, once with the buffers of the pipeline allocated for every frame, and once re-using the
+converter workspace (and the output APR). The parameters are computed from the first frame and kept for the series.
+
+Usage:
+
+Example_time_series_conversion -i input_image_tiff -d input_directory [-frames number_of_frames]
+
+)";
+
+
+#include <algorithm>
+#include <iostream>
+#include <numeric>
+
+#include "Example_time_series_conversion.hpp"
+
+
+struct LatencyStats {
+    double first;
+    double mean;
+    double median;
+    double min;
+    double max;
+};
+
+LatencyStats latency_stats(std::vector<double> latencies) {
+    LatencyStats stats;
+    stats.first = latencies.front();
+    stats.mean = std::accumulate(latencies.begin(), latencies.end(), 0.0)/latencies.size();
+    std::sort(latencies.begin(), latencies.end());
+    stats.median = latencies[latencies.size()/2];
+    stats.min = latencies.front();
+    stats.max = latencies.back();
+    return stats;
+}
+
+int main(int argc, char **argv) {
+
+    // INPUT PARSING
+
+    cmdLineOptions options = read_command_line_options(argc, argv);
+
+    MeshData<uint16_t> input_image = TiffUtils::getMesh<uint16_t>(options.directory + options.input);
+    if(input_image.mesh.size() == 0) {
+        std::cerr << "Could not read the input image" << std::endl;
+        return 1;
+    }
+
+    //the frame buffer the series is loaded into
+    MeshData<uint16_t> frame(input_image, true);
+
+    //parameters from the first frame
+    APRConverter<uint16_t> parameter_converter;
+    parameter_converter.par.Ip_th = -1;
+    parameter_converter.par.SNR_min = -1;
+    parameter_converter.par.lambda = -1;
+    parameter_converter.par.min_signal = -1;
+    parameter_converter.par.mask_file = "";
+
+    APR<uint16_t> first_apr;
+    if(!parameter_converter.get_apr(first_apr, frame)) {
+        std::cerr << "Conversion failed" << std::endl;
+        return 1;
+    }
+
+    std::cout << std::endl << "Frames: " << options.frames << " of " << input_image.y_num << "x" << input_image.x_num << "x" << input_image.z_num
+              << " pixels, particles per frame: " << first_apr.total_number_particles() << std::endl << std::endl;
+
+    const std::vector<std::string> mode_names = {"new buffers per frame", "re-used workspace"};
+
+    for (int reuse = 0; reuse < 2; ++reuse) {
+
+        APRConverter<uint16_t> apr_converter;
+        apr_converter.par = first_apr.parameters;
+        apr_converter.reuse_workspace = reuse;
+
+        APRTimer timer;
+        APR<uint16_t> reused_apr;
+        uint64_t total_number_particles = 0;
+
+        for (unsigned int f = 0; f < options.frames; ++f) {
+            frame.copyFromMesh(input_image);
+
+            APR<uint16_t> new_apr;
+            APR<uint16_t> &apr = reuse ? reused_apr : new_apr;
+
+            timer.start_timer("frame");
+            apr_converter.get_apr_method(apr, frame);
+            timer.stop_timer();
+
+            total_number_particles += apr.total_number_particles();
+        }
+
+        if (total_number_particles != options.frames * first_apr.total_number_particles()) {
+            std::cout << "Number of particles differs from the first frame" << std::endl;
+        }
+
+        const LatencyStats stats = latency_stats(timer.timings);
+
+        std::cout << mode_names[reuse] << ": per frame latency (ms) first: " << 1000*stats.first << " mean: " << 1000*stats.mean
+                  << " median: " << 1000*stats.median << " min: " << 1000*stats.min << " max: " << 1000*stats.max
+                  << " (" << options.frames/std::accumulate(timer.timings.begin(), timer.timings.end(), 0.0) << " frames/s)" << std::endl;
+    }
+
+}
+
+
+bool command_option_exists(char **begin, char **end, const std::string &option)
+{
+    return std::find(begin, end, option) != end;
+}
+
+char* get_command_option(char **begin, char **end, const std::string &option)
+{
+    char ** itr = std::find(begin, end, option);
+    if (itr != end && ++itr != end)
+    {
+        return *itr;
+    }
+    return 0;
+}
+
+cmdLineOptions read_command_line_options(int argc, char **argv){
+
+    cmdLineOptions result;
+
+    if(argc == 1) {
+        std::cerr << "Usage: \"Example_time_series_conversion -i input_image_tiff -d directory [-frames number_of_frames]\"" << std::endl;
+        std::cerr << usage << std::endl;
+        exit(1);
+    }
+
+    if(command_option_exists(argv, argv + argc, "-i"))
+    {
+        result.input = std::string(get_command_option(argv, argv + argc, "-i"));
+    } else {
+        std::cout << "Input file required" << std::endl;
+        exit(2);
+    }
+
+    if(command_option_exists(argv, argv + argc, "-d"))
+    {
+        result.directory = std::string(get_command_option(argv, argv + argc, "-d"));
+    }
+
+    if(command_option_exists(argv, argv + argc, "-frames"))
+    {
+        result.frames = std::max(std::stoi(std::string(get_command_option(argv, argv + argc, "-frames"))), 1);
+    }
+
+    return result;
+
+}
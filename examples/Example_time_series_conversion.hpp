@@ -0,0 +1,29 @@
+//
+// Benchmark of converting a time series of same sized frames, with and without re-using the converter workspace
+//
+
+#ifndef PARTPLAY_EXAMPLE_TIME_SERIES_CONVERSION_HPP
+#define PARTPLAY_EXAMPLE_TIME_SERIES_CONVERSION_HPP
+
+#include <functional>
+#include <string>
+
+#include "data_structures/Mesh/MeshData.hpp"
+#include "algorithm/APRConverter.hpp"
+#include "data_structures/APR/APR.hpp"
+#include "io/TiffUtils.hpp"
+
+struct cmdLineOptions{
+    std::string directory = "";
+    std::string input = "";
+    unsigned int frames = 100;
+};
+
+cmdLineOptions read_command_line_options(int argc, char **argv);
+
+bool command_option_exists(char **begin, char **end, const std::string &option);
+
+char* get_command_option(char **begin, char **end, const std::string &option);
+
+
+#endif //PARTPLAY_EXAMPLE_TIME_SERIES_CONVERSION_HPP
@@ -63,17 +63,87 @@ namespace std {
   }
 %}
 
+// frames in memory are passed to the converter as direct java.nio.ShortBuffers (no copy), the elements from the
+// position of the buffer are used (javain slices it) and the converter gets their number to check the dims and strides
+%typemap(jni) (const uint16_t *buffer, uint64_t buffer_size) "jobject"
+%typemap(jtype) (const uint16_t *buffer, uint64_t buffer_size) "java.nio.ShortBuffer"
+%typemap(jstype) (const uint16_t *buffer, uint64_t buffer_size) "java.nio.ShortBuffer"
+%typemap(javain) (const uint16_t *buffer, uint64_t buffer_size) "$javainput.slice()"
+%typemap(in) (const uint16_t *buffer, uint64_t buffer_size) {
+  $1 = (uint16_t *) jenv->GetDirectBufferAddress($input);
+  if ($1 == NULL) {
+    SWIG_JavaThrowException(jenv, SWIG_JavaIllegalArgumentException, "Unable to get the address of the buffer, it must be a direct java.nio.ShortBuffer");
+    return $null;
+  }
+  $2 = (uint64_t) jenv->GetDirectBufferCapacity($input);
+}
+
+%exception get_apr_from_buffer {
+  try {
+    $action
+  } catch (const std::invalid_argument &e) {
+    SWIG_JavaThrowException(jenv, SWIG_JavaIllegalArgumentException, e.what());
+    return $null;
+  }
+}
+
 %{
+#include <stdexcept>
 #include "src/data_structures/APR/APR.hpp"
 #include "src/numerics/APRNumerics.hpp"
+#include "src/algorithm/APRConverter.hpp"
 %}
 
 %include "src/data_structures/Mesh/MeshData.hpp"
 %include "src/data_structures/APR/APR.hpp"
+%include "src/data_structures/APR/APRLinearIterator.hpp"
 %include "src/data_structures/APR/APRIterator.hpp"
 %include "src/numerics/APRNumerics.hpp"
 %include "src/data_structures/APR/ExtraParticleData.hpp"
 %include "src/data_structures/APR/ExtraPartCellData.hpp"
+%include "src/algorithm/APRParameters.hpp"
+
+// the public conversion interface of APRConverter (the full class is not wrapped)
+template<typename ImageType>
+class APRConverter {
+public:
+    APRParameters par;
+    bool reuse_workspace;
+
+    bool get_apr(APR<ImageType> &aAPR);
+    void release_workspace();
+};
+
+// get_apr_from_buffer with the number of elements of the buffer, so a buffer too short for the dims and strides (or
+// negative strides reaching before it) throws instead of reading outside of it
+%extend APRConverter<uint16_t> {
+    bool get_apr_from_buffer(APR<uint16_t> &aAPR, const uint16_t *buffer, uint64_t buffer_size, uint64_t y_num, uint64_t x_num, uint64_t z_num,
+                             bool compute_parameters = true, int64_t stride_y = 1, int64_t stride_x = 0, int64_t stride_z = 0) {
+        if((y_num == 0) || (x_num == 0) || (z_num == 0)) {
+            throw std::invalid_argument("The image dimensions must be positive");
+        }
+
+        //the lowest and highest element read (strides of 0 are contiguous, as in APRConverter::get_apr_from_buffer)
+        const int64_t strides[3] = {stride_y, (stride_x == 0) ? (int64_t)y_num : stride_x, (stride_z == 0) ? (int64_t)(y_num*x_num) : stride_z};
+        const int64_t last[3] = {(int64_t)y_num - 1, (int64_t)x_num - 1, (int64_t)z_num - 1};
+        int64_t first_element = 0;
+        int64_t last_element = 0;
+        for (int d = 0; d < 3; ++d) {
+            if(strides[d] < 0) {
+                first_element += last[d]*strides[d];
+            } else {
+                last_element += last[d]*strides[d];
+            }
+        }
+
+        if((first_element < 0) || ((uint64_t)last_element >= buffer_size)) {
+            throw std::invalid_argument("The image dimensions and strides read elements " + std::to_string(first_element) + " to " +
+                                        std::to_string(last_element) + " of a buffer with " + std::to_string(buffer_size) + " remaining elements");
+        }
+
+        return $self->get_apr_from_buffer(aAPR, buffer, y_num, x_num, z_num, compute_parameters, stride_y, stride_x, stride_z);
+    }
+}
 
 %pointer_class(uint16_t, UInt16Pointer);
 
@@ -106,5 +176,6 @@ namespace std {
 %template(APRFloat) APR<float>;
 %template(APRIteratorStd) APRIterator<uint16_t>;
 %template(APRStd) APR<uint16_t>;
+%template(APRConverterStd) APRConverter<uint16_t>;
 
 
@@ -9,6 +9,12 @@
 #ifndef PARTPLAY_APR_CONVERTER_HPP
 #define PARTPLAY_APR_CONVERTER_HPP
 
+#include <algorithm>
+#include <cstring>
+#include <functional>
+#include <iomanip>
+#include <numeric>
+
 #include "../data_structures/Mesh/MeshData.hpp"
 #include "../io/TiffUtils.hpp"
 #include "../data_structures/APR/APR.hpp"
@@ -17,6 +23,7 @@
 #include "LocalIntensityScale.hpp"
 #include "LocalParticleCellSet.hpp"
 #include "PullingScheme.hpp"
+#include "APRTiling.hpp"
 
 
 template<typename ImageType>
@@ -48,176 +55,1242 @@ public:
         }
     };
 
-private:
-    //get apr without setting parameters, and with an already loaded image.
+    //converts an image already in memory (with automatic parameters as get_apr, normalized_input rescales the image in place)
+    template<typename T>
+    bool get_apr(APR<ImageType> &aAPR, MeshData<T> &input_image);
+
+    //get apr without setting parameters, and with an already loaded image (e.g. the frames of a time series after the first)
     template<typename T>
     bool get_apr_method(APR<ImageType> &aAPR, MeshData<T> &input_image);
 
+    //converts an image in memory owned by the caller, element (y,x,z) at buffer[y*stride_y + x*stride_x + z*stride_z]
+    //(strides in elements, 0 for contiguous). The buffer is only read, and used in place if it is contiguous in y -> x -> z
+    //(as MeshData), otherwise it is copied. Without compute_parameters the parameters in par are used as they are.
+    template<typename T>
+    bool get_apr_from_buffer(APR<ImageType> &aAPR, const T *buffer, uint64_t y_num, uint64_t x_num, uint64_t z_num, bool compute_parameters = true,
+                             int64_t stride_y = 1, int64_t stride_x = 0, int64_t stride_z = 0);
+
+    /////////////////////////
+    /// Workspace
+    ///
+    /////////////////////////
+
+    //keep the buffers of the pipeline across calls (for converting many same sized images, e.g. a time series),
+    //otherwise they are released at the end of each conversion
+    bool reuse_workspace = false;
+
+    void release_workspace();
+
+    /////////////////////////
+    /// Filter cache
+    ///
+    /////////////////////////
+
+    //keep the gradient magnitude and the (not yet rescaled) Local Intensity Scale of the last image in get_apr_method, so
+    //converting the same image again with only rel_error, sigma_th or sigma_th_max (min_signal) changed skips the filters
+    //(they depend on the image, Ip_th, lambda, the pixel spacing, the psf and the mask, the cache is re-computed if any changes)
+    bool cache_filters = false;
+
+    void clear_filter_cache();
+
+    /////////////////////////
+    /// Particle budget
+    ///
+    /////////////////////////
+
+    //converts the image with the rel_error that gives at most max_particles particles (and at least (1 - tolerance)*max_particles
+    //if the search gets there within max_iterations), the other parameters in par are used as they are. The filters are
+    //only computed once and the particles are counted on the particle cell tree, the rel_error found is left in par
+    //(par is unchanged if no rel_error within the search gives at most max_particles).
+    template<typename T>
+    bool get_apr_particle_budget(APR<ImageType> &aAPR, MeshData<T> &input_image, uint64_t max_particles, float tolerance = 0.02f, unsigned int max_iterations = 30);
+
+    /////////////////////////
+    /// Filter passes
+    ///
+    /////////////////////////
+
+    //fuse the element-wise passes of the filters into the passes next to them (the down-sampling into the inverse b-spline
+    //in y, the copy and the absolute difference into the SAT means in y), the results are the same with less memory traffic
+    bool fuse_filter_passes = true;
+
+    //time and nominal memory traffic (bytes read and written by the pass, without row buffers) of the filter stages of the
+    //last image the filters were computed for
+    struct FilterStage {
+        std::string name;
+        double time;
+        uint64_t bytes;
+    };
+    std::vector<FilterStage> filter_stages;
+
+    //table of the filter stages with their bandwidth, and the totals
+    void print_filter_bandwidth(std::ostream &out = std::cout) const;
+
+    /////////////////////////
+    /// Tiled conversion
+    ///
+    /////////////////////////
+
+    //regular grid of tiles over an image with the levels of the full image (tile sizes and overlap in pixels)
+    APRTiling get_tiling(uint64_t y_num, uint64_t x_num, uint64_t z_num, uint64_t tile_size_y, uint64_t tile_size_x, uint64_t tile_size_z, uint64_t overlap);
+
+    //overlap (in pixels) the tiles need for the filters with the current parameters (b-spline smoothing, gradient, Local Intensity Scale)
+    uint64_t get_tile_overlap();
+
+    //converts the image tile by tile, load_tile(tile, image) loads the box of the tile (each tile is loaded twice)
+    template<typename T>
+    bool get_apr_tiled(APR<ImageType> &aAPR, const APRTiling &tiling, const std::function<bool(const APRTile&, MeshData<T>&)> &load_tile);
+
+    //the steps of get_apr_tiled, get_tile_seeds and sample_tile_particles can be run for different tiles in parallel (e.g. on different machines)
+    template<typename T>
+    bool get_tile_seeds(const APRTiling &tiling, size_t tile_number, MeshData<T> &tile_image, APRTileSeeds &tile_seeds);
+    void begin_stitching(APR<ImageType> &aAPR, const APRTiling &tiling);
+    bool add_tile_seeds(const APRTiling &tiling, size_t tile_number, const APRTileSeeds &tile_seeds);
+    void finish_stitching(APR<ImageType> &aAPR, const APRTiling &tiling);
+    bool stitch_tile_seeds(APR<ImageType> &aAPR, const APRTiling &tiling, const std::vector<APRTileSeeds> &tile_seeds);
+    template<typename T>
+    bool sample_tile_particles(APR<ImageType> &aAPR, const APRTiling &tiling, size_t tile_number, MeshData<T> &tile_image, MeshData<T> &coarse_image);
+    template<typename T>
+    void sample_coarse_particles(APR<ImageType> &aAPR, const APRTiling &tiling, MeshData<T> &coarse_image);
+
+    /////////////////////////
+    /// Streaming (out-of-core) conversion
+    ///
+    /////////////////////////
+
+    //z-slabs over an image, as thick as the memory budget (in bytes) allows (no tiles if the budget is too small)
+    APRTiling get_slab_tiling(uint64_t y_num, uint64_t x_num, uint64_t z_num, uint64_t memory_budget, size_t input_type_size);
+
+    //converts the tiff file given in par in z-slabs read from the file, so the image never has to fit in memory
+    bool get_apr_streaming(APR<ImageType> &aAPR, uint64_t memory_budget);
+
+private:
     //pointer to the APR structure so member functions can have access if they need
     const APR<ImageType> *apr;
 
     template<typename T>
     void init_apr(APR<ImageType>& aAPR, MeshData<T>& input_image);
 
-    template<typename T>
-    void auto_parameters(const MeshData<T> &input_img);
+    static void get_level_range(uint64_t y_num, uint64_t x_num, uint64_t z_num, unsigned int &level_min, unsigned int &level_max);
+
+    template<typename T>
+    void compute_local_particle_cell_set(APR<ImageType> &aAPR, MeshData<T> &input_image, MeshData<float> *level_image = nullptr, unsigned int level_image_level = 0, bool use_filter_cache = false);
+
+    template<typename T>
+    bool get_apr_streaming_method(APR<ImageType> &aAPR, const TiffUtils::TiffInfo &aTiffFile, uint64_t memory_budget);
+
+    //the particle cell tree (and the level image at level_align) of the full image while the tiles are stitched
+    std::vector<MeshData<uint8_t>> stitched_particle_cell_tree;
+    MeshData<float> stitched_level_image;
+
+    //buffers of the pipeline, kept across calls if reuse_workspace is set (MeshData re-uses same sized allocations)
+    struct Workspace {
+        MeshData<ImageType> image_temp;
+        MeshData<ImageType> grad_temp;
+        MeshData<float> local_scale_temp;
+        MeshData<float> local_scale_temp2;
+        std::vector<MeshData<ImageType>> downsampled_img;
+        ArenaPartCellData<std::pair<uint16_t,YGap_map>> gap_scratch;
+    } workspace;
+
+    //the rescaling of the input image applied by the pre-pass (set by get_apr for normalized_input while it runs the pipeline,
+    //the values are held in double and evaluated in the input type, see InputNormalization)
+    struct PendingNormalization {
+        bool active = false;
+        double min = 0;
+        double max_value = 0;
+        double range = 0;
+    } input_normalization;
+
+    //the filter results of the last image and what they were computed from (see cache_filters)
+    struct FilterCache {
+        bool valid = false;
+        uint64_t image_checksum = 0;
+        uint64_t dims[3] = {0,0,0};
+        PendingNormalization normalization;
+        APRParameters par;
+        MeshData<ImageType> grad;
+        MeshData<float> local_scale;
+    } filter_cache;
+
+    bool filter_cache_matches(uint64_t image_checksum, uint64_t y_num, uint64_t x_num, uint64_t z_num) const;
+
+    template<typename T>
+    static uint64_t get_image_checksum(const MeshData<T> &input_image);
+
+    template<typename T>
+    uint64_t get_number_particles(APR<ImageType> &aAPR, MeshData<T> &input_image, float rel_error);
+
+    //the down-sampled pyramid is only kept for images of the APR type
+    template<typename T>
+    std::vector<MeshData<T>>& pyramid_buffers(std::vector<MeshData<T>> &local_buffers) { return local_buffers; }
+    std::vector<MeshData<ImageType>>& pyramid_buffers(std::vector<MeshData<ImageType>> &) { return workspace.downsampled_img; }
+
+    template<typename T>
+    void auto_parameters(const MeshData<T> &input_img);
+
+    //slice(z) gives the pixels of slice z of the image, only called for the slices of auto_parameters_read_slices
+    template<typename T, typename S>
+    void auto_parameters(const uint64_t y_num, const uint64_t x_num, const uint64_t z_num, S slice);
+
+    //auto_parameters of an image that is not in memory, load_slice(z, pixels) reads slice z of the image
+    template<typename T, typename L>
+    bool auto_parameters_from_slices(const uint64_t y_num, const uint64_t x_num, const uint64_t z_num, L load_slice);
+
+    std::vector<size_t> auto_parameters_slices(const uint64_t y_num, const uint64_t x_num, const uint64_t z_num) const {
+        //evenly spaced slices with about par.total_required_pixel pixels, the statistics are only computed on these
+        const size_t num_slices = std::max(std::min((uint64_t)ceil(par.total_required_pixel/(1.0*y_num*x_num)), z_num), (uint64_t)1);
+        const size_t delta = std::max((uint64_t)1, (uint64_t)(z_num/num_slices));
+        std::vector<size_t> slices(num_slices);
+        for (size_t i = 0; i < num_slices; ++i) {
+            slices[i] = delta*i;
+        }
+        return slices;
+    }
+
+    static int64_t auto_parameters_patch_slice(const size_t slice, const uint64_t z_num) {
+        //the noise patches of a selected slice are taken around it, limited to the range [1, z_num-2]
+        return std::min((int64_t) z_num - 2, std::max((int64_t) slice, (int64_t) 1));
+    }
+
+    std::vector<size_t> auto_parameters_read_slices(const uint64_t y_num, const uint64_t x_num, const uint64_t z_num) const {
+        //the selected slices and the slices their noise patches are taken from (in order, without duplicates)
+        std::vector<size_t> slices;
+        for (const size_t s : auto_parameters_slices(y_num, x_num, z_num)) {
+            slices.push_back(s);
+            if(z_num > 2) {
+                const int64_t z = auto_parameters_patch_slice(s, z_num);
+                slices.insert(slices.end(), {(size_t) z - 1, (size_t) z, (size_t) z + 1});
+            }
+        }
+        std::sort(slices.begin(), slices.end());
+        slices.erase(std::unique(slices.begin(), slices.end()), slices.end());
+        return slices;
+    }
+
+    template<typename T>
+    bool get_apr_method_from_file(APR<ImageType> &aAPR, const TiffUtils::TiffInfo &aTiffFile);
+
+    template<typename T>
+    float preprocess_input(MeshData<T> &input_image, MeshData<ImageType> &image_temp);
+
+    //adds the last stage of fine_grained_timer to filter_stages
+    void record_filter_stage(uint64_t bytes) {
+        filter_stages.push_back({fine_grained_timer.timing_names.back(), fine_grained_timer.timings.back(), bytes});
+    }
+
+    template<typename T>
+    void normalize_input(MeshData<T> &input_image);
+
+    void get_gradient(MeshData<ImageType> &image_temp, MeshData<ImageType> &grad_temp, MeshData<float> &local_scale_temp, MeshData<float> &local_scale_temp2, float bspline_offset);
+    void get_local_intensity_scale(MeshData<float> &local_scale_temp, MeshData<float> &local_scale_temp2);
+    void get_local_particle_cell_set(MeshData<ImageType> &grad_temp, MeshData<float> &local_scale_temp, MeshData<float> &local_scale_temp2, MeshData<float> *level_image = nullptr, unsigned int level_image_level = 0);
+};
+
+template <typename T>
+struct MinMax{T min; T max; };
+
+template <typename T>
+MinMax<T> getMinMax(const MeshData<T>& input_image) {
+    T minVal = std::numeric_limits<T>::max();
+    T maxVal = std::numeric_limits<T>::min();
+
+#ifdef HAVE_OPENMP
+#pragma omp parallel for default(shared) reduction(max:maxVal) reduction(min:minVal)
+#endif
+    for (size_t i = 0; i < input_image.mesh.size(); ++i) {
+        T val = input_image.mesh[i];
+        if (val > maxVal) maxVal = val;
+        if (val < minVal) minVal = val;
+    }
+
+    return MinMax<T>{minVal, maxVal};
+}
+
+template <typename T>
+struct InputNormalization {
+    //
+    //  Rescaling of the input intensities to [0, max_value] (normalized_input), evaluated in the input type (integer
+    //  arithmetic for integer images)
+    //
+    T min;
+    T max_value;
+    T range;
+
+    inline T operator()(const T v) const { return (v - min) * max_value / range; }
+};
+
+template<typename ImageType, bool = std::is_integral<ImageType>::value>
+struct PipelineCast {
+    static inline ImageType cast(const float v) { return v; }
+};
+
+template<typename ImageType>
+struct PipelineCast<ImageType, true> {
+    //integer pipeline types saturate (the offset can take the brightest pixels past the maximum of the type)
+    static inline ImageType cast(const float v) {
+        return (v >= (float) std::numeric_limits<ImageType>::max()) ? std::numeric_limits<ImageType>::max() :
+               ((v <= (float) std::numeric_limits<ImageType>::lowest()) ? std::numeric_limits<ImageType>::lowest() : (ImageType) v);
+    }
+};
+
+template<typename ImageType, typename T, bool normalize>
+void preprocess_image(MeshData<T> &input_image, MeshData<ImageType> &image_temp, const InputNormalization<T> &normalization, const float offset, const float threshold) {
+    //
+    //  The pre-processing of the input in one pass: (normalize, written back to the input image), offset, clamp from below
+    //  at the threshold and convert to the pipeline type. Instantiated per input / pipeline type pair and normalization,
+    //  so the loop is branch free and vectorizes. (Clamping before the conversion gives the same as thresholding the
+    //  converted value, the conversion is monotone.)
+    //
+
+    T* input = input_image.mesh.begin();
+    ImageType* output = image_temp.mesh.begin();
+    const int64_t size = input_image.mesh.size();
+
+    int64_t i;
+    #ifdef HAVE_OPENMP
+    #pragma omp parallel for simd schedule(static) private(i)
+    #endif
+    for (i = 0; i < size; ++i) {
+        T v = input[i];
+        if (normalize) {
+            v = normalization(v);
+            input[i] = v;
+        }
+        output[i] = PipelineCast<ImageType>::cast(std::max(v + offset, threshold));
+    }
+}
+
+/**
+ * Main method for constructing the APR from an input image
+ */
+template<typename ImageType> template<typename T>
+bool APRConverter<ImageType>::get_apr_method_from_file(APR<ImageType> &aAPR, const TiffUtils::TiffInfo &aTiffFile) {
+    allocation_timer.start_timer("read tif input image");
+    MeshData<T> inputImage = TiffUtils::getMesh<T>(aTiffFile);
+    allocation_timer.stop_timer();
+
+    return get_apr(aAPR, inputImage);
+}
+
+/**
+ * Main method for constructing the APR from an image in memory, the automatic parameters are computed from the image
+ */
+template<typename ImageType> template<typename T>
+bool APRConverter<ImageType>::get_apr(APR<ImageType> &aAPR, MeshData<T> &inputImage) {
+    apr = &aAPR;
+
+    method_timer.start_timer("calculate automatic parameters");
+
+    input_normalization = PendingNormalization();
+
+    if(par.normalized_input) {
+
+        if ((std::is_same<uint16_t, ImageType>::value) || (std::is_same<uint8_t, ImageType>::value)) {
+            MinMax<T> mm = getMinMax(inputImage);
+            T maxValue = static_cast<T>((float) std::numeric_limits<ImageType>::max() * 0.8);
+            std::cout << "MM: " << mm.min << " " << mm.max << " " << maxValue << std::endl;
+
+            if(mm.max > mm.min) {
+                //the image is rescaled (in place) by the pre-pass of the pipeline, the parameters are computed from the
+                //rescaled slices they are taken from
+                input_normalization.active = true;
+                input_normalization.min = mm.min;
+                input_normalization.max_value = maxValue;
+                input_normalization.range = mm.max - mm.min;
+            }
+        }
+    }
+
+    if(input_normalization.active) {
+        //only the slices auto_parameters reads are normalized (with their z neighbours)
+        const InputNormalization<T> normalization{(T) input_normalization.min, (T) input_normalization.max_value, (T) input_normalization.range};
+        const size_t slice_size = inputImage.y_num*inputImage.x_num;
+
+        auto_parameters_from_slices<T>(inputImage.y_num, inputImage.x_num, inputImage.z_num, [&inputImage, &normalization, slice_size](const size_t z, T* pixels) {
+            std::transform(inputImage.mesh.begin() + z*slice_size, inputImage.mesh.begin() + (z + 1)*slice_size, pixels, normalization);
+            return true;
+        });
+    } else {
+        auto_parameters(inputImage);
+    }
+    method_timer.stop_timer();
+
+    const bool success = get_apr_method(aAPR, inputImage);
+    input_normalization = PendingNormalization();
+
+    return success;
+}
+
+/**
+ * Constructs the APR from an image in caller owned memory, without copying it if it has the layout of MeshData
+ */
+template<typename ImageType> template<typename T>
+bool APRConverter<ImageType>::get_apr_from_buffer(APR<ImageType> &aAPR, const T *buffer, uint64_t y_num, uint64_t x_num, uint64_t z_num, bool compute_parameters,
+                                                  int64_t stride_y, int64_t stride_x, int64_t stride_z) {
+    if(stride_x == 0) stride_x = y_num;
+    if(stride_z == 0) stride_z = y_num * x_num;
+
+    const bool contiguous = (stride_y == 1) && (stride_x == (int64_t)y_num) && (stride_z == (int64_t)(y_num * x_num));
+
+    MeshData<T> input_image;
+
+    if(contiguous && !(compute_parameters && par.normalized_input)) {
+        //the pipeline only reads the input image (normalization would rescale it in place)
+        input_image.setView(const_cast<T*>(buffer), y_num, x_num, z_num);
+    } else {
+        allocation_timer.start_timer("copy input buffer");
+        input_image.init(y_num, x_num, z_num);
+
+        int64_t z;
+        #ifdef HAVE_OPENMP
+        #pragma omp parallel for default(shared) private(z)
+        #endif
+        for (z = 0; z < (int64_t)z_num; ++z) {
+            for (int64_t x = 0; x < (int64_t)x_num; ++x) {
+                const T* buffer_row = buffer + z * stride_z + x * stride_x;
+                T* mesh_row = &input_image.at(0, x, z);
+                for (int64_t y = 0; y < (int64_t)y_num; ++y) {
+                    mesh_row[y] = buffer_row[y * stride_y];
+                }
+            }
+        }
+        allocation_timer.stop_timer();
+    }
+
+    return compute_parameters ? get_apr(aAPR, input_image) : get_apr_method(aAPR, input_image);
+}
+
+/**
+ * Main method for constructing the APR from an input image
+ */
+template<typename ImageType> template<typename T>
+bool APRConverter<ImageType>::get_apr_method(APR<ImageType> &aAPR, MeshData<T>& input_image) {
+    apr = &aAPR; // in case it was called directly
+
+    total_timer.start_timer("Total_pipeline_excluding_IO");
+
+    init_apr(aAPR, input_image);
+
+    computation_timer.start_timer("Calculations");
+
+    compute_local_particle_cell_set(aAPR, input_image, nullptr, 0, cache_filters);
+
+    method_timer.start_timer("compute_pulling_scheme");
+    PullingScheme::pulling_scheme_main();
+    method_timer.stop_timer();
+
+    method_timer.start_timer("downsample_pyramid");
+    std::vector<MeshData<T>> local_downsampled_img;
+    std::vector<MeshData<T>>& downsampled_img = pyramid_buffers(local_downsampled_img);
+    //Down-sample the image for particle intensity estimation
+    downsamplePyrmaid(input_image, downsampled_img, aAPR.level_max(), aAPR.level_min());
+    method_timer.stop_timer();
+
+    method_timer.start_timer("compute_apr_datastructure");
+    aAPR.apr_access.initialize_structure_from_particle_cell_tree(aAPR,particle_cell_tree,&workspace.gap_scratch);
+    method_timer.stop_timer();
+
+    method_timer.start_timer("sample_particles");
+    aAPR.get_parts_from_img(downsampled_img,aAPR.particles_intensities);
+    method_timer.stop_timer();
+
+    //the input image was moved to the top of the pyramid, hand it back
+    input_image.swap(downsampled_img.back());
+
+    computation_timer.stop_timer();
+
+    aAPR.parameters = par;
+
+    if(!reuse_workspace){
+        release_workspace();
+    }
+
+    if(!cache_filters){
+        clear_filter_cache();
+    }
+
+    total_timer.stop_timer();
+
+    return true;
+}
+
+/**
+ * Converts the image with the rel_error giving at most max_particles particles
+ *
+ * The rel_error is first bracketed (stepping from par.rel_error by factors of 4), then bisected (geometrically), each step
+ * only re-runs the level computation and the Pulling Scheme on the cached filter results.
+ */
+template<typename ImageType> template<typename T>
+bool APRConverter<ImageType>::get_apr_particle_budget(APR<ImageType> &aAPR, MeshData<T>& input_image, uint64_t max_particles, float tolerance, unsigned int max_iterations) {
+    const float min_rel_error = 1e-5f;
+    const float max_rel_error = 1e5f;
+
+    //the search sets par.rel_error, the caller's value is restored if no APR is produced
+    const float rel_error_input = par.rel_error;
+
+    method_timer.start_timer("particle_budget_search");
+
+    //rel_error_below gives at most max_particles particles, rel_error_above more (0 if not found yet)
+    float rel_error_below = 0;
+    float rel_error_above = 0;
+    uint64_t number_particles_below = 0;
+    unsigned int iterations = 0;
+
+    float rel_error = (par.rel_error > 0) ? par.rel_error : 0.1f;
+
+    while ((iterations < max_iterations) && ((rel_error_below == 0) || (rel_error_above == 0))) {
+        const uint64_t number_particles = get_number_particles(aAPR, input_image, rel_error);
+        iterations++;
+
+        if (number_particles <= max_particles) {
+            rel_error_below = rel_error;
+            number_particles_below = number_particles;
+            rel_error /= 4;
+        } else {
+            rel_error_above = rel_error;
+            rel_error *= 4;
+        }
+
+        if ((rel_error < min_rel_error) || (rel_error > max_rel_error)) {
+            break;
+        }
+    }
+
+    while ((iterations < max_iterations) && (rel_error_below > 0) && (rel_error_above > 0) &&
+           (number_particles_below < (1 - tolerance)*max_particles)) {
+        rel_error = std::sqrt(rel_error_below*rel_error_above);
+        const uint64_t number_particles = get_number_particles(aAPR, input_image, rel_error);
+        iterations++;
+
+        if (number_particles <= max_particles) {
+            rel_error_below = rel_error;
+            number_particles_below = number_particles;
+        } else {
+            rel_error_above = rel_error;
+        }
+    }
+
+    method_timer.stop_timer();
+
+    if (rel_error_below == 0) {
+        std::cerr << "No rel_error gives at most " << max_particles << " particles" << std::endl;
+        par.rel_error = rel_error_input;
+        if (!cache_filters) {
+            clear_filter_cache();
+        }
+        return false;
+    }
+
+    std::cout << "Particle budget: rel_error " << rel_error_below << " gives " << number_particles_below << " particles ("
+              << iterations << " iterations)" << std::endl;
+
+    //the final conversion re-uses the cached filter results too
+    par.rel_error = rel_error_below;
+    const bool cache_filters_input = cache_filters;
+    cache_filters = true;
+    const bool success = get_apr_method(aAPR, input_image);
+    cache_filters = cache_filters_input;
+    if (!cache_filters) {
+        clear_filter_cache();
+    }
+
+    if (!success) {
+        par.rel_error = rel_error_input;
+    }
+
+    return success;
+}
+
+/**
+ * Number of particles the image gives with the rel_error (the filters are cached, the access structure is not built)
+ */
+template<typename ImageType> template<typename T>
+uint64_t APRConverter<ImageType>::get_number_particles(APR<ImageType> &aAPR, MeshData<T>& input_image, float rel_error) {
+    par.rel_error = rel_error;
+
+    init_apr(aAPR, input_image);
+    compute_local_particle_cell_set(aAPR, input_image, nullptr, 0, true);
+    PullingScheme::pulling_scheme_main();
+
+    return count_particles(input_image.y_num, input_image.x_num, input_image.z_num);
+}
+
+/**
+ * Computes the Local Particle Cell set of the image (in particle_cell_tree), the levels and dimensions of the APR have to be set
+ * (if level_image is given, the level of the particle cells at level_image_level is copied to it)
+ */
+template<typename ImageType> template<typename T>
+void APRConverter<ImageType>::compute_local_particle_cell_set(APR<ImageType> &aAPR, MeshData<T>& input_image, MeshData<float> *level_image, unsigned int level_image_level, bool use_filter_cache) {
+    apr = &aAPR;
+
+    ////////////////////////////////////////
+    /// Memory allocation of variables
+    ////////////////////////////////////////
+
+    //assuming uint16, the total memory cost shoudl be approximately (1 + 1 + 1/8 + 2/8 + 2/8) = 2 5/8 original image size in u16bit
+    //storage of the particle cell tree for computing the pulling scheme
+    allocation_timer.start_timer("init and copy image");
+    MeshData<ImageType>& image_temp = workspace.image_temp; // global image variable useful for passing between methods, or re-using memory (should be the only full sized copy of the image)
+    MeshData<ImageType>& grad_temp = workspace.grad_temp; // should be a down-sampled image
+    grad_temp.initDownsampled(input_image.y_num, input_image.x_num, input_image.z_num, 0);
+    MeshData<float>& local_scale_temp = workspace.local_scale_temp; // Used as down-sampled images for some averaging steps where it is useful to not lose precision, or get over-flow errors
+    local_scale_temp.initDownsampled(input_image.y_num, input_image.x_num, input_image.z_num);
+    MeshData<float>& local_scale_temp2 = workspace.local_scale_temp2;
+    local_scale_temp2.initDownsampled(input_image.y_num, input_image.x_num, input_image.z_num);
+    allocation_timer.stop_timer();
+
+    filter_stages.clear();
+
+    uint64_t image_checksum = 0;
+    if(use_filter_cache) {
+        fine_grained_timer.start_timer("image_checksum");
+        image_checksum = get_image_checksum(input_image);
+        fine_grained_timer.stop_timer();
+    }
+
+    if(use_filter_cache && filter_cache_matches(image_checksum, input_image.y_num, input_image.x_num, input_image.z_num)) {
+        method_timer.start_timer("load_cached_filters");
+        grad_temp.copyFromMesh(filter_cache.grad);
+        local_scale_temp.copyFromMesh(filter_cache.local_scale);
+        method_timer.stop_timer();
+
+        if(input_normalization.active) {
+            fine_grained_timer.start_timer("normalize image");
+            normalize_input(input_image);
+            fine_grained_timer.stop_timer();
+        }
+    } else {
+        allocation_timer.start_timer("init and copy image");
+        image_temp.init(input_image);
+        allocation_timer.stop_timer();
+
+        /////////////////////////////////
+        /// Pipeline
+        ////////////////////////
+
+        fine_grained_timer.start_timer("preprocess image");
+        const float bspline_offset = preprocess_input(input_image, image_temp);
+        fine_grained_timer.stop_timer();
+        record_filter_stage(input_image.mesh.size()*((input_normalization.active ? 2 : 1)*sizeof(T) + sizeof(ImageType)));
+
+        method_timer.start_timer("compute_gradient_magnitude_using_bsplines");
+        get_gradient(image_temp, grad_temp, local_scale_temp, local_scale_temp2, bspline_offset);
+        method_timer.stop_timer();
+
+        method_timer.start_timer("compute_local_intensity_scale");
+        get_local_intensity_scale(local_scale_temp, local_scale_temp2);
+        method_timer.stop_timer();
+
+        if(use_filter_cache) {
+            method_timer.start_timer("store_cached_filters");
+            filter_cache.grad.init(grad_temp);
+            filter_cache.grad.copyFromMesh(grad_temp);
+            filter_cache.local_scale.init(local_scale_temp);
+            filter_cache.local_scale.copyFromMesh(local_scale_temp);
+            filter_cache.image_checksum = image_checksum;
+            filter_cache.dims[0] = input_image.y_num;
+            filter_cache.dims[1] = input_image.x_num;
+            filter_cache.dims[2] = input_image.z_num;
+            filter_cache.normalization = input_normalization;
+            filter_cache.par = par;
+            filter_cache.valid = true;
+            method_timer.stop_timer();
+        }
+    }
+
+    fine_grained_timer.start_timer("rescale_local_intensity_scale");
+    float var_rescale;
+    std::vector<int> var_win;
+    get_window(var_rescale,var_win,par);
+    rescale_var_and_threshold(local_scale_temp, var_rescale, par);
+    fine_grained_timer.stop_timer();
+    record_filter_stage(2*local_scale_temp.mesh.size()*sizeof(float));
+
+    method_timer.start_timer("initialize_particle_cell_tree");
+    initialize_particle_cell_tree(aAPR);
+    method_timer.stop_timer();
+
+    method_timer.start_timer("compute_local_particle_set");
+    get_local_particle_cell_set(grad_temp, local_scale_temp, local_scale_temp2, level_image, level_image_level);
+    method_timer.stop_timer();
+}
+
+/**
+ * Frees the buffers of the pipeline (including the particle cell tree)
+ */
+template<typename ImageType>
+void APRConverter<ImageType>::release_workspace() {
+    workspace = Workspace();
+    particle_cell_tree.clear();
+}
+
+/**
+ * Frees the cached filter results
+ */
+template<typename ImageType>
+void APRConverter<ImageType>::clear_filter_cache() {
+    filter_cache = FilterCache();
+}
+
+/**
+ * Checks if the cached filter results were computed from the same image with the same filter parameters
+ */
+template<typename ImageType>
+bool APRConverter<ImageType>::filter_cache_matches(uint64_t image_checksum, uint64_t y_num, uint64_t x_num, uint64_t z_num) const {
+    const APRParameters& c = filter_cache.par;
+    const PendingNormalization& n = filter_cache.normalization;
+    return filter_cache.valid && (filter_cache.image_checksum == image_checksum) &&
+           (n.active == input_normalization.active) && (n.min == input_normalization.min) &&
+           (n.max_value == input_normalization.max_value) && (n.range == input_normalization.range) &&
+           (filter_cache.dims[0] == y_num) && (filter_cache.dims[1] == x_num) && (filter_cache.dims[2] == z_num) &&
+           (c.Ip_th == par.Ip_th) && (c.lambda == par.lambda) && (c.dx == par.dx) && (c.dy == par.dy) && (c.dz == par.dz) &&
+           (c.psfx == par.psfx) && (c.psfy == par.psfy) && (c.psfz == par.psfz) && (c.mask_file == par.mask_file);
+}
+
+/**
+ * Checksum of the pixels of an image (computed per z slice in parallel and combined in order)
+ */
+template<typename ImageType> template<typename T>
+uint64_t APRConverter<ImageType>::get_image_checksum(const MeshData<T> &input_image) {
+    const size_t slice_size = input_image.x_num*input_image.y_num;
+    std::vector<uint64_t> slice_checksums(input_image.z_num);
+
+    int64_t z;
+    #ifdef HAVE_OPENMP
+    #pragma omp parallel for schedule(static) private(z)
+    #endif
+    for (z = 0; z < (int64_t)input_image.z_num; ++z) {
+        //FNV-1a over the pixel values
+        uint64_t checksum = 14695981039346656037ULL;
+        for (size_t i = z*slice_size; i < (z + 1)*slice_size; ++i) {
+            T val = input_image.mesh[i];
+            uint64_t bits = 0;
+            std::memcpy(&bits, &val, sizeof(T));
+            checksum = (checksum ^ bits)*1099511628211ULL;
+        }
+        slice_checksums[z] = checksum;
+    }
+
+    uint64_t checksum = 14695981039346656037ULL;
+    for (auto const &slice_checksum : slice_checksums) {
+        checksum = (checksum ^ slice_checksum)*1099511628211ULL;
+    }
+    return checksum;
+}
+
+/**
+ * Regular grid of tiles for tiled conversion, with the levels of the full image
+ */
+template<typename ImageType>
+APRTiling APRConverter<ImageType>::get_tiling(uint64_t y_num, uint64_t x_num, uint64_t z_num, uint64_t tile_size_y, uint64_t tile_size_x, uint64_t tile_size_z, uint64_t overlap) {
+    unsigned int levelMin, levelMax;
+    get_level_range(y_num, x_num, z_num, levelMin, levelMax);
+
+    APRTiling tiling;
+    tiling.initialize(y_num, x_num, z_num, levelMin, levelMax, APRTiling::default_level_align(levelMin, levelMax), tile_size_y, tile_size_x, tile_size_z, overlap);
+    return tiling;
+}
+
+/**
+ * Overlap (in pixels) of the tiles, so the filters see the same neighbourhood in a tile as in the full image
+ */
+template<typename ImageType>
+uint64_t APRConverter<ImageType>::get_tile_overlap() {
+    //
+    //  b-spline smoothing: the recursive filters are initialised over get_bspline_support pixels
+    //  gradient and inverse b-spline: one pixel, and one down-sampled pixel
+    //  Local Intensity Scale: the two mean filters (on the down-sampled image)
+    //  The Pulling Scheme needs no overlap, it is run on the stitched particle cell tree of the full image
+    //
+
+    float var_rescale;
+    std::vector<int> var_win;
+    get_window(var_rescale,var_win,par);
+
+    const uint64_t win = std::max(std::max(var_win[0],var_win[1]),var_win[2]);
+    const uint64_t win2 = std::max(std::max(var_win[3],var_win[4]),var_win[5]);
+
+    return get_bspline_support(par.lambda) + 1 + 2*(1 + win + win2) + 2;
+}
+
+/**
+ * Tiled conversion, only one tile is held in memory at a time
+ *
+ * The Local Particle Cell set is computed for each tile separately, the sets of the cores are stitched into the
+ * particle cell tree of the full image and the Pulling Scheme is run on it, so the neighbour constraints hold across
+ * the tiles exactly as for a single image. The particles of each core are then sampled from its tile, the particles of
+ * the particle cells larger than the tile alignment from a down-sampled image assembled from the tiles. The result is
+ * the same as converting the full image if the overlap covers the support of the filters (see get_tile_overlap), the
+ * parameters in par are used as they are (no automatic parameters).
+ */
+template<typename ImageType> template<typename T>
+bool APRConverter<ImageType>::get_apr_tiled(APR<ImageType> &aAPR, const APRTiling &tiling, const std::function<bool(const APRTile&, MeshData<T>&)> &load_tile) {
+
+    if(!tiling.valid()){
+        std::cerr << "Invalid tiling" << std::endl;
+        return false;
+    }
+
+    total_timer.start_timer("Total_pipeline_tiled");
+
+    begin_stitching(aAPR, tiling);
+
+    //a failed tile stops the conversion, the workspace is still released and the timers stopped
+    bool success = true;
+
+    method_timer.start_timer("compute_tile_local_particle_sets");
+    for (size_t i = 0; success && (i < tiling.tiles.size()); ++i) {
+        MeshData<T> tile_image;
+        APRTileSeeds tile_seeds;
+        success = load_tile(tiling.tiles[i], tile_image) && get_tile_seeds(tiling, i, tile_image, tile_seeds) &&
+                  add_tile_seeds(tiling, i, tile_seeds);
+    }
+    method_timer.stop_timer();
+
+    if(success) {
+        method_timer.start_timer("stitch_and_pulling_scheme");
+        finish_stitching(aAPR, tiling);
+        method_timer.stop_timer();
+
+        method_timer.start_timer("sample_tile_particles");
+        MeshData<T> coarse_image;
+        for (size_t i = 0; success && (i < tiling.tiles.size()); ++i) {
+            MeshData<T> tile_image;
+            success = load_tile(tiling.tiles[i], tile_image) && sample_tile_particles(aAPR, tiling, i, tile_image, coarse_image);
+        }
+        if(success) {
+            sample_coarse_particles(aAPR, tiling, coarse_image);
+        }
+        method_timer.stop_timer();
+    }
+
+    if(!success){
+        stitched_particle_cell_tree.clear();
+        stitched_level_image.init(0, 0, 0);
+    }
+
+    if(!reuse_workspace){
+        release_workspace();
+    }
+
+    total_timer.stop_timer();
+
+    return success;
+}
+
+/**
+ * Computes the Local Particle Cell set of a tile and keeps the part of its core
+ */
+template<typename ImageType> template<typename T>
+bool APRConverter<ImageType>::get_tile_seeds(const APRTiling &tiling, size_t tile_number, MeshData<T> &tile_image, APRTileSeeds &tile_seeds) {
+    const APRTile& tile = tiling.tiles[tile_number];
+
+    if((tile_image.y_num != (tile.box.y_end - tile.box.y_begin)) || (tile_image.x_num != (tile.box.x_end - tile.box.x_begin)) ||
+       (tile_image.z_num != (tile.box.z_end - tile.box.z_begin))){
+        std::cerr << "Tile image does not match the tile box" << std::endl;
+        return false;
+    }
+
+    if(par.mask_file != ""){
+        std::cerr << "Masks are not supported for tiled conversion" << std::endl;
+        return false;
+    }
+
+    //the tile is converted with the levels of the full image, so the particle cells are on the same grid
+    APR<ImageType> tile_apr;
+    tile_apr.apr_access.org_dims[0] = tile_image.y_num;
+    tile_apr.apr_access.org_dims[1] = tile_image.x_num;
+    tile_apr.apr_access.org_dims[2] = tile_image.z_num;
+    tile_apr.apr_access.level_min = tiling.level_min;
+    tile_apr.apr_access.level_max = tiling.level_max;
+
+    MeshData<float> tile_level_image;
+    const APR<ImageType>* stitched_apr = apr; //apr must not be left pointing at the local tile_apr
+    compute_local_particle_cell_set(tile_apr, tile_image, &tile_level_image, tiling.level_align);
+    apr = stitched_apr;
+
+    //the particle cells of the core (in the coordinates of the tile), at the given level of the particle cell tree
+    auto copy_core = [&tile](const unsigned int shift, const auto& tile_mesh, auto& core_mesh) {
+        const uint64_t cell_size = ((uint64_t)1) << shift;
+
+        const size_t y_begin = (tile.core.y_begin - tile.box.y_begin) >> shift;
+        const size_t x_begin = (tile.core.x_begin - tile.box.x_begin) >> shift;
+        const size_t z_begin = (tile.core.z_begin - tile.box.z_begin) >> shift;
+        const size_t y_num = (tile.core.y_end - tile.core.y_begin + cell_size - 1) >> shift;
+        const size_t x_num = (tile.core.x_end - tile.core.x_begin + cell_size - 1) >> shift;
+        const size_t z_num = (tile.core.z_end - tile.core.z_begin + cell_size - 1) >> shift;
+
+        core_mesh.init(y_num, x_num, z_num);
+
+        #ifdef HAVE_OPENMP
+        #pragma omp parallel for default(shared) if(z_num * x_num > 100)
+        #endif
+        for (size_t z = 0; z < z_num; ++z) {
+            for (size_t x = 0; x < x_num; ++x) {
+                auto tile_row = tile_mesh.mesh.begin() + (z + z_begin) * tile_mesh.x_num * tile_mesh.y_num + (x + x_begin) * tile_mesh.y_num + y_begin;
+                std::copy(tile_row, tile_row + y_num, core_mesh.mesh.begin() + z * x_num * y_num + x * y_num);
+            }
+        }
+    };
+
+    //below level_align the particle cells can span several tiles, they are computed from the level image once stitched
+    tile_seeds.particle_cell_tree.clear();
+    tile_seeds.particle_cell_tree.resize(l_max + 1);
+
+    for (unsigned int level = tiling.level_align; level <= l_max; ++level) {
+        copy_core(tiling.level_max - level, particle_cell_tree[level], tile_seeds.particle_cell_tree[level]);
+    }
+
+    copy_core(tiling.level_max - tiling.level_align, tile_level_image, tile_seeds.level_image);
+
+    //the tree is only needed for the core
+    particle_cell_tree.clear();
+
+    return true;
+}
+
+/**
+ * Allocates the particle cell tree of the full image, the tiles are then added with add_tile_seeds
+ */
+template<typename ImageType>
+void APRConverter<ImageType>::begin_stitching(APR<ImageType> &aAPR, const APRTiling &tiling) {
+    aAPR.apr_access.org_dims[0] = tiling.org_dims[0];
+    aAPR.apr_access.org_dims[1] = tiling.org_dims[1];
+    aAPR.apr_access.org_dims[2] = tiling.org_dims[2];
+    aAPR.apr_access.level_min = tiling.level_min;
+    aAPR.apr_access.level_max = tiling.level_max;
+
+    apr = &aAPR;
+
+    //kept aside, as the particle cell tree is re-used for the tiles
+    initialize_particle_cell_tree(aAPR);
+    stitched_particle_cell_tree.swap(particle_cell_tree);
+    particle_cell_tree.clear();
+
+    const uint64_t alignment = tiling.alignment();
+    stitched_level_image.init((tiling.org_dims[0] + alignment - 1)/alignment, (tiling.org_dims[1] + alignment - 1)/alignment,
+                              (tiling.org_dims[2] + alignment - 1)/alignment, 0);
+}
+
+/**
+ * Copies the Local Particle Cell set of the core of a tile into the particle cell tree of the full image
+ */
+template<typename ImageType>
+bool APRConverter<ImageType>::add_tile_seeds(const APRTiling &tiling, size_t tile_number, const APRTileSeeds &tile_seeds) {
+    const APRTile& tile = tiling.tiles[tile_number];
+
+    if((stitched_particle_cell_tree.size() != (tiling.level_max)) || (tile_seeds.particle_cell_tree.size() != (tiling.level_max))){
+        std::cerr << "Tile seeds do not match the levels of the tiling" << std::endl;
+        return false;
+    }
+
+    //copies the core part into the mesh of the full image, at the given level of the particle cell tree
+    auto paste_core = [&tile](const unsigned int shift, const auto& core_mesh, auto& mesh) -> bool {
+        const size_t y_begin = tile.core.y_begin >> shift;
+        const size_t x_begin = tile.core.x_begin >> shift;
+        const size_t z_begin = tile.core.z_begin >> shift;
+
+        if(((y_begin + core_mesh.y_num) > mesh.y_num) || ((x_begin + core_mesh.x_num) > mesh.x_num) || ((z_begin + core_mesh.z_num) > mesh.z_num)){
+            return false;
+        }
+
+        const size_t z_num = core_mesh.z_num;
+        const size_t x_num = core_mesh.x_num;
+        const size_t y_num = core_mesh.y_num;
+
+        #ifdef HAVE_OPENMP
+        #pragma omp parallel for default(shared) if(z_num * x_num > 100)
+        #endif
+        for (size_t z = 0; z < z_num; ++z) {
+            for (size_t x = 0; x < x_num; ++x) {
+                auto core_row = core_mesh.mesh.begin() + z * x_num * y_num + x * y_num;
+                std::copy(core_row, core_row + y_num, mesh.mesh.begin() + (z + z_begin) * mesh.x_num * mesh.y_num + (x + x_begin) * mesh.y_num + y_begin);
+            }
+        }
+        return true;
+    };
+
+    bool core_matches = paste_core(tiling.level_max - tiling.level_align, tile_seeds.level_image, stitched_level_image);
+
+    for (unsigned int level = tiling.level_align; level < tiling.level_max; ++level) {
+        core_matches = core_matches && paste_core(tiling.level_max - level, tile_seeds.particle_cell_tree[level], stitched_particle_cell_tree[level]);
+    }
+
+    if(!core_matches){
+        std::cerr << "Tile seeds do not match the tile core" << std::endl;
+        return false;
+    }
+
+    return true;
+}
+
+/**
+ * Computes the levels below level_align from the stitched level image, runs the Pulling Scheme and initializes the access structure
+ */
+template<typename ImageType>
+void APRConverter<ImageType>::finish_stitching(APR<ImageType> &aAPR, const APRTiling &tiling) {
+    apr = &aAPR;
+
+    particle_cell_tree.swap(stitched_particle_cell_tree);
+    stitched_particle_cell_tree.clear();
+    l_min = tiling.level_min;
+    l_max = tiling.level_max - 1;
+
+    //as in get_local_particle_cell_set, the levels are down-sampled with a max reduction
+    MeshData<float> level_image_ds;
+    for (int l_ = (int)tiling.level_align - 1; l_ >= (int)l_min; l_--) {
+        downsample(stitched_level_image, level_image_ds,
+                   [](const float &x, const float &y) -> float { return std::max(x, y); },
+                   [](const float &x) -> float { return x; }, true);
+        fill(l_,level_image_ds);
+        stitched_level_image.swap(level_image_ds);
+    }
+    stitched_level_image.init(0, 0, 0);
+
+    PullingScheme::pulling_scheme_main();
 
-    template<typename T>
-    bool get_apr_method_from_file(APR<ImageType> &aAPR, const TiffUtils::TiffInfo &aTiffFile);
+    aAPR.apr_access.initialize_structure_from_particle_cell_tree(aAPR,particle_cell_tree);
+    aAPR.particles_intensities.data.resize(aAPR.total_number_particles());
+    aAPR.parameters = par;
+}
 
-    void get_gradient(MeshData<ImageType> &image_temp, MeshData<ImageType> &grad_temp, MeshData<float> &local_scale_temp, MeshData<float> &local_scale_temp2, float bspline_offset);
-    void get_local_intensity_scale(MeshData<float> &local_scale_temp, MeshData<float> &local_scale_temp2);
-    void get_local_particle_cell_set(MeshData<ImageType> &grad_temp, MeshData<float> &local_scale_temp, MeshData<float> &local_scale_temp2);
-};
+/**
+ * Stitches the Local Particle Cell sets of the tiles, runs the Pulling Scheme and initializes the access structure
+ */
+template<typename ImageType>
+bool APRConverter<ImageType>::stitch_tile_seeds(APR<ImageType> &aAPR, const APRTiling &tiling, const std::vector<APRTileSeeds> &tile_seeds) {
 
-template <typename T>
-struct MinMax{T min; T max; };
+    if(tile_seeds.size() != tiling.tiles.size()){
+        std::cerr << "Number of tile seeds does not match the number of tiles" << std::endl;
+        return false;
+    }
 
-template <typename T>
-MinMax<T> getMinMax(const MeshData<T>& input_image) {
-    T minVal = std::numeric_limits<T>::max();
-    T maxVal = std::numeric_limits<T>::min();
+    begin_stitching(aAPR, tiling);
 
-#ifdef HAVE_OPENMP
-#pragma omp parallel for default(shared) reduction(max:maxVal) reduction(min:minVal)
-#endif
-    for (size_t i = 0; i < input_image.mesh.size(); ++i) {
-        T val = input_image.mesh[i];
-        if (val > maxVal) maxVal = val;
-        if (val < minVal) minVal = val;
+    for (size_t t = 0; t < tiling.tiles.size(); ++t) {
+        if(!add_tile_seeds(tiling, t, tile_seeds[t])){
+            return false;
+        }
     }
 
-    return MinMax<T>{minVal, maxVal};
+    finish_stitching(aAPR, tiling);
+
+    return true;
 }
 
 /**
- * Main method for constructing the APR from an input image
+ * Samples the particles of the core of a tile from the tile image (the image is used up for the down-sampled pyramid),
+ * the core of the tile at level_align is copied to coarse_image for the larger particle cells (see sample_coarse_particles)
  */
 template<typename ImageType> template<typename T>
-bool APRConverter<ImageType>::get_apr_method_from_file(APR<ImageType> &aAPR, const TiffUtils::TiffInfo &aTiffFile) {
-    allocation_timer.start_timer("read tif input image");
-    MeshData<T> inputImage = TiffUtils::getMesh<T>(aTiffFile);
-    allocation_timer.stop_timer();
+bool APRConverter<ImageType>::sample_tile_particles(APR<ImageType> &aAPR, const APRTiling &tiling, size_t tile_number, MeshData<T> &tile_image, MeshData<T> &coarse_image) {
+    const APRTile& tile = tiling.tiles[tile_number];
 
-    method_timer.start_timer("calculate automatic parameters");
+    if((tile_image.y_num != (tile.box.y_end - tile.box.y_begin)) || (tile_image.x_num != (tile.box.x_end - tile.box.x_begin)) ||
+       (tile_image.z_num != (tile.box.z_end - tile.box.z_begin))){
+        std::cerr << "Tile image does not match the tile box" << std::endl;
+        return false;
+    }
 
-    if(par.normalized_input) {
+    //the pixel grid is at the level_max of the tiling (the APR itself starts at its first non-empty level)
+    std::vector<MeshData<T>> downsampled_img;
+    downsamplePyrmaid(tile_image, downsampled_img, tiling.level_max, tiling.level_align);
 
-        if ((std::is_same<uint16_t, ImageType>::value) || (std::is_same<uint8_t, ImageType>::value)) {
-            MinMax<T> mm = getMinMax(inputImage);
-            T maxValue = static_cast<T>((float) std::numeric_limits<ImageType>::max() * 0.8);
-            std::cout << "MM: " << mm.min << " " << mm.max << " " << maxValue << std::endl;
+    //the particle cells at level_align and above are inside the core, as it is aligned to them
+    std::vector<ParticleRun> runs;
+    aAPR.apr_access.find_particle_runs_in_roi(tile.core, runs);
 
-#ifdef HAVE_OPENMP
-#pragma omp parallel for default(shared)
-#endif
-            for (size_t i = 0; i < inputImage.mesh.size(); ++i) {
-                inputImage.mesh[i] = (inputImage.mesh[i] - mm.min) * maxValue / (mm.max - mm.min);
-            }
+    int64_t i;
+    #ifdef HAVE_OPENMP
+    #pragma omp parallel for default(shared) schedule(static) private(i)
+    #endif
+    for (i = 0; i < (int64_t)runs.size(); ++i) {
+        const ParticleRun& run = runs[i];
+        if(run.level < tiling.level_align){
+            continue;
         }
+        const unsigned int shift = tiling.level_max - run.level;
+        const MeshData<T>& img = downsampled_img[run.level];
+
+        const T* img_row = &img.at(run.y_begin - (tile.box.y_begin >> shift), run.x - (tile.box.x_begin >> shift), run.z - (tile.box.z_begin >> shift));
+        std::copy(img_row, img_row + (run.y_end - run.y_begin) + 1, aAPR.particles_intensities.data.begin() + run.global_index_begin);
     }
 
+    //the core at level_align, to be down-sampled further once all tiles are sampled
+    const uint64_t alignment = tiling.alignment();
+    const unsigned int shift = tiling.level_max - tiling.level_align;
 
+    if(coarse_image.mesh.size() == 0) {
+        coarse_image.init((tiling.org_dims[0] + alignment - 1)/alignment, (tiling.org_dims[1] + alignment - 1)/alignment, (tiling.org_dims[2] + alignment - 1)/alignment);
+    }
 
-    auto_parameters(inputImage);
-    method_timer.stop_timer();
+    const MeshData<T>& img = downsampled_img[tiling.level_align];
+    const size_t y_offset = (tile.core.y_begin - tile.box.y_begin) >> shift;
+    const size_t x_offset = (tile.core.x_begin - tile.box.x_begin) >> shift;
+    const size_t z_offset = (tile.core.z_begin - tile.box.z_begin) >> shift;
+    const size_t y_num = (tile.core.y_end - tile.core.y_begin + alignment - 1) >> shift;
+    const size_t x_num = (tile.core.x_end - tile.core.x_begin + alignment - 1) >> shift;
+    const size_t z_num = (tile.core.z_end - tile.core.z_begin + alignment - 1) >> shift;
+
+    for (size_t z = 0; z < z_num; ++z) {
+        for (size_t x = 0; x < x_num; ++x) {
+            const T* img_row = &img.at(y_offset, x + x_offset, z + z_offset);
+            std::copy(img_row, img_row + y_num, &coarse_image.at(tile.core.y_begin >> shift, x + (tile.core.x_begin >> shift), z + (tile.core.z_begin >> shift)));
+        }
+    }
 
-    return get_apr_method(aAPR, inputImage);
+    return true;
 }
 
 /**
- * Main method for constructing the APR from an input image
+ * Samples the particles below level_align from the image at level_align assembled by sample_tile_particles
  */
 template<typename ImageType> template<typename T>
-bool APRConverter<ImageType>::get_apr_method(APR<ImageType> &aAPR, MeshData<T>& input_image) {
-    apr = &aAPR; // in case it was called directly
+void APRConverter<ImageType>::sample_coarse_particles(APR<ImageType> &aAPR, const APRTiling &tiling, MeshData<T> &coarse_image) {
+    if(aAPR.level_min() >= tiling.level_align){
+        return;
+    }
 
-    total_timer.start_timer("Total_pipeline_excluding_IO");
+    std::vector<MeshData<T>> downsampled_img;
+    downsamplePyrmaid(coarse_image, downsampled_img, tiling.level_align, aAPR.level_min());
 
-    init_apr(aAPR, input_image);
+    ImageROI roi;
+    roi.y_begin = 0;
+    roi.y_end = tiling.org_dims[0];
+    roi.x_begin = 0;
+    roi.x_end = tiling.org_dims[1];
+    roi.z_begin = 0;
+    roi.z_end = tiling.org_dims[2];
 
-    ////////////////////////////////////////
-    /// Memory allocation of variables
-    ////////////////////////////////////////
+    std::vector<ParticleRun> runs;
+    aAPR.apr_access.find_particle_runs_in_roi(roi, runs);
 
-    //assuming uint16, the total memory cost shoudl be approximately (1 + 1 + 1/8 + 2/8 + 2/8) = 2 5/8 original image size in u16bit
-    //storage of the particle cell tree for computing the pulling scheme
-    allocation_timer.start_timer("init and copy image");
-    MeshData<ImageType> image_temp(input_image, false /* don't copy */); // global image variable useful for passing between methods, or re-using memory (should be the only full sized copy of the image)
-    MeshData<ImageType> grad_temp; // should be a down-sampled image
-    grad_temp.initDownsampled(input_image.y_num, input_image.x_num, input_image.z_num, 0);
-    MeshData<float> local_scale_temp; // Used as down-sampled images for some averaging steps where it is useful to not lose precision, or get over-flow errors
-    local_scale_temp.initDownsampled(input_image.y_num, input_image.x_num, input_image.z_num);
-    MeshData<float> local_scale_temp2;
-    local_scale_temp2.initDownsampled(input_image.y_num, input_image.x_num, input_image.z_num);
-    allocation_timer.stop_timer();
+    int64_t i;
+    #ifdef HAVE_OPENMP
+    #pragma omp parallel for default(shared) schedule(static) private(i)
+    #endif
+    for (i = 0; i < (int64_t)runs.size(); ++i) {
+        const ParticleRun& run = runs[i];
+        if(run.level >= tiling.level_align){
+            continue;
+        }
+        const T* img_row = &downsampled_img[run.level].at(run.y_begin, run.x, run.z);
+        std::copy(img_row, img_row + (run.y_end - run.y_begin) + 1, aAPR.particles_intensities.data.begin() + run.global_index_begin);
+    }
+}
 
-    /////////////////////////////////
-    /// Pipeline
-    ////////////////////////
+/**
+ * z-slabs over the full image, as thick as the memory budget allows
+ */
+template<typename ImageType>
+APRTiling APRConverter<ImageType>::get_slab_tiling(uint64_t y_num, uint64_t x_num, uint64_t z_num, uint64_t memory_budget, size_t input_type_size) {
+    //
+    //  The memory is the particle cell tree of the full image (about 1/7 byte per pixel, needed by the Pulling Scheme)
+    //  and the buffers of one slab (including its overlap): the input, the image and gradient of compute_local_particle_cell_set
+    //  and the down-sampled float buffers and particle cell tree of the slab. The output APR is not included.
+    //
 
-    computation_timer.start_timer("Calculations");
+    unsigned int levelMin, levelMax;
+    get_level_range(y_num, x_num, z_num, levelMin, levelMax);
 
-    fine_grained_timer.start_timer("offset image");
-    //offset image by factor (this is required if there are zero areas in the background with uint16_t and uint8_t images, as the Bspline co-efficients otherwise may be negative!)
-    // Warning both of these could result in over-flow (if your image is non zero, with a 'buffer' and has intensities up to uint16_t maximum value then set image_type = "", i.e. uncomment the following line)
-    float bspline_offset = 0;
-    if (std::is_same<uint16_t, ImageType>::value) {
-        bspline_offset = 100;
-        image_temp.copyFromMeshWithUnaryOp(input_image, [=](const auto &a) { return (a + bspline_offset); });
-    } else if (std::is_same<uint8_t, ImageType>::value){
-        bspline_offset = 5;
-        image_temp.copyFromMeshWithUnaryOp(input_image, [=](const auto &a) { return (a + bspline_offset); });
-    } else {
-        image_temp.copyFromMesh(input_image);
+    APRTiling tiling;
+    tiling.initialize(y_num, x_num, z_num, levelMin, levelMax, APRTiling::default_level_align(levelMin, levelMax), y_num, x_num, z_num, 0);
+    tiling.tiles.clear();
+
+    uint64_t tree_bytes = 0;
+    for (unsigned int level = levelMin; level < levelMax; ++level) {
+        const uint64_t cell_size = ((uint64_t)1) << (levelMax - level);
+        tree_bytes += ((y_num + cell_size - 1)/cell_size) * ((x_num + cell_size - 1)/cell_size) * ((z_num + cell_size - 1)/cell_size);
     }
-    fine_grained_timer.stop_timer();
 
-    method_timer.start_timer("compute_gradient_magnitude_using_bsplines");
-    get_gradient(image_temp, grad_temp, local_scale_temp, local_scale_temp2, bspline_offset);
-    method_timer.stop_timer();
+    const double slab_bytes_per_pixel = input_type_size + sizeof(ImageType) + sizeof(ImageType)/8.0 + 2*sizeof(float)/8.0 + 1/7.0;
+    const uint64_t overlap = get_tile_overlap();
+    const uint64_t alignment = tiling.alignment();
 
-    method_timer.start_timer("compute_local_intensity_scale");
-    get_local_intensity_scale(local_scale_temp, local_scale_temp2);
-    method_timer.stop_timer();
+    //the box of a slab is its core plus the overlap on both sides, and the alignment of its begin
+    const double slab_pixels = (memory_budget > tree_bytes) ? (memory_budget - tree_bytes)/(slab_bytes_per_pixel*y_num*x_num) : 0;
+    const uint64_t slab_box = (uint64_t)slab_pixels;
+    const uint64_t slab_core = (slab_box > (2*overlap + alignment)) ? slab_box - 2*overlap - alignment : 0;
 
-    method_timer.start_timer("initialize_particle_cell_tree");
-    initialize_particle_cell_tree(aAPR);
-    method_timer.stop_timer();
+    if(slab_core < alignment){
+        std::cerr << "Memory budget too small for streaming conversion" << std::endl;
+        return tiling;
+    }
 
-    method_timer.start_timer("compute_local_particle_set");
-    get_local_particle_cell_set(grad_temp, local_scale_temp, local_scale_temp2);
-    method_timer.stop_timer();
+    tiling.initialize(y_num, x_num, z_num, levelMin, levelMax, tiling.level_align, y_num, x_num, slab_core - (slab_core % alignment), overlap);
+    return tiling;
+}
 
-    method_timer.start_timer("compute_pulling_scheme");
-    PullingScheme::pulling_scheme_main();
-    method_timer.stop_timer();
+/**
+ * Streaming conversion of the tiff file given in par (input_dir + input_image_name)
+ */
+template<typename ImageType>
+bool APRConverter<ImageType>::get_apr_streaming(APR<ImageType> &aAPR, uint64_t memory_budget) {
+    apr = &aAPR;
+
+    TiffUtils::TiffInfo inputTiff(par.input_dir + par.input_image_name);
+    if (!inputTiff.isFileOpened()) return false;
+
+    if (inputTiff.iType == TiffUtils::TiffInfo::TiffType::TIFF_UINT8) {
+        return get_apr_streaming_method<uint8_t>(aAPR, inputTiff, memory_budget);
+    } else if (inputTiff.iType == TiffUtils::TiffInfo::TiffType::TIFF_FLOAT) {
+        return get_apr_streaming_method<float>(aAPR, inputTiff, memory_budget);
+    } else if (inputTiff.iType == TiffUtils::TiffInfo::TiffType::TIFF_UINT16) {
+        return get_apr_streaming_method<uint16_t>(aAPR, inputTiff, memory_budget);
+    } else {
+        std::cerr << "Wrong file type" << std::endl;
+        return false;
+    }
+}
 
-    method_timer.start_timer("downsample_pyramid");
-    std::vector<MeshData<T>> downsampled_img;
-    //Down-sample the image for particle intensity estimation
-    downsamplePyrmaid(input_image, downsampled_img, aAPR.level_max(), aAPR.level_min());
-    method_timer.stop_timer();
+/**
+ * Converts a tiff file slab by slab, the slabs (with their overlap) are read straight from the file
+ */
+template<typename ImageType> template<typename T>
+bool APRConverter<ImageType>::get_apr_streaming_method(APR<ImageType> &aAPR, const TiffUtils::TiffInfo &aTiffFile, uint64_t memory_budget) {
+    //(x and y are exchanged w.r.t. the file, as in TiffUtils::getMesh)
+    const uint64_t y_num = aTiffFile.iImgWidth;
+    const uint64_t x_num = aTiffFile.iImgHeight;
+    const uint64_t z_num = aTiffFile.iNumberOfDirectories;
 
-    method_timer.start_timer("compute_apr_datastructure");
-    aAPR.apr_access.initialize_structure_from_particle_cell_tree(aAPR,particle_cell_tree);
-    method_timer.stop_timer();
+    if(par.normalized_input) {
+        std::cerr << "Normalized input is not supported for streaming conversion, the input is used as it is" << std::endl;
+    }
 
-    method_timer.start_timer("sample_particles");
-    aAPR.get_parts_from_img(downsampled_img,aAPR.particles_intensities);
+    method_timer.start_timer("calculate automatic parameters");
+    bool loaded;
+    {
+        //the slices auto_parameters reads from the full image (with the neighbours of the noise patches)
+        MeshData<T> slice;
+        loaded = auto_parameters_from_slices<T>(y_num, x_num, z_num, [&aTiffFile, &slice](const size_t z, T* pixels) {
+            if(!TiffUtils::getMeshSlices(aTiffFile, z, z + 1, slice)){
+                return false;
+            }
+            std::copy(slice.mesh.begin(), slice.mesh.end(), pixels);
+            return true;
+        });
+    }
     method_timer.stop_timer();
 
-    computation_timer.stop_timer();
+    if(!loaded) {
+        return false;
+    }
 
-    aAPR.parameters = par;
+    const APRTiling tiling = get_slab_tiling(y_num, x_num, z_num, memory_budget, sizeof(T));
+    if(tiling.tiles.empty()){
+        return false;
+    }
 
-    total_timer.stop_timer();
+    std::function<bool(const APRTile&, MeshData<T>&)> load_slab = [&aTiffFile](const APRTile& tile, MeshData<T>& slab) {
+        return TiffUtils::getMeshSlices(aTiffFile, tile.box.z_begin, tile.box.z_end, slab);
+    };
 
-    return true;
+    return get_apr_tiled(aAPR, tiling, load_slab);
 }
 
 template<typename ImageType>
-void APRConverter<ImageType>::get_local_particle_cell_set(MeshData<ImageType> &grad_temp, MeshData<float> &local_scale_temp, MeshData<float> &local_scale_temp2) {
+void APRConverter<ImageType>::get_local_particle_cell_set(MeshData<ImageType> &grad_temp, MeshData<float> &local_scale_temp, MeshData<float> &local_scale_temp2, MeshData<float> *level_image, unsigned int level_image_level) {
     //
     //  Computes the Local Particle Cell Set from a down-sampled local intensity scale (\sigma) and gradient magnitude
     //
@@ -246,6 +1319,15 @@ void APRConverter<ImageType>::get_local_particle_cell_set(MeshData<ImageType> &g
     fill(l_max,local_scale_temp);
     fine_grained_timer.stop_timer();
 
+    //the levels at level_image_level are kept for tiled conversion (the larger particle cells span several tiles)
+    auto copy_level_image = [&](const MeshData<float>& levels, const int level) {
+        if((level_image != nullptr) && (level == (int)level_image_level)) {
+            level_image->init(levels);
+            std::copy(levels.mesh.begin(), levels.mesh.end(), level_image->mesh.begin());
+        }
+    };
+    copy_level_image(local_scale_temp, l_max);
+
     fine_grained_timer.start_timer("level_loop_initialize_tree");
     for(int l_ = l_max - 1; l_ >= l_min; l_--){
 
@@ -255,12 +1337,55 @@ void APRConverter<ImageType>::get_local_particle_cell_set(MeshData<ImageType> &g
                    [](const float &x) -> float { return x; }, true);
         //for those value of level k, add to the hash table
         fill(l_,local_scale_temp2);
+        copy_level_image(local_scale_temp2, l_);
         //assign the previous mesh to now be resampled.
         local_scale_temp.swap(local_scale_temp2);
     }
     fine_grained_timer.stop_timer();
 }
 
+/**
+ * Copies the input image into image_temp (normalized if pending, offset and thresholded) in one pass, returns the offset
+ */
+template<typename ImageType> template<typename T>
+float APRConverter<ImageType>::preprocess_input(MeshData<T> &input_image, MeshData<ImageType> &image_temp) {
+    //offset image by factor (this is required if there are zero areas in the background with uint16_t and uint8_t images, as the Bspline co-efficients otherwise may be negative!)
+    //(values past the maximum of the type after the offset are saturated)
+    float bspline_offset = 0;
+    if (std::is_same<uint16_t, ImageType>::value) {
+        bspline_offset = 100;
+    } else if (std::is_same<uint8_t, ImageType>::value){
+        bspline_offset = 5;
+    }
+
+    const float threshold = par.Ip_th + bspline_offset;
+
+    if(input_normalization.active) {
+        const InputNormalization<T> normalization{(T) input_normalization.min, (T) input_normalization.max_value, (T) input_normalization.range};
+        preprocess_image<ImageType, T, true>(input_image, image_temp, normalization, bspline_offset, threshold);
+    } else {
+        preprocess_image<ImageType, T, false>(input_image, image_temp, InputNormalization<T>{0, 1, 1}, bspline_offset, threshold);
+    }
+
+    return bspline_offset;
+}
+
+/**
+ * Applies the pending normalization to the input image in place (when the filters are not re-computed)
+ */
+template<typename ImageType> template<typename T>
+void APRConverter<ImageType>::normalize_input(MeshData<T> &input_image) {
+    const InputNormalization<T> normalization{(T) input_normalization.min, (T) input_normalization.max_value, (T) input_normalization.range};
+
+    int64_t i;
+    #ifdef HAVE_OPENMP
+    #pragma omp parallel for schedule(static) private(i)
+    #endif
+    for (i = 0; i < (int64_t)input_image.mesh.size(); ++i) {
+        input_image.mesh[i] = normalization(input_image.mesh[i]);
+    }
+}
+
 template<typename ImageType>
 void APRConverter<ImageType>::get_gradient(MeshData<ImageType> &image_temp, MeshData<ImageType> &grad_temp, MeshData<float> &local_scale_temp, MeshData<float> &local_scale_temp2, float bspline_offset) {
     //  Bevan Cheeseman 2018
@@ -268,46 +1393,58 @@ void APRConverter<ImageType>::get_gradient(MeshData<ImageType> &image_temp, Mesh
     //  Input: full sized image.
     //  Output: down-sampled by 2 gradient magnitude (Note, the gradient is calculated at pixel level then maximum down sampled within the loops below)
 
-    fine_grained_timer.verbose_flag = false;
+    //  The image is expected offset and clamped at Ip_th + bspline_offset (see preprocess_input)
 
-    fine_grained_timer.start_timer("threshold");
+    fine_grained_timer.verbose_flag = false;
 
-#ifdef HAVE_OPENMP
-#pragma omp parallel for
-#endif
-    for (size_t i = 0; i < image_temp.mesh.size(); ++i) {
-        if (image_temp.mesh[i] <= (par.Ip_th + bspline_offset)) { image_temp.mesh[i] = par.Ip_th + bspline_offset; }
-    }
-    fine_grained_timer.stop_timer();
 
+    //(nominal memory traffic of the passes over the image and the down-sampled images)
+    const uint64_t image_bytes = image_temp.mesh.size()*sizeof(ImageType);
+    const uint64_t grad_bytes = grad_temp.mesh.size()*sizeof(ImageType);
+    const uint64_t local_scale_bytes = local_scale_temp.mesh.size()*sizeof(float);
 
     fine_grained_timer.start_timer("smooth_bspline");
     if(par.lambda > 0) {
         get_smooth_bspline_3D(image_temp, par.lambda);
     }
     fine_grained_timer.stop_timer();
-
+    record_filter_stage((par.lambda > 0) ? 6*image_bytes : 0);
 
     fine_grained_timer.start_timer("calc_bspline_fd_mag_ds");
     calc_bspline_fd_ds_mag(image_temp,grad_temp,par.dx,par.dy,par.dz);
     fine_grained_timer.stop_timer();
+    record_filter_stage(image_bytes + grad_bytes);
 
-    fine_grained_timer.start_timer("down-sample_b-spline");
-    downsample(image_temp, local_scale_temp,
-               [](const float &x, const float &y) -> float { return x + y; },
-               [](const float &x) -> float { return x / 8.0; });
-    fine_grained_timer.stop_timer();
+    if(fuse_filter_passes && (par.lambda > 0)) {
+        fine_grained_timer.start_timer("down-sample_b-spline_calc_inv_bspline_y");
+        downsample_calc_inv_bspline_y(image_temp, local_scale_temp);
+        fine_grained_timer.stop_timer();
+        record_filter_stage(image_bytes + local_scale_bytes);
+    } else {
+        fine_grained_timer.start_timer("down-sample_b-spline");
+        downsample(image_temp, local_scale_temp,
+                   [](const float &x, const float &y) -> float { return x + y; },
+                   [](const float &x) -> float { return x / 8.0; });
+        fine_grained_timer.stop_timer();
+        record_filter_stage(image_bytes + local_scale_bytes);
+
+        if(par.lambda > 0) {
+            fine_grained_timer.start_timer("calc_inv_bspline_y");
+            calc_inv_bspline_y(local_scale_temp);
+            fine_grained_timer.stop_timer();
+            record_filter_stage(2*local_scale_bytes);
+        }
+    }
 
     if(par.lambda > 0){
-        fine_grained_timer.start_timer("calc_inv_bspline_y");
-        calc_inv_bspline_y(local_scale_temp);
-        fine_grained_timer.stop_timer();
         fine_grained_timer.start_timer("calc_inv_bspline_x");
         calc_inv_bspline_x(local_scale_temp);
         fine_grained_timer.stop_timer();
+        record_filter_stage(2*local_scale_bytes);
         fine_grained_timer.start_timer("calc_inv_bspline_z");
         calc_inv_bspline_z(local_scale_temp);
         fine_grained_timer.stop_timer();
+        record_filter_stage(2*local_scale_bytes);
     }
 
     fine_grained_timer.start_timer("load_and_apply_mask");
@@ -320,6 +1457,7 @@ void APRConverter<ImageType>::get_gradient(MeshData<ImageType> &image_temp, Mesh
     fine_grained_timer.start_timer("threshold");
     threshold_gradient(grad_temp,local_scale_temp,par.Ip_th + bspline_offset);
     fine_grained_timer.stop_timer();
+    record_filter_stage(2*grad_bytes + local_scale_bytes);
 }
 
 template<typename ImageType>
@@ -329,14 +1467,10 @@ void APRConverter<ImageType>::get_local_intensity_scale(MeshData<float> &local_s
     //
     //  Input: full sized image.
     //
-    //  Output: down-sampled Local Intensity Scale (h) (Due to the Equivalence Optimization we only need down-sampled values)
+    //  Output: down-sampled Local Intensity Scale (h) (Due to the Equivalence Optimization we only need down-sampled values),
+    //  before the rescaling and thresholding with sigma_th (done afterwards, so it can be re-done on the cached result)
     //
 
-    fine_grained_timer.start_timer("copy_intensities_from_bsplines");
-    //copy across the intensities
-    local_scale_temp2.copyFromMesh(local_scale_temp);
-    fine_grained_timer.stop_timer();
-
     float var_rescale;
     std::vector<int> var_win;
     get_window(var_rescale,var_win,par);
@@ -348,27 +1482,79 @@ void APRConverter<ImageType>::get_local_intensity_scale(MeshData<float> &local_s
     size_t win_x2 = var_win[4];
     size_t win_z2 = var_win[5];
 
-    fine_grained_timer.start_timer("calc_sat_mean_y");
-    calc_sat_mean_y(local_scale_temp,win_y);
-    fine_grained_timer.stop_timer();
+    const uint64_t local_scale_bytes = local_scale_temp.mesh.size()*sizeof(float);
+
+    if(fuse_filter_passes) {
+        fine_grained_timer.start_timer("copy_intensities_calc_sat_mean_y");
+        copy_calc_sat_mean_y(local_scale_temp,local_scale_temp2,win_y);
+        fine_grained_timer.stop_timer();
+        record_filter_stage(3*local_scale_bytes);
+    } else {
+        fine_grained_timer.start_timer("copy_intensities_from_bsplines");
+        //copy across the intensities
+        local_scale_temp2.copyFromMesh(local_scale_temp);
+        fine_grained_timer.stop_timer();
+        record_filter_stage(2*local_scale_bytes);
+
+        fine_grained_timer.start_timer("calc_sat_mean_y");
+        calc_sat_mean_y(local_scale_temp,win_y);
+        fine_grained_timer.stop_timer();
+        record_filter_stage(2*local_scale_bytes);
+    }
 
     fine_grained_timer.start_timer("calc_sat_mean_x");
     calc_sat_mean_x(local_scale_temp,win_x);
     fine_grained_timer.stop_timer();
+    record_filter_stage(2*local_scale_bytes);
 
     fine_grained_timer.start_timer("calc_sat_mean_z");
     calc_sat_mean_z(local_scale_temp,win_z);
     fine_grained_timer.stop_timer();
+    record_filter_stage(2*local_scale_bytes);
+
+    //calculate abs and subtract from original, then the second spatial average
+    if(fuse_filter_passes) {
+        fine_grained_timer.start_timer("calc_abs_diff_calc_sat_mean_y_2");
+        calc_abs_diff_sat_mean_y(local_scale_temp2,local_scale_temp,win_y2);
+        fine_grained_timer.stop_timer();
+        record_filter_stage(3*local_scale_bytes);
+    } else {
+        fine_grained_timer.start_timer("calc_abs_diff");
+        calc_abs_diff(local_scale_temp2,local_scale_temp);
+        fine_grained_timer.stop_timer();
+        record_filter_stage(3*local_scale_bytes);
+
+        fine_grained_timer.start_timer("calc_sat_mean_y_2");
+        calc_sat_mean_y(local_scale_temp,win_y2);
+        fine_grained_timer.stop_timer();
+        record_filter_stage(2*local_scale_bytes);
+    }
 
-    fine_grained_timer.start_timer("second_pass_and_rescale");
-    //calculate abs and subtract from original
-    calc_abs_diff(local_scale_temp2,local_scale_temp);
-    //Second spatial average
-    calc_sat_mean_y(local_scale_temp,win_y2);
+    fine_grained_timer.start_timer("calc_sat_mean_x_2");
     calc_sat_mean_x(local_scale_temp,win_x2);
+    fine_grained_timer.stop_timer();
+    record_filter_stage(2*local_scale_bytes);
+
+    fine_grained_timer.start_timer("calc_sat_mean_z_2");
     calc_sat_mean_z(local_scale_temp,win_z2);
-    rescale_var_and_threshold( local_scale_temp, var_rescale,par);
     fine_grained_timer.stop_timer();
+    record_filter_stage(2*local_scale_bytes);
+}
+
+template<typename ImageType>
+void APRConverter<ImageType>::print_filter_bandwidth(std::ostream &out) const {
+    uint64_t total_bytes = 0;
+    double total_time = 0;
+
+    out << std::left << std::setw(42) << "stage" << std::right << std::setw(12) << "time (s)" << std::setw(12) << "MB" << std::setw(12) << "GB/s" << std::endl;
+    for (auto const &stage : filter_stages) {
+        out << std::left << std::setw(42) << stage.name << std::right << std::setw(12) << stage.time << std::setw(12) << stage.bytes/1e6
+            << std::setw(12) << ((stage.time > 0) ? stage.bytes/stage.time/1e9 : 0) << std::endl;
+        total_bytes += stage.bytes;
+        total_time += stage.time;
+    }
+    out << std::left << std::setw(42) << "total" << std::right << std::setw(12) << total_time << std::setw(12) << total_bytes/1e6
+        << std::setw(12) << ((total_time > 0) ? total_bytes/total_time/1e9 : 0) << std::endl;
 }
 
 
@@ -382,19 +1568,59 @@ void APRConverter<ImageType>::init_apr(APR<ImageType>& aAPR,MeshData<T>& input_i
     aAPR.apr_access.org_dims[1] = input_image.x_num;
     aAPR.apr_access.org_dims[2] = input_image.z_num;
 
-    int max_dim = std::max(std::max(aAPR.apr_access.org_dims[1], aAPR.apr_access.org_dims[0]), aAPR.apr_access.org_dims[2]);
-    int min_dim = std::min(std::min(aAPR.apr_access.org_dims[1], aAPR.apr_access.org_dims[0]), aAPR.apr_access.org_dims[2]);
+    unsigned int levelMin, levelMax;
+    get_level_range(input_image.y_num, input_image.x_num, input_image.z_num, levelMin, levelMax);
+
+    aAPR.apr_access.level_min = levelMin;
+    aAPR.apr_access.level_max = levelMax;
+}
+
+template<typename ImageType>
+void APRConverter<ImageType>::get_level_range(uint64_t y_num, uint64_t x_num, uint64_t z_num, unsigned int &level_min, unsigned int &level_max) {
+    int max_dim = std::max(std::max(x_num, y_num), z_num);
+    int min_dim = std::min(std::min(x_num, y_num), z_num);
 
     int levelMax = ceil(std::log2(max_dim));
     // TODO: why minimum level is forced here to be 2?
     int levelMin = std::max( (int)(levelMax - floor(std::log2(min_dim))), 2);
 
-    aAPR.apr_access.level_min = levelMin;
-    aAPR.apr_access.level_max = levelMax;
+    level_min = levelMin;
+    level_max = levelMax;
 }
 
 template<typename ImageType> template<typename T>
 void APRConverter<ImageType>::auto_parameters(const MeshData<T>& input_img){
+    const size_t xnumynum = input_img.x_num*input_img.y_num;
+    auto_parameters<T>(input_img.y_num, input_img.x_num, input_img.z_num, [&input_img, xnumynum](const size_t z) -> const T* {
+        return &input_img.mesh[z*xnumynum];
+    });
+}
+
+template<typename ImageType> template<typename T, typename L>
+bool APRConverter<ImageType>::auto_parameters_from_slices(const uint64_t y_num, const uint64_t x_num, const uint64_t z_num, L load_slice){
+    //
+    //  Only the slices auto_parameters reads are loaded (into one stack), they are looked up by their z in the image
+    //
+    const std::vector<size_t> read_slices = auto_parameters_read_slices(y_num, x_num, z_num);
+    const size_t slice_size = y_num*x_num;
+
+    MeshData<T> slices(y_num, x_num, read_slices.size());
+    std::vector<size_t> stack_index(z_num, 0);
+    for (size_t i = 0; i < read_slices.size(); ++i) {
+        if(!load_slice(read_slices[i], &slices.mesh[i*slice_size])) {
+            return false;
+        }
+        stack_index[read_slices[i]] = i;
+    }
+
+    auto_parameters<T>(y_num, x_num, z_num, [&slices, &stack_index, slice_size](const size_t z) -> const T* {
+        return &slices.mesh[stack_index[z]*slice_size];
+    });
+    return true;
+}
+
+template<typename ImageType> template<typename T, typename S>
+void APRConverter<ImageType>::auto_parameters(const uint64_t y_num_, const uint64_t x_num_, const uint64_t z_num_, S slice){
     //
     //  Simple automatic parameter selection for 3D APR Flouresence Images
     //
@@ -407,51 +1633,78 @@ void APRConverter<ImageType>::auto_parameters(const MeshData<T>& input_img){
 
 
 
-    APRTimer par_timer;
-    par_timer.verbose_flag = false;
-
     //
     //  Do not compute the statistics over the whole image, but only a smaller sub-set.
     //
-    const double total_required_pixel = 10*1000*1000;
-    size_t num_slices = std::min((unsigned int)ceil(total_required_pixel/(1.0*input_img.y_num*input_img.x_num)),(unsigned int)input_img.z_num);
-    size_t delta = std::max((unsigned int)1,(unsigned int)(input_img.z_num/num_slices));
-    std::vector<size_t> selectedSlicesOffsets;
-    selectedSlicesOffsets.reserve(num_slices);
-    //evenly space the slices across the image
-    for (size_t i1 = 0; i1 < num_slices; ++i1) {
-        selectedSlicesOffsets.push_back(delta*i1);
-    }
+    const std::vector<size_t> selectedSlicesOffsets = auto_parameters_slices(y_num_, x_num_, z_num_);
+    const int64_t num_slices = selectedSlicesOffsets.size();
+
+    const int64_t z_num = z_num_;
+    const int64_t x_num = x_num_;
+    const int64_t y_num = y_num_;
+    const size_t xnumynum = x_num_*y_num_;
 
     // Get min value
-    par_timer.start_timer("get_min");
+    fine_grained_timer.start_timer("auto_parameters_get_min");
     float min_val = 99999999;
-    for (size_t k1 = 0; k1 < selectedSlicesOffsets.size(); ++k1) {
-        min_val = std::min((float)*std::min_element(input_img.mesh.begin() + selectedSlicesOffsets[k1]*(input_img.y_num*input_img.x_num),input_img.mesh.begin()  + (selectedSlicesOffsets[k1]+1)*(input_img.y_num*input_img.x_num)),min_val);
+    int64_t s;
+    #ifdef HAVE_OPENMP
+    #pragma omp parallel for schedule(static) private(s) reduction(min:min_val)
+    #endif
+    for (s = 0; s < num_slices; ++s) {
+        const T* pixels = slice(selectedSlicesOffsets[s]);
+        min_val = std::min((float)*std::min_element(pixels,pixels + xnumynum),min_val);
     }
-    par_timer.stop_timer();
+    fine_grained_timer.stop_timer();
 
     // will need to deal with grouped constant or zero sections in the image somewhere.... but lets keep it simple for now.
     const size_t num_bins = 10000;
     std::vector<uint64_t> freq(num_bins);
     uint64_t counter = 0;
-    double total=0;
-
-    size_t xnumynum = input_img.x_num*input_img.y_num;
-    par_timer.start_timer("get_histogram");
-    for (size_t s = 0; s < selectedSlicesOffsets.size(); ++s) {
-        for (size_t q= selectedSlicesOffsets[s]*xnumynum; q < (selectedSlicesOffsets[s]+1)*xnumynum; ++q) {
-            if(input_img.mesh[q] < (min_val + num_bins-1)){
-                freq[input_img.mesh[q]-min_val]++;
-                if(input_img.mesh[q] > 0) {
-                    counter++;
-                    total += input_img.mesh[q];
+
+    //the sums of the rows are added up in order afterwards, so the mean does not depend on the number of threads
+    std::vector<double> row_total(num_slices*x_num, 0);
+
+    fine_grained_timer.start_timer("auto_parameters_get_histogram");
+    #ifdef HAVE_OPENMP
+    #pragma omp parallel
+    #endif
+    {
+        //each thread fills its own histogram, they are summed at the end
+        std::vector<uint64_t> freq_local(num_bins, 0);
+        uint64_t counter_local = 0;
+
+        int64_t r;
+        #ifdef HAVE_OPENMP
+        #pragma omp for schedule(static) private(r) nowait
+        #endif
+        for (r = 0; r < num_slices*x_num; ++r) {
+            const T* row = slice(selectedSlicesOffsets[r/x_num]) + (r%x_num)*y_num;
+            double total_row = 0;
+            for (size_t q = 0; q < (size_t)y_num; ++q) {
+                if(row[q] < (min_val + num_bins-1)){
+                    freq_local[row[q]-min_val]++;
+                    if(row[q] > 0) {
+                        counter_local++;
+                        total_row += row[q];
+                    }
                 }
             }
+            row_total[r] = total_row;
         }
 
+        #ifdef HAVE_OPENMP
+        #pragma omp critical
+        #endif
+        {
+            for (size_t j = 0; j < num_bins; ++j) {
+                freq[j] += freq_local[j];
+            }
+            counter += counter_local;
+        }
     }
-    par_timer.stop_timer();
+    const double total = std::accumulate(row_total.begin(), row_total.end(), 0.0);
+    fine_grained_timer.stop_timer();
 
     float img_mean = counter > 0 ? total/(counter*1.0) : 1;
     float prop_total_th = 0.05; //assume there is atleast 5% background in the image
@@ -524,44 +1777,73 @@ void APRConverter<ImageType>::auto_parameters(const MeshData<T>& input_img){
     }
 
 
-    int64_t z_num = input_img.z_num;
-    int64_t x_num = input_img.x_num;
-    int64_t y_num = input_img.y_num;
+    fine_grained_timer.start_timer("auto_parameters_get_patches");
 
-    par_timer.start_timer("get_patches");
+    //
+    //  The patches are taken around the first pixels (in slice -> x -> y order) with the value of the mode, the
+    //  matches are first counted per row, so the rows can be searched in parallel and still give the patches in order
+    //
+    const int64_t rows_per_slice = std::max(x_num - 2, (int64_t)0);
+    const int64_t num_rows = ((y_num > 2) && (z_num > 2)) ? num_slices*rows_per_slice : 0;
+    std::vector<uint64_t> row_offset(num_rows + 1, 0);
+
+    auto patch_slice = [&](const int64_t row) {
+        return auto_parameters_patch_slice(selectedSlicesOffsets[row/rows_per_slice], z_num);
+    };
 
-    uint64_t counter_p = 0;
     if (patches.size() > 0) {
-        for (size_t s = 0; s < selectedSlicesOffsets.size(); ++s) {
-            // limit slice to range [1, z_num-2]
-            int64_t z = std::min((int) z_num - 2, std::max((int) selectedSlicesOffsets[s], (int) 1));
-            for (int64_t x = 1; x < (x_num - 1); ++x) {
-                for (int64_t y = 1; y < (y_num - 1); ++y) {
-                    float val = input_img.mesh[z * x_num * y_num + x * y_num + y];
-                    if (val == estimated_first_mode) {
-                        uint64_t counter_n = 0;
-                        for (int64_t sz = -1; sz <= 1; ++sz) {
-                            for (int64_t sx = -1; sx <= 1; ++sx) {
-                                for (int64_t sy = -1; sy <= 1; ++sy) {
-                                    size_t idx = (z + sz) * x_num * y_num + (x + sx) * y_num + (y + sy);
-                                    const auto &val = input_img.mesh[idx];
-                                    patches[counter_p][counter_n] = val;
-                                    counter_n++;
-                                }
+        int64_t r;
+        #ifdef HAVE_OPENMP
+        #pragma omp parallel for schedule(static) private(r)
+        #endif
+        for (r = 0; r < num_rows; ++r) {
+            const int64_t z = patch_slice(r);
+            const int64_t x = 1 + r%rows_per_slice;
+            const T* pixels = slice(z);
+            uint64_t matches = 0;
+            for (int64_t y = 1; y < (y_num - 1); ++y) {
+                float val = pixels[x * y_num + y];
+                if (val == estimated_first_mode) {
+                    matches++;
+                }
+            }
+            row_offset[r + 1] = matches;
+        }
+
+        std::partial_sum(row_offset.begin(), row_offset.end(), row_offset.begin());
+
+        #ifdef HAVE_OPENMP
+        #pragma omp parallel for schedule(dynamic) private(r)
+        #endif
+        for (r = 0; r < num_rows; ++r) {
+            uint64_t counter_p = row_offset[r];
+            if ((counter_p >= patches.size()) || (counter_p == row_offset[r + 1])) {
+                continue;
+            }
+            const int64_t z = patch_slice(r);
+            const int64_t x = 1 + r%rows_per_slice;
+            const T* neighbour_slices[3] = {slice(z - 1), slice(z), slice(z + 1)};
+            for (int64_t y = 1; (y < (y_num - 1)) && (counter_p < patches.size()); ++y) {
+                float val = neighbour_slices[1][x * y_num + y];
+                if (val == estimated_first_mode) {
+                    uint64_t counter_n = 0;
+                    for (int64_t sz = -1; sz <= 1; ++sz) {
+                        for (int64_t sx = -1; sx <= 1; ++sx) {
+                            for (int64_t sy = -1; sy <= 1; ++sy) {
+                                size_t idx = (x + sx) * y_num + (y + sy);
+                                const auto &val = neighbour_slices[sz + 1][idx];
+                                patches[counter_p][counter_n] = val;
+                                counter_n++;
                             }
                         }
-                        counter_p++;
-                        if (counter_p >= patches.size()) {
-                            goto finish;
-                        }
                     }
+                    counter_p++;
                 }
             }
         }
     }
 
-    finish:
-    par_timer.stop_timer();
+    fine_grained_timer.stop_timer();
 
     //first compute the mean over all the patches.
     double total_p=0;
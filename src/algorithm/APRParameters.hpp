@@ -35,6 +35,9 @@ public:
 
     bool normalized_input = false;
 
+    // number of pixels (in evenly spaced z slices) the automatic parameters are estimated from
+    double total_required_pixel = 10*1000*1000;
+
     std::string name;
     std::string output_dir;
     std::string input_image_name;
@@ -0,0 +1,198 @@
+//
+// Tiles of an image for tiled conversion (each tile is converted on its own and the results are stitched)
+//
+
+#ifndef PARTPLAY_APR_TILING_HPP
+#define PARTPLAY_APR_TILING_HPP
+
+#include <algorithm>
+#include <vector>
+#include "../data_structures/Mesh/MeshData.hpp"
+#include "../data_structures/APR/APRAccess.hpp"
+
+struct APRTile {
+    //
+    //  box: the pixels of the image loaded for the tile (the core plus an overlap with the neighbouring tiles)
+    //  core: the part of the image the tile is responsible for, the cores of the tiles partition the image
+    //
+    ImageROI box;
+    ImageROI core;
+};
+
+struct APRTileSeeds {
+    //
+    //  The Local Particle Cell set of the core of a tile ([level] -> SEED_TYPE/EMPTY for the particle cells of the
+    //  core, levels level_align .. level_max-1 as in the particle cell tree), and the (max down-sampled) level of the
+    //  particle cells of the core at level_align, the lower levels are computed from it once the tiles are stitched
+    //
+    std::vector<MeshData<uint8_t>> particle_cell_tree;
+    MeshData<float> level_image;
+};
+
+class APRTiling {
+    //
+    //  The tiles are converted with the levels of the full image, so their particle cells are on the same grid. The
+    //  begins of the boxes and cores are multiples of the particle cell size at level_align, so every particle cell of
+    //  the full image on level_align or above lies in exactly one core. The larger particle cells (below level_align)
+    //  can span several tiles, they are handled after stitching from the level_align data of the tiles.
+    //
+
+public:
+
+    uint64_t org_dims[3] = {0,0,0};
+    unsigned int level_min = 0;
+    unsigned int level_max = 0;
+    unsigned int level_align = 0;
+
+    std::vector<APRTile> tiles;
+
+    static unsigned int default_level_align(const unsigned int level_min_,const unsigned int level_max_){
+        //tiles aligned to 16 pixels (or the largest particle cells if they are smaller)
+        return std::max((int)level_min_,(int)level_max_ - 4);
+    }
+
+    inline uint64_t alignment() const {
+        //size of the particle cells at level_align in pixels
+        return ((uint64_t)1) << (level_max - level_align);
+    }
+
+    void initialize(const uint64_t y_num,const uint64_t x_num,const uint64_t z_num,const unsigned int level_min_,const unsigned int level_max_,const unsigned int level_align_,
+                    const uint64_t tile_size_y,const uint64_t tile_size_x,const uint64_t tile_size_z,const uint64_t overlap){
+        //
+        //  Regular grid of tiles (in z -> x -> y order), the tile sizes are rounded up to a multiple of alignment(), the
+        //  boxes are the cores grown by the overlap on each side (clipped to the image)
+        //
+
+        org_dims[0] = y_num;
+        org_dims[1] = x_num;
+        org_dims[2] = z_num;
+        level_min = level_min_;
+        level_max = level_max_;
+        level_align = level_align_;
+
+        const uint64_t tile_size[3] = {align_up(tile_size_y),align_up(tile_size_x),align_up(tile_size_z)};
+
+        tiles.clear();
+
+        for (uint64_t z = 0; z < org_dims[2]; z += tile_size[2]) {
+            for (uint64_t x = 0; x < org_dims[1]; x += tile_size[1]) {
+                for (uint64_t y = 0; y < org_dims[0]; y += tile_size[0]) {
+                    APRTile tile;
+                    tile.core.y_begin = y;
+                    tile.core.y_end = std::min(y + tile_size[0],org_dims[0]);
+                    tile.core.x_begin = x;
+                    tile.core.x_end = std::min(x + tile_size[1],org_dims[1]);
+                    tile.core.z_begin = z;
+                    tile.core.z_end = std::min(z + tile_size[2],org_dims[2]);
+
+                    tile.box.y_begin = align_down(tile.core.y_begin - std::min(overlap,tile.core.y_begin));
+                    tile.box.y_end = std::min(tile.core.y_end + overlap,org_dims[0]);
+                    tile.box.x_begin = align_down(tile.core.x_begin - std::min(overlap,tile.core.x_begin));
+                    tile.box.x_end = std::min(tile.core.x_end + overlap,org_dims[1]);
+                    tile.box.z_begin = align_down(tile.core.z_begin - std::min(overlap,tile.core.z_begin));
+                    tile.box.z_end = std::min(tile.core.z_end + overlap,org_dims[2]);
+
+                    tiles.push_back(tile);
+                }
+            }
+        }
+    }
+
+    bool valid() const {
+        //
+        //  Checks the alignment of the tiles, that the cores are inside the boxes and that they cover the image once
+        //
+
+        if((level_align < level_min) || (level_align >= level_max) || tiles.empty()){
+            return false;
+        }
+
+        uint64_t number_pixels = 0;
+
+        for (auto const &tile : tiles) {
+            const ImageROI& b = tile.box;
+            const ImageROI& c = tile.core;
+
+            if((b.y_begin % alignment()) || (b.x_begin % alignment()) || (b.z_begin % alignment()) ||
+               (c.y_begin % alignment()) || (c.x_begin % alignment()) || (c.z_begin % alignment())){
+                return false;
+            }
+
+            if((c.y_begin < b.y_begin) || (c.y_end > b.y_end) || (c.x_begin < b.x_begin) || (c.x_end > b.x_end) ||
+               (c.z_begin < b.z_begin) || (c.z_end > b.z_end) || (b.y_end > org_dims[0]) || (b.x_end > org_dims[1]) || (b.z_end > org_dims[2])){
+                return false;
+            }
+
+            //the cores can only end inside the image on the grid (otherwise a particle cell would be split between tiles)
+            if(((c.y_end % alignment()) && (c.y_end != org_dims[0])) || ((c.x_end % alignment()) && (c.x_end != org_dims[1])) ||
+               ((c.z_end % alignment()) && (c.z_end != org_dims[2]))){
+                return false;
+            }
+
+            if((c.y_begin >= c.y_end) || (c.x_begin >= c.x_end) || (c.z_begin >= c.z_end)){
+                return false;
+            }
+
+            number_pixels += (c.y_end - c.y_begin)*(c.x_end - c.x_begin)*(c.z_end - c.z_begin);
+        }
+
+        //together with the overlap check below the cores are a partition of the image
+        if(number_pixels != org_dims[0]*org_dims[1]*org_dims[2]){
+            return false;
+        }
+
+        //the sorted core edges split the image into a grid, each cell of it must be in at most one core
+        std::vector<uint64_t> edges[3];
+        for (auto const &tile : tiles) {
+            const ImageROI& c = tile.core;
+            edges[0].push_back(c.y_begin); edges[0].push_back(c.y_end);
+            edges[1].push_back(c.x_begin); edges[1].push_back(c.x_end);
+            edges[2].push_back(c.z_begin); edges[2].push_back(c.z_end);
+        }
+        for (auto &e : edges) {
+            std::sort(e.begin(),e.end());
+            e.erase(std::unique(e.begin(),e.end()),e.end());
+        }
+
+        auto edge_index = [&edges](const int dim,const uint64_t v){
+            return (uint64_t)(std::lower_bound(edges[dim].begin(),edges[dim].end(),v) - edges[dim].begin());
+        };
+
+        const uint64_t cells_y = edges[0].size() - 1;
+        const uint64_t cells_x = edges[1].size() - 1;
+        std::vector<bool> covered(cells_y*cells_x*(edges[2].size() - 1),false);
+
+        for (auto const &tile : tiles) {
+            const ImageROI& c = tile.core;
+            const uint64_t y_end = edge_index(0,c.y_end);
+            const uint64_t x_end = edge_index(1,c.x_end);
+            const uint64_t z_end = edge_index(2,c.z_end);
+            for (uint64_t z = edge_index(2,c.z_begin); z < z_end; ++z) {
+                for (uint64_t x = edge_index(1,c.x_begin); x < x_end; ++x) {
+                    for (uint64_t y = edge_index(0,c.y_begin); y < y_end; ++y) {
+                        const uint64_t cell = (z*cells_x + x)*cells_y + y;
+                        if(covered[cell]){
+                            return false;
+                        }
+                        covered[cell] = true;
+                    }
+                }
+            }
+        }
+
+        return true;
+    }
+
+private:
+
+    inline uint64_t align_down(const uint64_t v) const {
+        return v - (v % alignment());
+    }
+
+    inline uint64_t align_up(const uint64_t v) const {
+        return std::max(align_down(v + alignment() - 1),alignment());
+    }
+};
+
+
+#endif //PARTPLAY_APR_TILING_HPP
@@ -21,6 +21,8 @@ public:
     template<typename T>
     void get_smooth_bspline_3D(MeshData<T> &input, float lambda);
 
+    static size_t get_bspline_support(float lambda, float tol = 0.0001);
+
 // Calculate inverse B-Spline Transform
 
     template<typename T>
@@ -32,9 +34,9 @@ public:
     template<typename T>
     void calc_inv_bspline_z(MeshData<T> &input);
 
-    struct three_temps {
-        float temp_1, temp_2, temp_3;
-    };
+    //down-samples (mean of 2x2x2) and applies the inverse b-spline in y in one pass (as downsample then calc_inv_bspline_y)
+    template<typename T>
+    void downsample_calc_inv_bspline_y(const MeshData<T> &input, MeshData<float> &output);
 
 // Gradient computation
 
@@ -51,6 +53,11 @@ public:
     template<typename T>
     void bspline_filt_rec_y(MeshData<T> &image, float lambda, float tol);
 
+    //the y recursion run on blocks of number_lines neighbouring x-lines at once (interleaved, so the lines are the simd
+    //lanes), number_lines = 1 filters one line at a time
+    template<size_t number_lines, typename T>
+    void bspline_filt_rec_y_lines(MeshData<T> &image, float lambda, float tol);
+
     template<typename T>
     void bspline_filt_rec_x(MeshData<T> &image, float lambda, float tol);
 
@@ -59,6 +66,25 @@ public:
 
     inline float impulse_resp(float k, float rho, float omg);
 
+    struct bspline_coefficients {
+        float b1, b2, norm_factor;
+        size_t k0;
+        std::vector<float> bc1_vec, bc2_vec, bc3_vec, bc4_vec;
+    };
+
+    bspline_coefficients get_bspline_coefficients(float lambda, float tol, size_t k0_max, size_t k0_min);
+
+    static size_t get_tile_width(size_t y_num, size_t number_steps, size_t type_size);
+
+    template<size_t number_lines, typename T>
+    inline void bspline_filt_rec_lines(T *data, size_t y_stride, size_t y_num, const bspline_coefficients &c);
+
+    template<typename S, typename T>
+    inline void bspline_filt_rec_tile(T *data, size_t stride, size_t number_steps, size_t width, const bspline_coefficients &c, float *temp);
+
+    template<typename T>
+    inline void calc_inv_bspline_tile(T *data, size_t stride, size_t number_steps, size_t width, float *temp);
+
     inline float impulse_resp_back(float k, float rho, float omg, float gamma, float c0);
 
 };
@@ -136,6 +162,21 @@ void ComputeGradient::get_smooth_bspline_3D(MeshData<T>& input, float lambda) {
     spline_timer.stop_timer();
 }
 
+size_t ComputeGradient::get_bspline_support(float lambda, float tol) {
+    //
+    //  Number of pixels over which the recursive smoothing filters are initialised, beyond it the influence of a
+    //  pixel on the b-spline co-efficients is below tol (eq. 4.5 Unser 1993, as in bspline_filt_rec_y)
+    //
+
+    if(lambda <= 0){
+        return 0;
+    }
+
+    float xi = 1 - 96*lambda + 24*lambda*sqrt(3 + 144*lambda); // eq 4.6
+    float rho = (24*lambda - 1 - sqrt(xi))/(24*lambda)*sqrt((1/xi)*(48*lambda + 24*lambda*sqrt(3 + 144*lambda))); // eq 4.5
+
+    return std::max((size_t)(ceil(std::abs(log(tol)/log(rho)))),(size_t)2);
+}
 
 inline float ComputeGradient::impulse_resp(float k,float rho,float omg){
     //  Impulse Response Function
@@ -152,135 +193,230 @@ inline float ComputeGradient::impulse_resp_back(float k,float rho,float omg,floa
 
 template<typename T>
 void ComputeGradient::bspline_filt_rec_y(MeshData<T>& image,float lambda,float tol){
+    //16 lines fill the vector registers up to AVX-512 (and give independent recursions to hide the latency with narrower ones)
+    bspline_filt_rec_y_lines<16>(image,lambda,tol);
+}
+
+template<size_t number_lines, typename T>
+void ComputeGradient::bspline_filt_rec_y_lines(MeshData<T>& image,float lambda,float tol){
     //
     //  Bevan Cheeseman 2016
     //
     // Recursive Filter Implimentation for Smoothing BSplines
     // B-Spline Signal Processing: Part 11-Efficient Design and Applications, Unser 1993
-
-    float xi = 1 - 96*lambda + 24*lambda*sqrt(3 + 144*lambda); // eq 4.6
-    float rho = (24*lambda - 1 - sqrt(xi))/(24*lambda)*sqrt((1/xi)*(48*lambda + 24*lambda*sqrt(3 + 144*lambda))); // eq 4.5
-    float omg = atan(sqrt((1/xi)*(144*lambda - 1))); // eq 4.6
-
-    float c0 = (1+ pow(rho,2))/(1-pow(rho,2)) * (1 - 2*rho*cos(omg) + pow(rho,2))/(1 + 2*rho*cos(omg) + pow(rho,2)); // eq 4.8
-    float gamma = (1-pow(rho,2))/(1+pow(rho,2)) * (1/tan(omg)); // eq 4.8
-
-    const float b1 = 2*rho*cos(omg);
-    const float b2 = -pow(rho,2.0);
+    //
+    // The recursion along y can not be vectorized within a line, so blocks of number_lines x-lines are copied to an
+    // interleaved buffer ([y][line]) and filtered together, forwards and backwards, before they are copied back
+    //
 
     const size_t z_num = image.z_num;
     const size_t x_num = image.x_num;
     const size_t y_num = image.y_num;
 
-    const size_t k0 = std::max(std::min((size_t)(ceil(std::abs(log(tol)/log(rho)))),z_num),(size_t)2);
-    const float norm_factor = pow((1 - 2.0*rho*cos(omg) + pow(rho,2)),2);
-
-    // for boundaries
-    std::vector<float> impulse_resp_vec_f(k0+3);  //forward
-    for (size_t k = 0; k < (k0+3); ++k) {
-        impulse_resp_vec_f[k] = impulse_resp(k,rho,omg);
+    if(y_num < 2){
+        return;
     }
 
-    std::vector<float> impulse_resp_vec_b(k0+3);  //backward
-    for (size_t k = 0; k < (k0+3); ++k) {
-        impulse_resp_vec_b[k] = impulse_resp_back(k,rho,omg,gamma,c0);
+    //(the boundary sums can not reach past the end of the line)
+    const bspline_coefficients c = get_bspline_coefficients(lambda,tol,std::min(z_num,y_num),2);
+
+    const size_t number_blocks = (number_lines > 1) ? x_num/number_lines : 0;
+
+    #ifdef HAVE_OPENMP
+    #pragma omp parallel default(shared)
+    #endif
+    {
+        std::vector<T> block(number_blocks > 0 ? y_num*number_lines : 0);
+
+        int64_t z;
+        #ifdef HAVE_OPENMP
+        #pragma omp for schedule(static) private(z)
+        #endif
+        for (z = 0; z < (int64_t)z_num; ++z) {
+            const size_t jxnumynum = z * x_num * y_num;
+
+            for (size_t b = 0; b < number_blocks; ++b) {
+                T* lines = &image.mesh[jxnumynum + b*number_lines*y_num];
+
+                for (size_t y = 0; y < y_num; ++y) {
+                    for (size_t l = 0; l < number_lines; ++l) {
+                        block[y*number_lines + l] = lines[l*y_num + y];
+                    }
+                }
+
+                bspline_filt_rec_lines<number_lines>(block.data(), number_lines, y_num, c);
+
+                for (size_t l = 0; l < number_lines; ++l) {
+                    for (size_t y = 0; y < y_num; ++y) {
+                        lines[l*y_num + y] = block[y*number_lines + l];
+                    }
+                }
+            }
+
+            //the remaining lines one at a time, in place
+            for (size_t x = number_blocks*number_lines; x < x_num; ++x) {
+                bspline_filt_rec_lines<1>(&image.mesh[jxnumynum + x*y_num], 1, y_num, c);
+            }
+        }
     }
+}
 
-    std::vector<float> bc1_vec(k0, 0);  //forward
-    //y(1) init
-    bc1_vec[1] = impulse_resp_vec_f[0];
-    for (size_t k = 0; k < k0; ++k) {
-        bc1_vec[k] += impulse_resp_vec_f[k+1];
+template<size_t number_lines, typename T>
+inline void ComputeGradient::bspline_filt_rec_lines(T *data, const size_t y_stride, const size_t y_num, const bspline_coefficients &c) {
+    //
+    //  Causal and anti-causal recursions of number_lines lines, element l of line y at data[y*y_stride + l]
+    //
+
+    float temp1[number_lines];
+    float temp2[number_lines];
+    float temp3[number_lines];
+    float temp4[number_lines];
+
+    for (size_t l = 0; l < number_lines; ++l) {
+        temp1[l] = 0;
+        temp2[l] = 0;
+        temp3[l] = 0;
+        temp4[l] = 0;
     }
 
-    std::vector<float> bc2_vec(k0, 0);  //backward
-    //y(0) init
-    for (size_t k = 0; k < k0; ++k) {
-        bc2_vec[k] = impulse_resp_vec_f[k];
+    for (size_t k = 0; k < c.k0; ++k) {
+        const T* front = data + k*y_stride;
+        const T* back = data + (y_num - 1 - k)*y_stride;
+        #ifdef HAVE_OPENMP
+        #pragma omp simd
+        #endif
+        for (size_t l = 0; l < number_lines; ++l) {
+            temp1[l] += c.bc1_vec[k]*front[l];
+            temp2[l] += c.bc2_vec[k]*front[l];
+            temp3[l] += c.bc3_vec[k]*back[l];
+            temp4[l] += c.bc4_vec[k]*back[l];
+        }
     }
 
-    std::vector<float> bc3_vec(k0, 0);  //forward
-    //y(N-1) init
-    bc3_vec[0] = impulse_resp_vec_b[1];
-    for (size_t k = 0; k < (k0-1); ++k) {
-        bc3_vec[k+1] += impulse_resp_vec_b[k] + impulse_resp_vec_b[k+2];
+    //forwards direction
+
+    //initialize the sequence
+    for (size_t l = 0; l < number_lines; ++l) {
+        data[l] = temp2[l];
+        data[y_stride + l] = temp1[l];
     }
 
-    std::vector<float> bc4_vec(k0, 0);  //backward
-    //y(N) init
-    bc4_vec[0] = impulse_resp_vec_b[0];
-    for (size_t k = 1; k < k0; ++k) {
-        bc4_vec[k] += 2*impulse_resp_vec_b[k];
+    for (size_t y = 2; y < y_num; ++y) {
+        T* row = data + y*y_stride;
+        #ifdef HAVE_OPENMP
+        #pragma omp simd
+        #endif
+        for (size_t l = 0; l < number_lines; ++l) {
+            float temp = temp1[l]*c.b1 + temp2[l]*c.b2 + row[l];
+            row[l] = temp;
+            temp2[l] = temp1[l];
+            temp1[l] = temp;
+        }
     }
 
-    APRTimer btime;
-    btime.verbose_flag = false;
+    T* last = data + (y_num - 1)*y_stride;
+    T* second_last = data + (y_num - 2)*y_stride;
 
-    //forwards direction
-    btime.start_timer("forward_loop_y");
-    #ifdef HAVE_OPENMP
-	#pragma omp parallel for default(shared)
-    #endif
-    for (size_t z = 0; z < z_num; ++z) {
-        const size_t jxnumynum = z * x_num * y_num;
+    for (size_t l = 0; l < number_lines; ++l) {
+        second_last[l] = temp3[l];
+        last[l] = temp4[l];
+    }
 
-        for (size_t x = 0; x < x_num; ++x) {
-            float temp1 = 0;
-            float temp2 = 0;
-            float temp3 = 0;
-            float temp4 = 0;
-            const size_t iynum = x * y_num;
-
-            for (size_t k = 0; k < k0; ++k) {
-                temp1 += bc1_vec[k]*image.mesh[jxnumynum + iynum + k];
-                temp2 += bc2_vec[k]*image.mesh[jxnumynum + iynum + k];
-                temp3 += bc3_vec[k]*image.mesh[jxnumynum + iynum + y_num - 1 - k];
-                temp4 += bc4_vec[k]*image.mesh[jxnumynum + iynum + y_num - 1 - k];
-            }
+    //backwards direction
 
-            //initialize the sequence
-            image.mesh[jxnumynum + iynum + 0] = temp2;
-            image.mesh[jxnumynum + iynum + 1] = temp1;
+    for (size_t l = 0; l < number_lines; ++l) {
+        temp2[l] = last[l];
+        temp1[l] = second_last[l];
 
-            for (auto it = (image.mesh.begin()+jxnumynum + iynum + 2); it !=  (image.mesh.begin()+jxnumynum + iynum + y_num); ++it) {
-                float  temp = temp1*b1 + temp2*b2 + *it;
-                *it = temp;
-                temp2 = temp1;
-                temp1 = temp;
-            }
+        last[l] *= c.norm_factor;
+        second_last[l] *= c.norm_factor;
+    }
 
-            image.mesh[jxnumynum + iynum + y_num - 2] = temp3;
-            image.mesh[jxnumynum + iynum + y_num - 1] = temp4;
+    for (int64_t y = y_num - 3; y >= 0; --y) {
+        T* row = data + y*y_stride;
+        #ifdef HAVE_OPENMP
+        #pragma omp simd
+        #endif
+        for (size_t l = 0; l < number_lines; ++l) {
+            float temp = temp1[l]*c.b1 + temp2[l]*c.b2 + row[l];
+            row[l] = temp*c.norm_factor;
+            temp2[l] = temp1[l];
+            temp1[l] = temp;
         }
     }
-    btime.stop_timer();
+}
 
+template<typename S, typename T>
+inline void ComputeGradient::bspline_filt_rec_tile(T *data, const size_t stride, const size_t number_steps, const size_t width, const bspline_coefficients &c, float *temp) {
+    //
+    //  Causal and anti-causal recursions along x or z of a tile of width y-values, element l of step i at
+    //  data[i*stride + l]. The whole tile is filtered forwards and backwards before moving on, so it is still in cache
+    //  for the backward pass. The recursion state is kept in temp (4*width floats), the input is added in precision S.
+    //
 
-    btime.start_timer("backward_loop_y");
-    #ifdef HAVE_OPENMP
-	#pragma omp parallel for default(shared)
-    #endif
-    for (int64_t j = z_num - 1; j >= 0; --j) {
-        const size_t jxnumynum = j * x_num * y_num;
+    float* temp1 = temp;
+    float* temp2 = temp + width;
+    float* temp3 = temp + 2*width;
+    float* temp4 = temp + 3*width;
+
+    std::fill(temp, temp + 4*width, 0);
+
+    for (size_t k = 0; k < c.k0; ++k) {
+        const T* front = data + k*stride;
+        const T* back = data + (number_steps - 1 - k)*stride;
+        #ifdef HAVE_OPENMP
+        #pragma omp simd
+        #endif
+        for (size_t l = 0; l < width; ++l) {
+            //forwards boundary condition
+            temp1[l] += c.bc1_vec[k]*front[l];
+            temp2[l] += c.bc2_vec[k]*front[l];
+            //backwards boundary condition
+            temp3[l] += c.bc3_vec[k]*back[l];
+            temp4[l] += c.bc4_vec[k]*back[l];
+        }
+    }
 
-        for (int64_t i = x_num - 1; i >= 0; --i) {
-            const size_t iynum = i * y_num;
+    // ------  Causal Filter Loop
+    //initialization
+    for (size_t l = 0; l < width; ++l) {
+        data[l] = temp2[l];
+        data[stride + l] = temp1[l];
+    }
 
-            float temp2 = image.mesh[jxnumynum + iynum + y_num - 1];
-            float temp1 = image.mesh[jxnumynum + iynum + y_num - 2];
+    for (size_t i = 2; i < number_steps; ++i) {
+        T* row = data + i*stride;
+        #ifdef HAVE_OPENMP
+        #pragma omp simd
+        #endif
+        for (size_t l = 0; l < width; ++l) {
+            temp2[l] = ((S)row[l]) + c.b1*temp1[l] + c.b2*temp2[l];
+            row[l] = temp2[l];
+        }
+        std::swap(temp1, temp2);
+    }
 
-            image.mesh[jxnumynum + iynum + y_num - 1]*=norm_factor;
-            image.mesh[jxnumynum + iynum + y_num - 2]*=norm_factor;
+    // ------ Anti-Causal Filter Loop
+    //initialization
+    T* last = data + (number_steps - 1)*stride;
+    T* second_last = data + (number_steps - 2)*stride;
+    for (size_t l = 0; l < width; ++l) {
+        last[l] = temp4[l]*c.norm_factor;
+        second_last[l] = temp3[l]*c.norm_factor;
+    }
 
-            for (auto it = (image.mesh.begin()+jxnumynum + iynum + y_num-3); it !=  (image.mesh.begin()+jxnumynum + iynum-1); --it) {
-                float temp = temp1*b1 + temp2*b2 + *it;
-                *it = temp*norm_factor;
-                temp2 = temp1;
-                temp1 = temp;
-            }
+    for (int64_t i = number_steps - 3; i >= 0; --i) {
+        T* row = data + i*stride;
+        #ifdef HAVE_OPENMP
+        #pragma omp simd
+        #endif
+        for (size_t l = 0; l < width; ++l) {
+            float temp = (row[l] + c.b1*temp3[l] + c.b2*temp4[l]);
+            row[l] = temp*c.norm_factor;
+            temp4[l] = temp3[l];
+            temp3[l] = temp;
         }
     }
-    btime.stop_timer();
 }
 
 template<typename T>
@@ -289,151 +425,40 @@ void ComputeGradient::bspline_filt_rec_z(MeshData<T>& image,float lambda,float t
     //  Bevan Cheeseman 2016
     //
     //  Recursive Filter Implimentation for Smoothing BSplines
-
-    float xi = 1 - 96*lambda + 24*lambda*sqrt(3 + 144*lambda);
-    float rho = (24*lambda - 1 - sqrt(xi))/(24*lambda)*sqrt((1/xi)*(48*lambda + 24*lambda*sqrt(3 + 144*lambda)));
-    float omg = atan(sqrt((1/xi)*(144*lambda - 1)));
-    float c0 = (1+ pow(rho,2))/(1-pow(rho,2)) * (1 - 2*rho*cos(omg) + pow(rho,2))/(1 + 2*rho*cos(omg) + pow(rho,2));
-    float gamma = (1-pow(rho,2))/(1+pow(rho,2)) * (1/tan(omg));
-
-    const float b1 = 2*rho*cos(omg);
-    const float b2 = -pow(rho,2.0);
+    //
+    //  Filtered in y-tiles (all z for a range of y, see get_tile_width), the planes are too far apart for the cache
+    //
 
     const size_t z_num = image.z_num;
     const size_t x_num = image.x_num;
     const size_t y_num = image.y_num;
 
-    const size_t k0 = std::min((size_t)(ceil(std::abs(log(tol)/log(rho)))),z_num);
-    const float norm_factor = pow((1 - 2.0*rho*cos(omg) + pow(rho,2)),2);
-
-    //////////////////////////////////////////////////////////////
-    //
-    //  Setting up boundary conditions
-    //
-    //////////////////////////////////////////////////////////////
-
-    std::vector<float> impulse_resp_vec_f(k0+3);  //forward
-    for (size_t k = 0; k < (k0+3);k++){
-        impulse_resp_vec_f[k] = impulse_resp(k,rho,omg);
-    }
-
-    std::vector<float> impulse_resp_vec_b(k0+3);  //backward
-    for (size_t k = 0; k < (k0+3);k++){
-        impulse_resp_vec_b[k] = impulse_resp_back(k,rho,omg,gamma,c0);
-    }
-
-    std::vector<float> bc1_vec(k0, 0);  //forward
-    //y(1) init
-    bc1_vec[1] = impulse_resp_vec_f[0];
-    for(size_t k = 0; k < k0; k++){
-        bc1_vec[k] += impulse_resp_vec_f[k+1];
-    }
-
-    std::vector<float> bc2_vec(k0, 0);  //backward
-    //y(0) init
-    for(size_t k = 0; k < k0; k++){
-        bc2_vec[k] = impulse_resp_vec_f[k];
+    if(z_num < 2){
+        return;
     }
 
-    std::vector<float> bc3_vec(k0, 0);  //forward
-    //y(N-1) init
-    bc3_vec[0] = impulse_resp_vec_b[1];
-    for(size_t k = 0; k < (k0-1); k++){
-        bc3_vec[k+1] += impulse_resp_vec_b[k] + impulse_resp_vec_b[k+2];
-    }
+    const bspline_coefficients c = get_bspline_coefficients(lambda,tol,z_num,2);
 
-    std::vector<float> bc4_vec(k0, 0);  //backward
-    //y(N) init
-    bc4_vec[0] = impulse_resp_vec_b[0];
-    for(size_t k = 1; k < k0; k++){
-        bc4_vec[k] += 2*impulse_resp_vec_b[k];
-    }
-
-    //forwards direction
-    std::vector<float> temp_vec1(y_num,0);
-    std::vector<float> temp_vec2(y_num,0);
-    std::vector<float> temp_vec3(y_num,0);
-    std::vector<float> temp_vec4(y_num,0);
+    const size_t tile_width = get_tile_width(y_num,z_num,sizeof(T));
+    const size_t number_tiles = (y_num + tile_width - 1)/tile_width;
 
-    //Initialization and boundary conditions
     #ifdef HAVE_OPENMP
-	#pragma omp parallel for default(shared) firstprivate(temp_vec1, temp_vec2, temp_vec3, temp_vec4)
+    #pragma omp parallel default(shared)
     #endif
-    for (size_t i = 0; i < x_num; ++i) {
-
-        std::fill(temp_vec1.begin(), temp_vec1.end(), 0);
-        std::fill(temp_vec2.begin(), temp_vec2.end(), 0);
-        std::fill(temp_vec3.begin(), temp_vec3.end(), 0);
-        std::fill(temp_vec4.begin(), temp_vec4.end(), 0);
-
-        size_t iynum = i * y_num;
-
-        for (size_t j = 0; j < k0; ++j) {
-            size_t index = j * x_num * y_num + iynum;
-            #ifdef HAVE_OPENMP
-	        #pragma omp simd
-            #endif
-            for (int64_t k = y_num - 1; k >= 0; k--) {
-                //forwards boundary condition
-                temp_vec1[k] += bc1_vec[j] * image.mesh[index + k];
-                temp_vec2[k] += bc2_vec[j] * image.mesh[index + k];
-                //backwards boundary condition
-                temp_vec3[k] += bc3_vec[j] * image.mesh[(z_num - 1 - j)*x_num*y_num + iynum + k];
-                temp_vec4[k] += bc4_vec[j] * image.mesh[(z_num - 1 - j)*x_num*y_num + iynum + k];
-            }
-        }
-
-        // ------  Causal Filter Loop
-        //initialization
-        for (size_t k = 0; k < y_num; ++k) {
-            //z(0)
-            image.mesh[iynum + k] = temp_vec2[k];
-        }
-
-        for (size_t k = 0; k < y_num; ++k) {
-            //y(1)
-            image.mesh[x_num*y_num  + iynum + k] = temp_vec1[k];
-        }
-
-        for (size_t j = 2; j < z_num; ++j) {
-            size_t index = j * x_num * y_num + iynum;
-
-            #ifdef HAVE_OPENMP
-	        #pragma omp simd
-            #endif
-            for (size_t k = 0; k < y_num; ++k) {
-                temp_vec2[k] = 1.0*image.mesh[index + k] + b1*temp_vec1[k]+  b2*temp_vec2[k];
-            }
-
-            std::swap(temp_vec1, temp_vec2);
-            std::copy(temp_vec1.begin(), temp_vec1.begin()+ y_num, image.mesh.begin() + index);
-        }
-
-        // ------ Anti-Causal Filter Loop
-        //initialization
-        for (int64_t k = y_num - 1; k >= 0; --k) {
-            //y(N)
-            image.mesh[(z_num - 1)*x_num*y_num  + iynum + k] = temp_vec4[k]*norm_factor;
-        }
-
-        for (int64_t k = y_num - 1; k >= 0; --k) {
-            //y(N-1)
-            image.mesh[(z_num - 2)*x_num*y_num  + iynum + k] = temp_vec3[k]*norm_factor;
-        }
-
-        //main loop
-        for (int64_t j = z_num - 3; j >= 0; --j) {
-            size_t index = j * x_num * y_num + i * y_num;
-
-            #ifdef HAVE_OPENMP
-	        #pragma omp simd
-            #endif
-            for (int64_t k = y_num - 1; k >= 0; --k) {
-                float temp = (image.mesh[index + k] +  b1*temp_vec3[k]+  b2*temp_vec4[k]);
-                image.mesh[index + k] = temp*norm_factor;
-                temp_vec4[k] = temp_vec3[k];
-                temp_vec3[k] = temp;
-            }
+    {
+        std::vector<float> temp(4*tile_width);
+
+        int64_t t;
+        #ifdef HAVE_OPENMP
+        #pragma omp for schedule(static) private(t)
+        #endif
+        for (t = 0; t < (int64_t)(x_num*number_tiles); ++t) {
+            const size_t x = t/number_tiles;
+            const size_t y_begin = (t%number_tiles)*tile_width;
+            const size_t width = std::min(tile_width, y_num - y_begin);
+
+            //(z adds the input in double precision)
+            bspline_filt_rec_tile<double>(&image.mesh[x*y_num + y_begin], x_num*y_num, z_num, width, c, temp.data());
         }
     }
 }
@@ -444,150 +469,122 @@ void ComputeGradient::bspline_filt_rec_x(MeshData<T>& image,float lambda,float t
     //  Bevan Cheeseman 2016
     //
     //  Recursive Filter Implimentation for Smoothing BSplines
-
-    float xi = 1 - 96*lambda + 24*lambda*sqrt(3 + 144*lambda);
-    float rho = (24*lambda - 1 - sqrt(xi))/(24*lambda)*sqrt((1/xi)*(48*lambda + 24*lambda*sqrt(3 + 144*lambda)));
-    float omg = atan(sqrt((1/xi)*(144*lambda - 1)));
-    float c0 = (1+ pow(rho,2))/(1-pow(rho,2)) * (1 - 2*rho*cos(omg) + pow(rho,2))/(1 + 2*rho*cos(omg) + pow(rho,2));
-    float gamma = (1-pow(rho,2))/(1+pow(rho,2)) * (1/tan(omg));
-
-    const float b1 = 2*rho*cos(omg);
-    const float b2 = -pow(rho,2.0);
+    //
+    //  Filtered in y-tiles (all x for a range of y, see get_tile_width), so large xy planes do not leave the cache
+    //  between the forward and backward passes
+    //
 
     const size_t z_num = image.z_num;
     const size_t x_num = image.x_num;
     const size_t y_num = image.y_num;
 
-    const size_t k0 = std::min((size_t)(ceil(std::abs(log(tol)/log(rho)))),z_num);
-    const float norm_factor = pow((1 - 2.0*rho*cos(omg) + pow(rho,2)),2);
+    if(x_num < 2){
+        return;
+    }
+
+    //initialised over at most z_num pixels, as the y pass (a single pixel for 2D images), and not past the end of the line
+    const bspline_coefficients c = get_bspline_coefficients(lambda,tol,std::min(z_num,x_num),1);
+
+    const size_t tile_width = get_tile_width(y_num,x_num,sizeof(T));
+    const size_t number_tiles = (y_num + tile_width - 1)/tile_width;
+
+    #ifdef HAVE_OPENMP
+    #pragma omp parallel default(shared)
+    #endif
+    {
+        std::vector<float> temp(4*tile_width);
+
+        int64_t t;
+        #ifdef HAVE_OPENMP
+        #pragma omp for schedule(static) private(t)
+        #endif
+        for (t = 0; t < (int64_t)(z_num*number_tiles); ++t) {
+            const size_t z = t/number_tiles;
+            const size_t y_begin = (t%number_tiles)*tile_width;
+            const size_t width = std::min(tile_width, y_num - y_begin);
+
+            bspline_filt_rec_tile<float>(&image.mesh[z*x_num*y_num + y_begin], y_num, x_num, width, c, temp.data());
+        }
+    }
+}
 
-    //////////////////////////////////////////////////////////////
+ComputeGradient::bspline_coefficients ComputeGradient::get_bspline_coefficients(float lambda, float tol, size_t k0_max, size_t k0_min) {
     //
-    //  Setting up boundary conditions
+    //  Coefficients of the recursive filters and of their boundary conditions (Unser 1993), the boundary conditions are
+    //  initialised over at most k0_max (and at least k0_min) pixels
     //
-    //////////////////////////////////////////////////////////////
 
+    float xi = 1 - 96*lambda + 24*lambda*sqrt(3 + 144*lambda); // eq 4.6
+    float rho = (24*lambda - 1 - sqrt(xi))/(24*lambda)*sqrt((1/xi)*(48*lambda + 24*lambda*sqrt(3 + 144*lambda))); // eq 4.5
+    float omg = atan(sqrt((1/xi)*(144*lambda - 1))); // eq 4.6
+
+    float c0 = (1+ pow(rho,2))/(1-pow(rho,2)) * (1 - 2*rho*cos(omg) + pow(rho,2))/(1 + 2*rho*cos(omg) + pow(rho,2)); // eq 4.8
+    float gamma = (1-pow(rho,2))/(1+pow(rho,2)) * (1/tan(omg)); // eq 4.8
+
+    bspline_coefficients c;
+    c.b1 = 2*rho*cos(omg);
+    c.b2 = -pow(rho,2.0);
+
+    const size_t k0 = std::max(std::min((size_t)(ceil(std::abs(log(tol)/log(rho)))),k0_max),k0_min);
+    c.k0 = k0;
+    c.norm_factor = pow((1 - 2.0*rho*cos(omg) + pow(rho,2)),2);
+
+    // for boundaries
     std::vector<float> impulse_resp_vec_f(k0+3);  //forward
-    for (size_t k = 0; k < (k0+3);k++){
+    for (size_t k = 0; k < (k0+3); ++k) {
         impulse_resp_vec_f[k] = impulse_resp(k,rho,omg);
     }
 
     std::vector<float> impulse_resp_vec_b(k0+3);  //backward
-    for (size_t k = 0; k < (k0+3);k++){
+    for (size_t k = 0; k < (k0+3); ++k) {
         impulse_resp_vec_b[k] = impulse_resp_back(k,rho,omg,gamma,c0);
     }
 
-    std::vector<float> bc1_vec(k0, 0);  //forward
+    //(bc1_vec[1] is set even if k0 is 1, it is then not used)
+    c.bc1_vec.resize(std::max(k0,(size_t)2), 0);  //forward
     //y(1) init
-    bc1_vec[1] = impulse_resp_vec_f[0];
-    for(size_t k = 0; k < k0;k++){
-        bc1_vec[k] += impulse_resp_vec_f[k+1];
+    c.bc1_vec[1] = impulse_resp_vec_f[0];
+    for (size_t k = 0; k < k0; ++k) {
+        c.bc1_vec[k] += impulse_resp_vec_f[k+1];
     }
 
-    std::vector<float> bc2_vec(k0, 0);  //backward
+    c.bc2_vec.resize(k0, 0);  //backward
     //y(0) init
-    for(size_t k = 0; k < k0;k++){
-        bc2_vec[k] = impulse_resp_vec_f[k];
+    for (size_t k = 0; k < k0; ++k) {
+        c.bc2_vec[k] = impulse_resp_vec_f[k];
     }
 
-    std::vector<float> bc3_vec(k0, 0);  //forward
+    c.bc3_vec.resize(k0, 0);  //forward
     //y(N-1) init
-    bc3_vec[0] = impulse_resp_vec_b[1];
-    for(size_t k = 0; k < (k0-1);k++){
-        bc3_vec[k+1] += impulse_resp_vec_b[k] + impulse_resp_vec_b[k+2];
+    c.bc3_vec[0] = impulse_resp_vec_b[1];
+    for (size_t k = 0; k < (k0-1); ++k) {
+        c.bc3_vec[k+1] += impulse_resp_vec_b[k] + impulse_resp_vec_b[k+2];
     }
 
-    std::vector<float> bc4_vec(k0, 0);  //backward
+    c.bc4_vec.resize(k0, 0);  //backward
     //y(N) init
-    bc4_vec[0] = impulse_resp_vec_b[0];
-    for(size_t k = 1; k < k0;k++){
-        bc4_vec[k] += 2*impulse_resp_vec_b[k];
+    c.bc4_vec[0] = impulse_resp_vec_b[0];
+    for (size_t k = 1; k < k0; ++k) {
+        c.bc4_vec[k] += 2*impulse_resp_vec_b[k];
     }
 
-    //forwards direction
-
-    std::vector<float> temp_vec1(y_num,0);
-    std::vector<float> temp_vec2(y_num,0);
-    std::vector<float> temp_vec3(y_num,0);
-    std::vector<float> temp_vec4(y_num,0);
-
-    #ifdef HAVE_OPENMP
-	#pragma omp parallel for default(shared) firstprivate(temp_vec1, temp_vec2, temp_vec3, temp_vec4)
-    #endif
-    for (size_t j = 0;j < z_num; ++j) {
-        std::fill(temp_vec1.begin(), temp_vec1.end(), 0);
-        std::fill(temp_vec2.begin(), temp_vec2.end(), 0);
-        std::fill(temp_vec3.begin(), temp_vec3.end(), 0);
-        std::fill(temp_vec4.begin(), temp_vec4.end(), 0);
-
-        size_t jxnumynum = j * y_num * x_num;
-
-        for (size_t i = 0; i < k0; ++i) {
-
-            for (size_t k = 0; k < y_num; ++k) {
-                //forwards boundary condition
-                temp_vec1[k] += bc1_vec[i]*image.mesh[jxnumynum + i*y_num + k];
-                temp_vec2[k] += bc2_vec[i]*image.mesh[jxnumynum + i*y_num + k];
-                //backwards boundary condition
-                temp_vec3[k] += bc3_vec[i]*image.mesh[jxnumynum + (x_num - 1 - i)*y_num + k];
-                temp_vec4[k] += bc4_vec[i]*image.mesh[jxnumynum + (x_num - 1 - i)*y_num + k];
-            }
-        }
-
-        //initialization
-        for (int64_t k = y_num - 1; k >= 0; --k) {
-            //y(0)
-            image.mesh[jxnumynum  + k] = temp_vec2[k];
-        }
-
-        for (int64_t k = y_num - 1; k >= 0; --k) {
-            //y(1)
-            image.mesh[jxnumynum  + y_num + k] = temp_vec1[k];
-        }
-
-        for (size_t i = 2;i < x_num; ++i) {
-            size_t index = i * y_num + jxnumynum;
-
-            #ifdef HAVE_OPENMP
-            #pragma omp simd
-            #endif
-            for (int64_t k = y_num - 1; k >= 0; k--) {
-                temp_vec2[k] = image.mesh[index + k] + b1*temp_vec1[k]+  b2*temp_vec2[k];
-            }
-
-            std::swap(temp_vec1, temp_vec2);
-            std::copy(temp_vec1.begin(), temp_vec1.begin() + y_num, image.mesh.begin() + index);
-        }
-
-
-        //Anti-Causal Filter Loop
-
-        //initialization
-        for (int64_t k = y_num - 1; k >= 0; --k) {
-            //y(N)
-            image.mesh[jxnumynum  + (x_num - 1)*y_num + k] = temp_vec4[k]*norm_factor;
-        }
-
-        for (int64_t k = y_num - 1; k >= 0; --k) {
-            //y(N-1)
-            image.mesh[jxnumynum  + (x_num - 2)*y_num + k] = temp_vec3[k]*norm_factor;
-        }
+    return c;
+}
 
-        //main loop
-        for (int64_t i = x_num - 3; i >= 0; --i){
-            size_t index = jxnumynum + i*y_num;
+size_t ComputeGradient::get_tile_width(size_t y_num, size_t number_steps, size_t type_size) {
+    //
+    //  Width (in y) of the tiles of the x and z passes, so a tile over all the steps stays within 2 MB (the L2 cache),
+    //  a multiple of 16 values (whole cache lines and simd vectors) unless it is the whole y range. The rows of a tile
+    //  are kept at least 8 kB long, shorter rows defeat the hardware prefetcher and (at power of two strides) alias in
+    //  the cache, which costs more than the tile falling out of L2 (a 2 kB minimum made the float x pass slower than
+    //  filtering whole rows).
+    //
 
-            #ifdef HAVE_OPENMP
-            #pragma omp simd
-            #endif
-            for (int64_t k = y_num - 1; k >= 0; k--){
-                float temp = (image.mesh[index + k] + b1*temp_vec3[ k]+  b2*temp_vec4[ k]);
-                image.mesh[index + k] = temp*norm_factor;
-                temp_vec4[k] = temp_vec3[k];
-                temp_vec3[k] = temp;
-            }
-        }
-    }
+    const size_t cache_budget = 2*1024*1024;
+    const size_t min_row_bytes = 8*1024;
+    const size_t width = (cache_budget/(std::max(number_steps,(size_t)1)*type_size))/16*16;
+    const size_t min_width = (min_row_bytes/type_size)/16*16;
+    return std::min(std::max(width,min_width),y_num);
 }
 
 /**
@@ -640,131 +637,209 @@ void ComputeGradient::calc_inv_bspline_y(MeshData<T>& input){
 }
 
 template<typename T>
-void ComputeGradient::calc_inv_bspline_z(MeshData<T>& input){
-    //  Bevan Cheeseman 2016
+inline void ComputeGradient::calc_inv_bspline_tile(T *data, const size_t stride, const size_t number_steps, const size_t width, float *temp) {
+    //
+    //  Inverse cubic bspline filter along x or z of a tile of width y-values (element l of step i at data[i*stride + l]),
+    //  the three steps in the filter window are kept in temp (3*width floats) and rotated
     //
-    //  Inverse cubic bspline inverse filter in x direciton (Off-stride direction)
 
-    int64_t z_num = input.z_num;
-    int64_t x_num = input.x_num;
-    int64_t y_num = input.y_num;
+    const float a1 = 1.0/6.0;
+    const float a2 = 4.0/6.0;
+    const float a3 = 1.0/6.0;
 
-    const float a1 = 1.0 / 6.0; // gaussian for sigma 0.60056
-    const float a2 = 4.0 / 6.0;
-    const float a3 = 1.0 / 6.0;
+    float* temp1 = temp;
+    float* temp2 = temp + width;
+    float* temp3 = temp + 2*width;
 
-    std::vector<three_temps> temp_vec(y_num);
+    //LHS boundary condition is accounted for with this initialization
+    for (size_t l = 0; l < width; ++l) {
+        temp1[l] = data[stride + l]; // second step
+        temp2[l] = data[l]; // first step
+    }
 
-    int64_t xnumynum = x_num * y_num;
+    for (size_t i = 0; i < number_steps - 1; ++i) {
+        T* row = data + i*stride;
+        const T* next_row = row + stride;
+
+        #ifdef HAVE_OPENMP
+        #pragma omp simd
+        #endif
+        for (size_t l = 0; l < width; ++l) {
+            temp3[l] = next_row[l]; // (i+1)th step
+            row[l] = a1*temp1[l] + a2*temp2[l] + a3*temp3[l];
+        }
+
+        float* rotate = temp1;
+        temp1 = temp2;
+        temp2 = temp3;
+        temp3 = rotate;
+    }
+
+    //then do the last boundary point (RHS)
+    T* last = data + (number_steps - 1)*stride;
+    for (size_t l = 0; l < width; ++l) {
+        last[l] = (a1+a3)*temp1[l];
+        last[l] += a2*temp2[l];
+    }
+}
+
+template<typename T>
+void ComputeGradient::downsample_calc_inv_bspline_y(const MeshData<T>& input, MeshData<float>& output){
+    //
+    //  The down-sampled rows are computed into a row buffer (with the same sums as downsample) and the inverse b-spline is
+    //  applied from it, so the down-sampled image is only written once. Output is initialized to the down-sampled size.
+    //
+
+    const size_t z_num = input.z_num;
+    const size_t x_num = input.x_num;
+    const size_t y_num = input.y_num;
+
+    const size_t z_num_ds = ceil(z_num/2.0);
+    const size_t x_num_ds = ceil(x_num/2.0);
+    const size_t y_num_ds = ceil(y_num/2.0);
+
+    output.init(y_num_ds, x_num_ds, z_num_ds);
+
+    const float a1 = 1.0/6.0;
+    const float a2 = 4.0/6.0;
+    const float a3 = 1.0/6.0;
+
+    std::vector<float> temp_vec(y_num_ds, 0);
 
     #ifdef HAVE_OPENMP
-	#pragma omp parallel for default(shared) firstprivate(temp_vec)
+    #pragma omp parallel for default(shared) firstprivate(temp_vec)
     #endif
-    for (int64_t i = 0; i < x_num; ++i) {
-        int64_t iynum = i * y_num;
+    for (size_t z = 0; z < z_num_ds; ++z) {
+        for (size_t x = 0; x < x_num_ds; ++x) {
+            // shifted +1 in original input space
+            const size_t shx = std::min(2*x + 1, x_num - 1);
+            const size_t shz = std::min(2*z + 1, z_num - 1);
+
+            const T* row_0 = &input.mesh[2*z*x_num*y_num + 2*x*y_num];
+            const T* row_1 = &input.mesh[2*z*x_num*y_num + shx*y_num];
+            const T* row_2 = &input.mesh[shz*x_num*y_num + 2*x*y_num];
+            const T* row_3 = &input.mesh[shz*x_num*y_num + shx*y_num];
+
+            //(the +1 neighbour in y is only clipped for the last down-sampled pixel of odd lines)
+            const size_t y_num_pairs = y_num/2;
+            for (size_t y = 0; y < y_num_pairs; ++y) {
+                float sum = row_0[2*y];
+                sum = sum + (float) row_0[2*y + 1];
+                sum = sum + (float) row_1[2*y];
+                sum = sum + (float) row_1[2*y + 1];
+                sum = sum + (float) row_2[2*y];
+                sum = sum + (float) row_2[2*y + 1];
+                sum = sum + (float) row_3[2*y];
+                sum = sum + (float) row_3[2*y + 1];
+                temp_vec[y] = sum/8.0;
+            }
 
-        //initialize the loop
-        for (int64_t k = y_num - 1; k >= 0; k--) {
-            temp_vec[k].temp_1 = input.mesh[xnumynum + iynum + k]; //second column in z_dir
-            temp_vec[k].temp_2 = input.mesh[iynum + k]; // first column in z-dir
-        }
+            for (size_t y = y_num_pairs; y < y_num_ds; ++y) {
+                const size_t shy = y_num - 1;
+                float sum = row_0[2*y];
+                sum = sum + (float) row_0[shy];
+                sum = sum + (float) row_1[2*y];
+                sum = sum + (float) row_1[shy];
+                sum = sum + (float) row_2[2*y];
+                sum = sum + (float) row_2[shy];
+                sum = sum + (float) row_3[2*y];
+                sum = sum + (float) row_3[shy];
+                temp_vec[y] = sum/8.0;
+            }
 
-        for (int64_t j = 0; j < z_num - 1; ++j) {
-            int64_t jxnumynum = j * xnumynum;
+            float* out = &output.mesh[z*x_num_ds*y_num_ds + x*y_num_ds];
 
-            //initialize the loop
-            #ifdef HAVE_OPENMP
-	        #pragma omp simd
-            #endif
-            for (int64_t k = 0; k < (y_num); ++k) {
-                temp_vec[k].temp_3 = input.mesh[jxnumynum + xnumynum + iynum + k]; // (j+1)th column in z dir
+            if (y_num_ds < 2) {
+                out[0] = temp_vec[0];
+                continue;
             }
 
-            #ifdef HAVE_OPENMP
-	        #pragma omp simd
-            #endif
-            for (int64_t k = 0; k < (y_num); ++k) {
-                input.mesh[jxnumynum + iynum + k] = a1 * temp_vec[k].temp_1 + a2 * temp_vec[k].temp_2 + a3 * temp_vec[k].temp_3;
-            }
+            //LHS boundary condition
+            out[0] = a2*temp_vec[0];
+            out[0] += (a1+a3)*temp_vec[1];
 
-            #ifdef HAVE_OPENMP
-            #pragma omp simd
-            #endif
-            // TODO: use three separete vectors and swap them instead of one vector of triple floats
-            for (int64_t k = 0; k < (y_num);k++){
-                temp_vec[k].temp_1 = temp_vec[k].temp_2;
-                temp_vec[k].temp_2 = temp_vec[k].temp_3;
+            for (size_t k = 1; k < (y_num_ds-1); k++){
+                out[k] = a1*temp_vec[k-1] + a2*temp_vec[k] + a3*temp_vec[k+1];
             }
-        }
 
-        //then do the last boundary point (RHS)
-        for (int64_t k = 0; k < (y_num);k++){
-            input.mesh[(z_num - 1) * xnumynum + iynum + k] = (a1 + a3) * temp_vec[k].temp_1;
-            input.mesh[(z_num - 1) * xnumynum + iynum + k] += a2 * temp_vec[k].temp_2;
+            //RHS boundary condition
+            out[y_num_ds - 1] = (a1+a3)*temp_vec[y_num_ds - 2];
+            out[y_num_ds - 1] += a2*temp_vec[y_num_ds - 1];
         }
     }
 }
 
-
 template<typename T>
-void ComputeGradient::calc_inv_bspline_x(MeshData<T>& input) {
+void ComputeGradient::calc_inv_bspline_z(MeshData<T>& input){
     //  Bevan Cheeseman 2016
     //
-    //  Inverse cubic bspline inverse filter in x direciton (Off-stride direction)
+    //  Inverse cubic bspline inverse filter in z direciton (Off-stride direction), in y-tiles as bspline_filt_rec_z
 
-    int64_t z_num = input.z_num;
-    int64_t x_num = input.x_num;
-    int64_t y_num = input.y_num;
+    const size_t z_num = input.z_num;
+    const size_t x_num = input.x_num;
+    const size_t y_num = input.y_num;
 
-    const float a1 = 1.0/6.0;
-    const float a2 = 4.0/6.0;
-    const float a3 = 1.0/6.0;
+    if(z_num < 2){
+        return;
+    }
 
-    std::vector<three_temps> temp_vec(y_num);
-    int64_t xnumynum = x_num * y_num;
+    const size_t tile_width = get_tile_width(y_num,z_num,sizeof(T));
+    const size_t number_tiles = (y_num + tile_width - 1)/tile_width;
 
     #ifdef HAVE_OPENMP
-	#pragma omp parallel for default(shared) firstprivate(temp_vec)
+    #pragma omp parallel default(shared)
     #endif
-    for(int64_t j = 0; j < z_num; ++j) {
-        int64_t jxnumynum = j * xnumynum;
-
-        //initialize the loop
-        for (int64_t k = y_num - 1; k >= 0; --k) {
-            temp_vec[k].temp_1 = input.mesh[jxnumynum + y_num + k]; // second column in the XY plane
-            temp_vec[k].temp_2 = input.mesh[jxnumynum + k];   // first column in the XY plane
+    {
+        std::vector<float> temp(3*tile_width);
+
+        int64_t t;
+        #ifdef HAVE_OPENMP
+        #pragma omp for schedule(static) private(t)
+        #endif
+        for (t = 0; t < (int64_t)(x_num*number_tiles); ++t) {
+            const size_t x = t/number_tiles;
+            const size_t y_begin = (t%number_tiles)*tile_width;
+            const size_t width = std::min(tile_width, y_num - y_begin);
+
+            calc_inv_bspline_tile(&input.mesh[x*y_num + y_begin], x_num*y_num, z_num, width, temp.data());
         }
+    }
+}
 
-        //LHS boundary condition is accounted for with this initialization
-        for (int64_t i = 0; i < x_num-1; ++i) {
-            int64_t iynum = i * y_num;
 
-            //initialize the loop
-            #ifdef HAVE_OPENMP
-	        #pragma omp simd
-            #endif
-            for (int64_t k = 0; k < y_num; ++k) {
-                temp_vec[k].temp_3 = input.mesh[jxnumynum + iynum + y_num + k]; // get (i+1)th column
-            }
+template<typename T>
+void ComputeGradient::calc_inv_bspline_x(MeshData<T>& input) {
+    //  Bevan Cheeseman 2016
+    //
+    //  Inverse cubic bspline inverse filter in x direciton (Off-stride direction), in y-tiles as bspline_filt_rec_x
 
-            #ifdef HAVE_OPENMP
-	        #pragma omp simd
-            #endif
-            for (int64_t k = 0; k < (y_num); k++) {
-                input.mesh[jxnumynum + iynum + k] = a1 * temp_vec[k].temp_1 + a2 * temp_vec[k].temp_2 + a3 * temp_vec[k].temp_3;
-            }
+    const size_t z_num = input.z_num;
+    const size_t x_num = input.x_num;
+    const size_t y_num = input.y_num;
 
-            // move two first y-columns to the right
-            // TODO: instead of temp_vec of triple-floats we could use 3 separate vectors and switch them instead of copying data
-            for (int64_t k = 0; k < (y_num); k++) {
-                temp_vec[k].temp_1 = temp_vec[k].temp_2;
-                temp_vec[k].temp_2 = temp_vec[k].temp_3;
-            }
-        }
+    if(x_num < 2){
+        return;
+    }
+
+    const size_t tile_width = get_tile_width(y_num,x_num,sizeof(T));
+    const size_t number_tiles = (y_num + tile_width - 1)/tile_width;
 
-        //then do the last boundary point (RHS)
-        for (int64_t k = y_num - 1; k >= 0; k--) {
-            input.mesh[jxnumynum + xnumynum - y_num + k] = (a1+a3) * temp_vec[k].temp_1 + a2 * temp_vec[k].temp_2;
+    #ifdef HAVE_OPENMP
+    #pragma omp parallel default(shared)
+    #endif
+    {
+        std::vector<float> temp(3*tile_width);
+
+        int64_t t;
+        #ifdef HAVE_OPENMP
+        #pragma omp for schedule(static) private(t)
+        #endif
+        for (t = 0; t < (int64_t)(z_num*number_tiles); ++t) {
+            const size_t z = t/number_tiles;
+            const size_t y_begin = (t%number_tiles)*tile_width;
+            const size_t width = std::min(tile_width, y_num - y_begin);
+
+            calc_inv_bspline_tile(&input.mesh[z*x_num*y_num + y_begin], y_num, x_num, width, temp.data());
         }
     }
 }
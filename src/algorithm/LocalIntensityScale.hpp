@@ -22,9 +22,29 @@ public:
     template<typename T>
     void calc_sat_mean_y(MeshData<T> &input, const size_t offset);
 
+    //the SAT mean in y of load(index) written to input, for fusing an element-wise pass into the mean (see calc_sat_mean_y)
+    template<typename T, typename L>
+    void calc_sat_mean_y_op(MeshData<T> &input, const size_t offset, L load);
+
+    //calc_sat_mean_y_op on blocks of number_lines x-lines at once (lines need at least 2*offset + 2 pixels)
+    template<size_t number_lines, typename T, typename L>
+    void calc_sat_mean_y_lines(MeshData<T> &input, const size_t offset, L load);
+
+    //calc_abs_diff followed by calc_sat_mean_y in one pass
+    template<typename T>
+    void calc_abs_diff_sat_mean_y(const MeshData<T> &input_image, MeshData<T> &var, const size_t offset);
+
+    //copies input to input_copy and computes calc_sat_mean_y of input in one pass
+    template<typename T>
+    void copy_calc_sat_mean_y(MeshData<T> &input, MeshData<T> &input_copy, const size_t offset);
+
     void get_window(float &var_rescale, std::vector<int> &var_win, const APRParameters &par);
     template<typename T>
     void rescale_var_and_threshold(MeshData<T>& var,const float var_rescale, const APRParameters& par);
+
+private:
+    template<size_t number_lines, typename T>
+    inline void sat_mean_lines(const T *sums, T *out, const size_t line_stride, const size_t y_num, const size_t offset);
 };
 
 template<typename T>
@@ -104,10 +124,38 @@ void LocalIntensityScale::get_window(float& var_rescale, std::vector<int>& var_w
  */
 template<typename T>
 void LocalIntensityScale::calc_sat_mean_y(MeshData<T>& input, const size_t offset){
+    calc_sat_mean_y_op(input, offset, [&input](const size_t idx) -> T { return input.mesh[idx]; });
+}
+
+template<typename T>
+void LocalIntensityScale::calc_abs_diff_sat_mean_y(const MeshData<T> &input_image, MeshData<T> &var, const size_t offset) {
+    calc_sat_mean_y_op(var, offset, [&input_image, &var](const size_t idx) -> T { return std::abs(var.mesh[idx] - input_image.mesh[idx]); });
+}
+
+template<typename T>
+void LocalIntensityScale::copy_calc_sat_mean_y(MeshData<T> &input, MeshData<T> &input_copy, const size_t offset) {
+    calc_sat_mean_y_op(input, offset, [&input, &input_copy](const size_t idx) -> T {
+        input_copy.mesh[idx] = input.mesh[idx];
+        return input.mesh[idx];
+    });
+}
+
+template<typename T, typename L>
+void LocalIntensityScale::calc_sat_mean_y_op(MeshData<T>& input, const size_t offset, L load){
+    //
+    //  load(index) is called once per element (in order along each line) before the element is overwritten
+    //
     const size_t z_num = input.z_num;
     const size_t x_num = input.x_num;
     const size_t y_num = input.y_num;
 
+    if(y_num >= 2*offset + 2) {
+        calc_sat_mean_y_lines<8>(input, offset, load);
+        return;
+    }
+
+    //(short lines, the boundaries overlap)
+
     std::vector<T> temp_vec(y_num, 0);
     float divisor = 2 * offset + 1;
 
@@ -121,7 +169,7 @@ void LocalIntensityScale::calc_sat_mean_y(MeshData<T>& input, const size_t offse
             //first pass over and calculate cumsum
             float temp = 0;
             for (size_t k = 0; k < y_num; ++k) {
-                temp += input.mesh[index + k];
+                temp += load(index + k);
                 temp_vec[k] = temp;
             }
 
@@ -161,6 +209,127 @@ void LocalIntensityScale::calc_sat_mean_y(MeshData<T>& input, const size_t offse
     }
 }
 
+template<size_t number_lines, typename T, typename L>
+void LocalIntensityScale::calc_sat_mean_y_lines(MeshData<T>& input, const size_t offset, L load){
+    //
+    //  The cumulative sum along a line is a serial dependency, so blocks of number_lines x-lines are summed together
+    //  (one running sum per line) into an interleaved buffer ([y][line]), and the means of all the lines of the block
+    //  are computed from it at once with the boundaries peeled. Same arithmetic as the line by line version.
+    //
+    const size_t z_num = input.z_num;
+    const size_t x_num = input.x_num;
+    const size_t y_num = input.y_num;
+
+    const size_t number_blocks = (number_lines > 1) ? x_num/number_lines : 0;
+
+    #ifdef HAVE_OPENMP
+    #pragma omp parallel default(shared)
+    #endif
+    {
+        std::vector<T> sums(y_num*number_lines);
+
+        int64_t z;
+        #ifdef HAVE_OPENMP
+        #pragma omp for schedule(static) private(z)
+        #endif
+        for (z = 0; z < (int64_t)z_num; ++z) {
+            const size_t jxnumynum = z * x_num * y_num;
+
+            for (size_t b = 0; b < number_blocks; ++b) {
+                const size_t index = jxnumynum + b*number_lines*y_num;
+
+                //cumulative sums
+                float temp[number_lines];
+                for (size_t l = 0; l < number_lines; ++l) {
+                    temp[l] = 0;
+                }
+                for (size_t k = 0; k < y_num; ++k) {
+                    for (size_t l = 0; l < number_lines; ++l) {
+                        temp[l] += load(index + l*y_num + k);
+                        sums[k*number_lines + l] = temp[l];
+                    }
+                }
+
+                sat_mean_lines<number_lines>(sums.data(), &input.mesh[index], y_num, y_num, offset);
+            }
+
+            //the remaining lines one at a time
+            for (size_t x = number_blocks*number_lines; x < x_num; ++x) {
+                const size_t index = jxnumynum + x*y_num;
+
+                float temp = 0;
+                for (size_t k = 0; k < y_num; ++k) {
+                    temp += load(index + k);
+                    sums[k] = temp;
+                }
+
+                sat_mean_lines<1>(sums.data(), &input.mesh[index], y_num, y_num, offset);
+            }
+        }
+    }
+}
+
+template<size_t number_lines, typename T>
+inline void LocalIntensityScale::sat_mean_lines(const T *sums, T *out, const size_t line_stride, const size_t y_num, const size_t offset) {
+    //
+    //  Means of number_lines lines from their cumulative sums (element l of line y at sums[y*number_lines + l]) written
+    //  to out[l*line_stride + y], with the arithmetic of calc_sat_mean_y (y_num >= 2*offset + 2)
+    //
+    const float divisor = 2 * offset + 1;
+    const float end_point_factor = divisor/(offset + 1);
+
+    //end point (LHS)
+    for (size_t l = 0; l < number_lines; ++l) {
+        T value = 0;
+        value += sums[offset*number_lines + l]/divisor;
+        value *= end_point_factor;
+        out[l*line_stride] = value;
+    }
+
+    //LHS boundary
+    for (size_t k = 1; k < (offset + 1); ++k) {
+        const double factor = divisor/(1.0*k + offset);
+        #ifdef HAVE_OPENMP
+        #pragma omp simd
+        #endif
+        for (size_t l = 0; l < number_lines; ++l) {
+            T value = -sums[l]/divisor;
+            value += sums[(k + offset)*number_lines + l]/divisor;
+            value *= factor;
+            out[l*line_stride + k] = value;
+        }
+    }
+
+    //interior
+    for (size_t k = offset + 1; k < (y_num - offset); ++k) {
+        #ifdef HAVE_OPENMP
+        #pragma omp simd
+        #endif
+        for (size_t l = 0; l < number_lines; ++l) {
+            T value = -sums[(k - offset - 1)*number_lines + l]/divisor;
+            value += sums[(k + offset)*number_lines + l]/divisor;
+            out[l*line_stride + k] = value;
+        }
+    }
+
+    //RHS boundary
+    float counter = 0;
+    for (size_t k = (y_num - offset); k < y_num; ++k) {
+        counter++;
+        const double factor = 1.0/(divisor - counter);
+        #ifdef HAVE_OPENMP
+        #pragma omp simd
+        #endif
+        for (size_t l = 0; l < number_lines; ++l) {
+            T value = -sums[(k - offset - 1)*number_lines + l]/divisor;
+            value *= divisor;
+            value += sums[(y_num - 1)*number_lines + l];
+            value *= factor;
+            out[l*line_stride + k] = value;
+        }
+    }
+}
+
 template<typename T>
 void LocalIntensityScale::calc_sat_mean_x(MeshData<T>& input, const size_t offset) {
     const size_t z_num = input.z_num;
@@ -200,6 +369,9 @@ void LocalIntensityScale::calc_sat_mean_x(MeshData<T>& input, const size_t offse
             index_modulo = (current_index + offset) % (2*offset + 1); // current_index - offset - 1
             size_t previous_modulo = (current_index + offset - 1) % (2*offset + 1); // the index of previous cumsum
 
+            #ifdef HAVE_OPENMP
+            #pragma omp simd
+            #endif
             for(size_t k = 0; k < y_num; k++) {
                 float temp = input.mesh[jxnumynum + (i + offset)*y_num + k] + temp_vec[previous_modulo*y_num + k];
                 input.mesh[jxnumynum + i*y_num + k] = (temp - temp_vec[index_modulo*y_num + k]) /
@@ -264,6 +436,9 @@ void LocalIntensityScale::calc_sat_mean_z(MeshData<T>& input,const size_t offset
             index_modulo = (current_index + offset) % (2*offset + 1); // current_index - offset - 1
             size_t previous_modulo = (current_index + offset - 1) % (2*offset + 1); // the index of previous cumsum
 
+            #ifdef HAVE_OPENMP
+            #pragma omp simd
+            #endif
             for(size_t k = 0; k < y_num; k++) {
                 // the current cumsum
                 float temp = input.mesh[(j + offset) * xnumynum + iynum + k] + temp_vec[previous_modulo*y_num + k];
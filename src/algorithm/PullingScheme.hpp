@@ -64,6 +64,7 @@ public:
     template<typename T>
     void fill(float k, const MeshData<T> &input);
     void pulling_scheme_main();
+    uint64_t count_particles(uint64_t y_num, uint64_t x_num, uint64_t z_num) const;
     template<typename T>
     void initialize_particle_cell_tree(APR<T>& apr);
 
@@ -116,6 +117,59 @@ void PullingScheme::pulling_scheme_main() {
     }
 }
 
+uint64_t PullingScheme::count_particles(const uint64_t y_num, const uint64_t x_num, const uint64_t z_num) const {
+    //
+    //  Number of particles of the APR the particle cell tree (after the Pulling Scheme) gives, without building the
+    //  access structure. Boundary and filler cells are particles of their level, the children of seed cells are particles
+    //  of the level above (y_num, x_num, z_num are the dimensions of the image, the highest level)
+    //
+
+    uint64_t number_particles = 0;
+
+    for (unsigned int level = l_min; level <= l_max; ++level) {
+        const MeshData<uint8_t>& tree = particle_cell_tree[level];
+        const bool has_parent = level > l_min;
+
+        int64_t z;
+        #ifdef HAVE_OPENMP
+        #pragma omp parallel for default(shared) private(z) reduction(+:number_particles)
+        #endif
+        for (z = 0; z < (int64_t)tree.z_num; ++z) {
+            for (size_t x = 0; x < tree.x_num; ++x) {
+                const uint8_t* row = &tree.mesh[z*tree.x_num*tree.y_num + x*tree.y_num];
+                const uint8_t* parent_row = has_parent ? &particle_cell_tree[level - 1].at(0, x/2, z/2) : nullptr;
+                for (size_t y = 0; y < tree.y_num; ++y) {
+                    if ((row[y] == BOUNDARY_TYPE) || (row[y] == FILLER_TYPE) || (has_parent && (parent_row[y/2] == SEED_TYPE))) {
+                        number_particles++;
+                    }
+                }
+            }
+        }
+    }
+
+    //the children of the seed cells on the highest level of the tree, clipped to the image
+    const MeshData<uint8_t>& tree = particle_cell_tree[l_max];
+
+    int64_t z;
+    #ifdef HAVE_OPENMP
+    #pragma omp parallel for default(shared) private(z) reduction(+:number_particles)
+    #endif
+    for (z = 0; z < (int64_t)tree.z_num; ++z) {
+        const uint64_t children_z = std::min((uint64_t)2, z_num - 2*z);
+        for (size_t x = 0; x < tree.x_num; ++x) {
+            const uint64_t children_x = std::min((uint64_t)2, x_num - 2*x);
+            const uint8_t* row = &tree.mesh[z*tree.x_num*tree.y_num + x*tree.y_num];
+            for (size_t y = 0; y < tree.y_num; ++y) {
+                if (row[y] == SEED_TYPE) {
+                    number_particles += children_z*children_x*std::min((uint64_t)2, y_num - 2*y);
+                }
+            }
+        }
+    }
+
+    return number_particles;
+}
+
 template<typename T>
 void PullingScheme::fill(const float k, const MeshData<T> &input) {
     //  Bevan Cheeseman 2016
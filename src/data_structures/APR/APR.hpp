@@ -51,8 +51,12 @@ public:
     //////////////////////////////////
 
     //basic IO
-    void read_apr(std::string file_name){
-        apr_writer.read_apr(*this,file_name);
+    void read_apr(std::string file_name,bool flat_map = true){
+        //
+        //  Loaded APRs use the flat access structure by default, it is read straight from the file without rebuilding
+        //  the per row maps. flat_map = false rebuilds the std::map structure (see also APRAccess::set_flat_map)
+        //
+        apr_writer.read_apr(*this,file_name,flat_map);
     }
 
     void write_apr(std::string save_loc,std::string file_name){
@@ -142,18 +146,69 @@ public:
         //  Samples particles from an image using an image tree (img_by_level is a vector of images)
 
         //initialization of the iteration structures
-        APRIterator<ImageType> apr_iterator(*this); //this is required for parallel access
+        APRLinearIterator apr_iterator(apr_access); //this is required for parallel access (cheap to copy)
         parts.data.resize(apr_iterator.total_number_particles());
 
-        #ifdef HAVE_OPENMP
-	    #pragma omp parallel for schedule(static) firstprivate(apr_iterator)
-        #endif
-        for (uint64_t particle_number = 0; particle_number < apr_iterator.total_number_particles(); ++particle_number) {
-            //needed step for any parallel loop (update to the next part)
-            apr_iterator.set_iterator_to_particle_by_number(particle_number);
-            parts[apr_iterator] = img_by_level[apr_iterator.level()].at(apr_iterator.y(),apr_iterator.x(),apr_iterator.z());
+        for (uint64_t level = apr_iterator.level_min(); level <= apr_iterator.level_max(); ++level) {
+            const int64_t x_num_ = apr_iterator.spatial_index_x_max(level);
+            const int64_t z_num_ = apr_iterator.spatial_index_z_max(level);
+            const MeshData<U>& img = img_by_level[level];
+
+            int64_t z_;
+            #ifdef HAVE_OPENMP
+            #pragma omp parallel for schedule(dynamic) private(z_) firstprivate(apr_iterator)
+            #endif
+            for (z_ = 0; z_ < z_num_; ++z_) {
+                for (int64_t x_ = 0; x_ < x_num_; ++x_) {
+                    //each run of particles is copied straight out of the (contiguous in y) image row
+                    if(apr_iterator.set_iterator_to_row_begin(level,z_,x_)) {
+                        do {
+                            const U* img_row = &img.at(apr_iterator.run_y_begin(), x_, z_);
+                            std::copy(img_row, img_row + apr_iterator.run_length(), parts.data.begin() + apr_iterator.run_global_index_begin());
+                        } while(apr_iterator.move_to_next_run());
+                    }
+                }
+            }
         }
     }
+
+    ////////////////////////
+    ///
+    ///  Crops
+    ///
+    //////////////////////////
+
+    ImageROI crop(const ImageROI& roi,APR<ImageType>& apr_crop){
+        //
+        //  Extracts the particles of the box as a standalone APR (with its own access structure and intensities), the
+        //  particle cells are taken over as they are, so no reconstruction or conversion is needed. The origin of the
+        //  box is aligned down to the particle cell size at level_min, the aligned box (in pixels of this APR) is returned.
+        //
+
+        const ImageROI aligned_roi = apr_access.crop_roi(roi);
+
+        std::vector<ParticleRun> runs;
+        apr_access.find_particle_runs_in_roi(aligned_roi,runs);
+
+        apr_crop.apr_access.initialize_structure_from_crop(apr_access,aligned_roi,runs);
+        APRAccess::crop_particle_data(runs,particles_intensities,apr_crop.particles_intensities);
+
+        apr_crop.name = name;
+        apr_crop.parameters = parameters;
+
+        return aligned_roi;
+    }
+
+    template<typename S>
+    void crop_parts(const ImageROI& roi,const ExtraParticleData<S>& parts,ExtraParticleData<S>& crop_parts){
+        //
+        //  Extracts other particle data of this APR in the particle order of the crop of the same box
+        //
+
+        std::vector<ParticleRun> runs;
+        apr_access.find_particle_runs_in_roi(apr_access.crop_roi(roi),runs);
+        APRAccess::crop_particle_data(runs,parts,crop_parts);
+    }
 };
 
 
@@ -7,7 +7,10 @@
 
 
 
+#include <cmath>
 #include <map>
+#include <algorithm>
+#include <numeric>
 #include <utility>
 #include "../../data_structures/Mesh/MeshData.hpp"
 
@@ -37,10 +40,18 @@
 #define ZM_LEVEL_MASK ((((uint16_t)1) << 2) - 1) << 11
 #define ZM_LEVEL_SHIFT 11
 
+//default access structure of converted APRs (loaded APRs are flat unless APR::read_apr is asked otherwise), can be
+//changed at run time using set_flat_map()
+#ifdef APR_USE_FLAT_MAP
+#define APR_FLAT_MAP_DEFAULT true
+#else
+#define APR_FLAT_MAP_DEFAULT false
+#endif
 
 #include "APR.hpp"
 #include "ExtraParticleData.hpp"
 #include "ExtraPartCellData.hpp"
+#include "ArenaPartCellData.hpp"
 
 
 struct ParticleCell {
@@ -48,6 +59,17 @@ struct ParticleCell {
     uint64_t pc_offset,global_index;
 };
 
+struct ParticleRun {
+    //run of particles contiguous in y (and in global index), y_end is inclusive
+    uint16_t level,x,z,y_begin,y_end;
+    uint64_t global_index_begin;
+};
+
+struct ImageROI {
+    //box in pixels of the original image, the ends are exclusive
+    uint64_t y_begin,y_end,x_begin,x_end,z_begin,z_end;
+};
+
 struct YGap_map {
     uint16_t y_end;
     uint64_t global_index_begin;
@@ -59,14 +81,31 @@ struct ParticleCellGapMap{
 
 struct MapIterator{
     std::map<uint16_t,YGap_map>::iterator iterator;
-    uint64_t pc_offset;
-    uint16_t level;
+    //not pointing to any row until set
+    uint64_t pc_offset = UINT64_MAX;
+    uint16_t level = UINT16_MAX;
+    //current gap and end of the row when using the flat access structure
+    uint64_t gap_index = 0;
+    uint64_t gap_end = 0;
+};
+
+struct FlatGapMap{
+    //
+    //  Contiguous (CSR style) alternative to the per row std::map, the gaps of all non-empty rows are stored in
+    //  level -> z -> x -> y order, row_gap_begin[level][pc_offset] is the index of the first gap of the row
+    //  (x_num*z_num + 1 entries per level, so the row ends at row_gap_begin[level][pc_offset+1])
+    //
+    std::vector<uint16_t> y_begin;
+    std::vector<uint16_t> y_end;
+    std::vector<uint64_t> global_index_begin;
+    std::vector<std::vector<uint64_t>> row_gap_begin;
 };
 
 struct LocalMapIterators{
-    std::vector<MapIterator>  same_level;
-    std::vector<std::vector<MapIterator>>  child_level;
-    std::vector<MapIterator>  parent_level;
+    //fixed size, so copying an iterator (e.g. firstprivate) does not allocate
+    MapIterator same_level[6];
+    MapIterator child_level[6][4];
+    MapIterator parent_level[6];
 
     LocalMapIterators(){
         //initialize them to be set to pointing to no-where
@@ -74,11 +113,12 @@ struct LocalMapIterators{
         init.pc_offset = -1;
         init.level = -1;
 
-        same_level.resize(6,init);
-        parent_level.resize(6,init);
-        child_level.resize(6);
         for (int i = 0; i < 6; ++i) {
-            child_level[i].resize(4,init);
+            same_level[i] = init;
+            parent_level[i] = init;
+            for (int j = 0; j < 4; ++j) {
+                child_level[i][j] = init;
+            }
         }
     }
 };
@@ -99,9 +139,14 @@ class APRAccess {
 
 public:
 
-    ExtraPartCellData<ParticleCellGapMap> gap_map;
+    ArenaPartCellData<ParticleCellGapMap> gap_map; //one map per non-empty row
     //ExtraPartCellData<std::map<uint16_t,YGap_map>::iterator> gap_map_it;
 
+    FlatGapMap flat_map;
+
+    //selects the access structure (gap_map or flat_map), needs to be set before the structure is initialized or read
+    bool use_flat_map = APR_FLAT_MAP_DEFAULT;
+
     ExtraParticleData<uint8_t> particle_cell_type;
 
     uint64_t level_max;
@@ -126,6 +171,10 @@ public:
     std::vector<std::vector<uint64_t>> global_index_by_level_and_z_begin;
     std::vector<std::vector<uint64_t>> global_index_by_level_and_z_end;
 
+    //per level index of the non-empty rows (pc_offset) and the global index of their first particle (for random access by particle number)
+    std::vector<std::vector<uint64_t>> row_index_pc_offset;
+    std::vector<std::vector<uint64_t>> row_index_global_begin;
+
     MapIterator& get_local_iterator(LocalMapIterators& local_iterators,const uint16_t& level_delta,const uint16_t& face,const uint16_t& index){
         //
         //  Chooses the local iterator required
@@ -219,11 +268,140 @@ public:
         return false;
     }
 
+    /////////////////////////
+    /// Row and gap access (independent of the access structure used)
+    ///
+    /////////////////////////
+
+    inline bool row_empty(const uint16_t& level,const uint64_t& offset){
+        if(use_flat_map){
+            return (flat_map.row_gap_begin[level][offset] == flat_map.row_gap_begin[level][offset+1]);
+        } else {
+            return (gap_map.row_size(level,offset) == 0);
+        }
+    }
+
+    inline uint64_t row_number_gaps(const uint16_t& level,const uint64_t& offset){
+        if(use_flat_map){
+            return (flat_map.row_gap_begin[level][offset+1] - flat_map.row_gap_begin[level][offset]);
+        } else if(gap_map.row_size(level,offset) > 0){
+            return gap_map.row(level,offset)[0].map.size();
+        } else {
+            return 0;
+        }
+    }
+
+    inline void set_row_begin(MapIterator& it,const uint16_t& level,const uint64_t& offset){
+        //
+        //  Sets the iterator to the first gap of a (non-empty) row
+        //
+        it.level = level;
+        it.pc_offset = offset;
+        if(use_flat_map){
+            it.gap_index = flat_map.row_gap_begin[level][offset];
+            it.gap_end = flat_map.row_gap_begin[level][offset+1];
+        } else {
+            it.iterator = gap_map.row(level,offset)[0].map.begin();
+        }
+    }
+
+    inline bool next_gap(MapIterator& it){
+        //
+        //  Moves to the next gap in the row, returns false if the end of the row has been reached
+        //
+        if(use_flat_map){
+            it.gap_index++;
+            return (it.gap_index < it.gap_end);
+        } else {
+            it.iterator++;
+            return (it.iterator != gap_map.row(it.level,it.pc_offset)[0].map.end());
+        }
+    }
+
+    inline uint16_t gap_y_begin(const MapIterator& it){
+        return use_flat_map ? flat_map.y_begin[it.gap_index] : it.iterator->first;
+    }
+
+    inline uint16_t gap_y_end(const MapIterator& it){
+        return use_flat_map ? flat_map.y_end[it.gap_index] : it.iterator->second.y_end;
+    }
+
+    inline uint64_t gap_global_index_begin(const MapIterator& it){
+        return use_flat_map ? flat_map.global_index_begin[it.gap_index] : it.iterator->second.global_index_begin;
+    }
+
+    inline uint64_t row_global_index_end(const uint16_t& level,const uint64_t& offset){
+        //
+        //  Global index of the last particle in the row (0 for empty rows)
+        //
+        if(use_flat_map){
+            const uint64_t last = flat_map.row_gap_begin[level][offset+1];
+            if(last > flat_map.row_gap_begin[level][offset]){
+                return (flat_map.global_index_begin[last-1] + (flat_map.y_end[last-1] - flat_map.y_begin[last-1]));
+            } else {
+                return 0;
+            }
+        } else if(gap_map.row_size(level,offset) > 0){
+            auto it = gap_map.row(level,offset)[0].map.rbegin();
+            return (it->second.global_index_begin + (it->second.y_end-it->first));
+        } else {
+            return 0;
+        }
+    }
+
+    inline uint64_t find_row_by_particle_number(const uint16_t& level,const uint64_t& particle_number){
+        //
+        //  Returns the pc_offset of the row on the level containing the particle, binary search over the non-empty rows
+        //
+        const std::vector<uint64_t>& global_begin = row_index_global_begin[level];
+        auto row = std::upper_bound(global_begin.begin(),global_begin.end(),particle_number) - 1;
+        return row_index_pc_offset[level][row - global_begin.begin()];
+    }
+
+    inline void find_gap_by_particle_number(MapIterator& it,const uint64_t& particle_number){
+        //
+        //  Moves the iterator (set to the beginning of the row) to the gap containing the particle
+        //
+        if(use_flat_map){
+            const uint64_t* global_begin = flat_map.global_index_begin.data();
+            it.gap_index = (std::upper_bound(global_begin + it.gap_index, global_begin + it.gap_end, particle_number) - global_begin) - 1;
+        } else {
+            while(particle_number > global_index_end(it)){
+                it.iterator++;
+            }
+        }
+    }
+
+    inline bool find_gap_by_y(MapIterator& it,const uint16_t& level,const uint64_t& offset,const uint16_t& y){
+        //
+        //  Sets the iterator to the first gap of a (non-empty) row that ends at or after y, returns false if there is none
+        //
+        it.level = level;
+        it.pc_offset = offset;
+        if(use_flat_map){
+            it.gap_end = flat_map.row_gap_begin[level][offset+1];
+            const uint16_t* y_end_ = flat_map.y_end.data();
+            it.gap_index = std::lower_bound(y_end_ + flat_map.row_gap_begin[level][offset], y_end_ + it.gap_end, y) - y_end_;
+            return (it.gap_index < it.gap_end);
+        } else {
+            std::map<uint16_t,YGap_map>& row_map = gap_map.row(level,offset)[0].map;
+            it.iterator = row_map.upper_bound(y);
+            if(it.iterator != row_map.begin()){
+                auto previous = std::prev(it.iterator);
+                if(previous->second.y_end >= y){
+                    it.iterator = previous;
+                }
+            }
+            return (it.iterator != row_map.end());
+        }
+    }
+
     inline uint64_t get_parts_start(const uint16_t& x,const uint16_t& z,const uint16_t& level){
         const uint64_t offset = x_num[level] * z + x;
-        if(gap_map.data[level][offset].size() > 0){
-            auto it = (gap_map.data[level][offset][0].map.begin());
-            return it->second.global_index_begin;
+        if(!row_empty(level,offset)){
+            MapIterator it;
+            set_row_begin(it,level,offset);
+            return gap_global_index_begin(it);
         } else {
             return (-1);
         }
@@ -231,20 +409,16 @@ public:
 
     inline uint64_t get_parts_end(const uint16_t& x,const uint16_t& z,const uint16_t& level){
         const uint64_t offset = x_num[level] * z + x;
-        if(gap_map.data[level][offset].size() > 0){
-            auto it = (gap_map.data[level][offset][0].map.rbegin());
-            return (it->second.global_index_begin + (it->second.y_end-it->first));
-        } else {
-            return (0);
-        }
+        return row_global_index_end(level,offset);
     }
 
     inline uint64_t global_index_end(MapIterator& it){
-        return (it.iterator->second.global_index_begin + (it.iterator->second.y_end-it.iterator->first));
+        return (gap_global_index_begin(it) + (gap_y_end(it)-gap_y_begin(it)));
     }
 
     inline bool check_neighbours_flag(const uint16_t& x,const uint16_t& z,const uint16_t& level){
-        return ((uint16_t)(x-1)>(x_num[level]-3)) | ((uint16_t)(z-1)>(z_num[level]-3));
+        //set on the first and last rows of the level (which can be the same on levels with fewer than 3 rows, e.g. in crops)
+        return (x == 0) | ((uint64_t)x + 1 >= x_num[level]) | (z == 0) | ((uint64_t)z + 1 >= z_num[level]);
     }
 
     inline uint8_t number_neighbours_in_direction(const uint8_t& level_delta){
@@ -262,12 +436,16 @@ public:
     }
 
     bool find_particle_cell(ParticleCell& part_cell,MapIterator& map_iterator){
-        if(gap_map.data[part_cell.level][part_cell.pc_offset].size() > 0) {
+        if(use_flat_map){
+            return find_particle_cell_flat(part_cell,map_iterator);
+        }
 
-            ParticleCellGapMap& current_pc_map = gap_map.data[part_cell.level][part_cell.pc_offset][0];
+        if(gap_map.row_size(part_cell.level,part_cell.pc_offset) > 0) {
+
+            ParticleCellGapMap& current_pc_map = gap_map.row(part_cell.level,part_cell.pc_offset)[0];
 
             if((map_iterator.pc_offset != part_cell.pc_offset) || (map_iterator.level != part_cell.level) ){
-                map_iterator.iterator = gap_map.data[part_cell.level][part_cell.pc_offset][0].map.begin();
+                map_iterator.iterator = gap_map.row(part_cell.level,part_cell.pc_offset)[0].map.begin();
                 map_iterator.pc_offset = part_cell.pc_offset;
                 map_iterator.level = part_cell.level;
             }
@@ -324,8 +502,418 @@ public:
         return false;
     }
 
+    bool find_particle_cell_flat(ParticleCell& part_cell,MapIterator& map_iterator){
+        //
+        //  Flat access structure version of find_particle_cell, gallops forward from the last gap found in the row
+        //  (neighbour access mostly moves forward in small steps) and otherwise binary searches the contiguous gaps.
+        //
+
+        const uint64_t row_begin = flat_map.row_gap_begin[part_cell.level][part_cell.pc_offset];
+        const uint64_t row_end = flat_map.row_gap_begin[part_cell.level][part_cell.pc_offset+1];
+
+        if(row_begin == row_end){
+            return false;
+        }
+
+        if((map_iterator.pc_offset != part_cell.pc_offset) || (map_iterator.level != part_cell.level) ){
+            map_iterator.gap_index = row_begin;
+            map_iterator.gap_end = row_end;
+            map_iterator.pc_offset = part_cell.pc_offset;
+            map_iterator.level = part_cell.level;
+        }
+
+        const uint16_t* y_begin_ = flat_map.y_begin.data();
+        const uint64_t current = map_iterator.gap_index;
+        const uint16_t* found;
+
+        if(part_cell.y >= y_begin_[current]){
+            if(part_cell.y <= flat_map.y_end[current]){
+                // already pointing to the correct place
+                part_cell.global_index = flat_map.global_index_begin[current] + (part_cell.y - y_begin_[current]);
+                return true;
+            }
+
+            //galloping search for the first gap beginning after y
+            uint64_t bound = 1;
+            while(((current + bound) < row_end) && (y_begin_[current + bound] <= part_cell.y)){
+                bound *= 2;
+            }
+
+            found = std::upper_bound(y_begin_ + current + bound/2 + 1, y_begin_ + std::min(current + bound,row_end), part_cell.y);
+        } else {
+            found = std::upper_bound(y_begin_ + row_begin, y_begin_ + current, part_cell.y);
+
+            if(found == (y_begin_ + row_begin)){
+                //less then the first value
+                return false;
+            }
+        }
+
+        const uint64_t gap = (found - y_begin_) - 1;
+        map_iterator.gap_index = gap;
+
+        if(part_cell.y <= flat_map.y_end[gap]){
+            part_cell.global_index = flat_map.global_index_begin[gap] + (part_cell.y - y_begin_[gap]);
+            return true;
+        }
+
+        return false;
+    }
+
+    /////////////////////////
+    /// Region of interest queries
+    ///
+    /////////////////////////
+
+    void find_particle_runs_in_roi(const ImageROI& roi,std::vector<ParticleRun>& runs){
+        //
+        //  Returns the runs of particles (in global index order) whose particle cells intersect the box, only the rows
+        //  intersecting the box are visited on each level (in parallel over z) and the gaps are clipped to its y range
+        //
+
+        runs.clear();
+
+        const uint64_t y_end_max = std::min(roi.y_end,(uint64_t)y_num[level_max]);
+        const uint64_t x_end_max = std::min(roi.x_end,(uint64_t)x_num[level_max]);
+        const uint64_t z_end_max = std::min(roi.z_end,(uint64_t)z_num[level_max]);
+
+        if((roi.y_begin >= y_end_max) || (roi.x_begin >= x_end_max) || (roi.z_begin >= z_end_max)){
+            return;
+        }
+
+        for (uint64_t level = level_min; level <= level_max; ++level) {
+            //the particle cells of the level intersecting the box (inclusive)
+            const unsigned int shift = level_max - level;
+            const uint16_t y_begin_l = roi.y_begin >> shift;
+            const uint16_t y_end_l = (y_end_max - 1) >> shift;
+            const uint64_t x_begin_l = roi.x_begin >> shift;
+            const uint64_t x_end_l = (x_end_max - 1) >> shift;
+            const int64_t z_begin_l = roi.z_begin >> shift;
+            const int64_t z_end_l = (z_end_max - 1) >> shift;
+
+            std::vector<std::vector<ParticleRun>> z_runs(z_end_l - z_begin_l + 1);
+
+            int64_t z_;
+#ifdef HAVE_OPENMP
+#pragma omp parallel for default(shared) schedule(dynamic) private(z_) if((z_end_l - z_begin_l) > 8)
+#endif
+            for (z_ = z_begin_l; z_ <= z_end_l; ++z_) {
+                std::vector<ParticleRun>& slice_runs = z_runs[z_ - z_begin_l];
+                MapIterator it;
+
+                for (uint64_t x_ = x_begin_l; x_ <= x_end_l; ++x_) {
+                    const uint64_t offset = x_num[level]*z_ + x_;
+
+                    if(row_empty(level,offset) || !find_gap_by_y(it,level,offset,y_begin_l)){
+                        continue;
+                    }
+
+                    do {
+                        const uint16_t gap_begin = gap_y_begin(it);
+                        if(gap_begin > y_end_l){
+                            break;
+                        }
+
+                        ParticleRun run;
+                        run.level = level;
+                        run.x = x_;
+                        run.z = z_;
+                        run.y_begin = std::max(gap_begin,y_begin_l);
+                        run.y_end = std::min(gap_y_end(it),y_end_l);
+                        run.global_index_begin = gap_global_index_begin(it) + (run.y_begin - gap_begin);
+                        slice_runs.push_back(run);
+                    } while(next_gap(it));
+                }
+            }
+
+            for (auto const &slice_runs : z_runs) {
+                runs.insert(runs.end(),slice_runs.begin(),slice_runs.end());
+            }
+        }
+    }
+
+    static uint64_t number_particles_in_runs(const std::vector<ParticleRun>& runs){
+        uint64_t total = 0;
+        for (auto const &run : runs) {
+            total += (run.y_end - run.y_begin) + 1;
+        }
+        return total;
+    }
+
+    /////////////////////////
+    /// Crops (sub-APRs)
+    ///
+    /////////////////////////
+
+    ImageROI crop_roi(const ImageROI& roi) const {
+        //
+        //  The box actually covered by a crop: the begin is aligned down to the size of the particle cells at level_min
+        //  so the particle cells of every level stay on their grid in the crop, and the end is clipped to the image.
+        //
+
+        const uint64_t cell_size = ((uint64_t)1) << (level_max - level_min);
+
+        ImageROI aligned;
+        aligned.y_end = std::min(roi.y_end,(uint64_t)org_dims[0]);
+        aligned.x_end = std::min(roi.x_end,(uint64_t)org_dims[1]);
+        aligned.z_end = std::min(roi.z_end,(uint64_t)org_dims[2]);
+        aligned.y_begin = std::min(roi.y_begin - (roi.y_begin % cell_size),aligned.y_end);
+        aligned.x_begin = std::min(roi.x_begin - (roi.x_begin % cell_size),aligned.x_end);
+        aligned.z_begin = std::min(roi.z_begin - (roi.z_begin % cell_size),aligned.z_end);
+
+        return aligned;
+    }
+
+    void initialize_structure_from_crop(const APRAccess& apr_access,const ImageROI& roi,const std::vector<ParticleRun>& runs){
+        //
+        //  Builds the access structure of a crop directly from the runs of the original structure intersecting it
+        //  (find_particle_runs_in_roi on an aligned box from crop_roi), the particle cells keep their level and are
+        //  shifted to the origin of the box on each level. The particles of the crop are the particles of the runs
+        //  in the same order, so the particle data is copied over run by run (see crop_particle_data).
+        //
+
+        level_min = apr_access.level_min;
+        level_max = apr_access.level_max;
+        use_flat_map = apr_access.use_flat_map;
+
+        org_dims[0] = roi.y_end - roi.y_begin;
+        org_dims[1] = roi.x_end - roi.x_begin;
+        org_dims[2] = roi.z_end - roi.z_begin;
+
+        x_num.assign(level_max+1,0);
+        y_num.assign(level_max+1,0);
+        z_num.assign(level_max+1,0);
+
+        for (uint64_t level = level_min; level <= level_max; ++level) {
+            const unsigned int shift = level_max - level;
+            const uint64_t cell_size = ((uint64_t)1) << shift;
+            y_num[level] = (org_dims[0] + cell_size - 1) >> shift;
+            x_num[level] = (org_dims[1] + cell_size - 1) >> shift;
+            z_num[level] = (org_dims[2] + cell_size - 1) >> shift;
+        }
+
+        //one gap per run, the runs of a row are consecutive
+        MapStorageData map_data;
+        map_data.y_begin.resize(runs.size());
+        map_data.y_end.resize(runs.size());
+        map_data.global_index.resize(runs.size());
+
+        uint64_t global_index = 0;
+        uint64_t number_particles_type = 0;
+
+        for (uint64_t i = 0; i < runs.size(); ++i) {
+            const ParticleRun& run = runs[i];
+            const unsigned int shift = level_max - run.level;
+            const uint16_t y_origin = roi.y_begin >> shift;
+
+            map_data.y_begin[i] = run.y_begin - y_origin;
+            map_data.y_end[i] = run.y_end - y_origin;
+            map_data.global_index[i] = global_index;
+
+            const uint64_t run_length = (run.y_end - run.y_begin) + 1;
+            global_index += run_length;
+
+            if(run.level < level_max){
+                number_particles_type += run_length;
+            }
+
+            if((i == 0) || (run.level != runs[i-1].level) || (run.z != runs[i-1].z) || (run.x != runs[i-1].x)){
+                map_data.level.push_back(run.level);
+                map_data.x.push_back(run.x - (roi.x_begin >> shift));
+                map_data.z.push_back(run.z - (roi.z_begin >> shift));
+                map_data.number_gaps.push_back(1);
+            } else {
+                map_data.number_gaps.back()++;
+            }
+        }
+
+        total_number_particles = global_index;
+        total_number_gaps = runs.size();
+        total_number_non_empty_rows = map_data.number_gaps.size();
+
+        rebuild_map(map_data);
+
+        //the types of the particle cells below level_max, they are stored in particle order
+        particle_cell_type.data.resize(number_particles_type);
+
+        uint64_t counter = 0;
+        for (auto const &run : runs) {
+            if(run.level < level_max){
+                const uint64_t run_length = (run.y_end - run.y_begin) + 1;
+                std::copy(apr_access.particle_cell_type.data.begin() + run.global_index_begin,
+                          apr_access.particle_cell_type.data.begin() + run.global_index_begin + run_length,
+                          particle_cell_type.data.begin() + counter);
+                counter += run_length;
+            }
+        }
+    }
+
+    template<typename S>
+    static void crop_particle_data(const std::vector<ParticleRun>& runs,const ExtraParticleData<S>& parts,ExtraParticleData<S>& crop_parts){
+        //
+        //  Copies the particle data of the runs (from find_particle_runs_in_roi) into the particle order of the crop
+        //
+
+        std::vector<uint64_t> run_begin(runs.size()+1,0);
+        for (uint64_t i = 0; i < runs.size(); ++i) {
+            run_begin[i+1] = run_begin[i] + (runs[i].y_end - runs[i].y_begin) + 1;
+        }
+
+        crop_parts.data.resize(run_begin.back());
+
+        int64_t i;
+#ifdef HAVE_OPENMP
+#pragma omp parallel for default(shared) schedule(static) private(i) if(runs.size() > 1000)
+#endif
+        for (i = 0; i < (int64_t)runs.size(); ++i) {
+            std::copy(parts.data.begin() + runs[i].global_index_begin,
+                      parts.data.begin() + runs[i].global_index_begin + (run_begin[i+1] - run_begin[i]),
+                      crop_parts.data.begin() + run_begin[i]);
+        }
+    }
+
+    /////////////////////////
+    /// Batch random access
+    ///
+    /////////////////////////
+
+    void find_particles_by_global_coordinate(const std::vector<float>& x,const std::vector<float>& y,const std::vector<float>& z,std::vector<uint64_t>& global_index){
+        //
+        //  Batch version of APRIterator::set_iterator_by_global_coordinate, finds the particle cell whose spatial domain
+        //  contains each point (x[i],y[i],z[i]) and returns its global index (UINT64_MAX if the point is out of bounds).
+        //
+        //  The points are bucketed by their row at the highest level (counting sort) and sorted by y within a row, the
+        //  z slices are then searched in parallel with one map iterator per level, so consecutive points reuse the rows
+        //  and gaps found for the previous point.
+        //
+
+        const uint64_t number_points = x.size();
+        global_index.resize(number_points);
+
+        const uint64_t y_num_ = y_num[level_max];
+        const uint64_t x_num_ = x_num[level_max];
+        const uint64_t z_num_ = z_num[level_max];
+
+        //the row (x_num*z + x) and y of the highest level particle cell containing each point
+        std::vector<uint64_t> cell_row(number_points);
+        std::vector<uint16_t> cell_y(number_points);
+
+        int64_t i;
+#ifdef HAVE_OPENMP
+#pragma omp parallel for default(shared) schedule(static) private(i)
+#endif
+        for (i = 0; i < (int64_t)number_points; ++i) {
+            if((x[i] < 0) || (y[i] < 0) || (z[i] < 0) || ((uint64_t)(x[i]) > (x_num_-1)) || ((uint64_t)(y[i]) > (y_num_-1)) || ((uint64_t)(z[i]) > (z_num_-1))){
+                //out of bounds
+                cell_row[i] = UINT64_MAX;
+                global_index[i] = UINT64_MAX;
+            } else {
+                //rounded as in set_iterator_by_global_coordinate (the coordinates are positive here)
+                const uint64_t x_ = std::min((uint64_t)(x[i] + 0.5),x_num_-1);
+                const uint64_t z_ = std::min((uint64_t)(z[i] + 0.5),z_num_-1);
+                cell_row[i] = x_num_*z_ + x_;
+                cell_y[i] = std::min((uint64_t)(y[i] + 0.5),y_num_-1);
+            }
+        }
+
+        //bucket the points by row (counting sort)
+        std::vector<uint64_t> row_begin(x_num_*z_num_+1,0);
+        for (uint64_t j = 0; j < number_points; ++j) {
+            if(cell_row[j] != UINT64_MAX){
+                row_begin[cell_row[j]+1]++;
+            }
+        }
+        std::partial_sum(row_begin.begin(),row_begin.end(),row_begin.begin());
+
+        std::vector<std::pair<uint16_t,uint64_t>> order(row_begin.back()); // (y,point)
+        {
+            std::vector<uint64_t> row_current(row_begin.begin(),row_begin.end()-1);
+            for (uint64_t j = 0; j < number_points; ++j) {
+                if(cell_row[j] != UINT64_MAX){
+                    order[row_current[cell_row[j]]++] = {cell_y[j],j};
+                }
+            }
+        }
+
+        std::vector<MapIterator> level_iterators(level_max+1);
+
+        int64_t z_;
+#ifdef HAVE_OPENMP
+#pragma omp parallel for default(shared) schedule(dynamic) private(z_) firstprivate(level_iterators)
+#endif
+        for (z_ = 0; z_ < (int64_t)z_num_; ++z_) {
+            for (uint64_t x_ = 0; x_ < x_num_; ++x_) {
+                const uint64_t row = x_num_*z_ + x_;
+                const auto row_start = order.begin() + row_begin[row];
+                const auto row_end = order.begin() + row_begin[row+1];
+
+                std::sort(row_start,row_end);
+
+                //the particle cell found for the previous point of the row (the cells partition the domain, so the
+                //next point is in the same cell if it has the same y at that level)
+                uint16_t previous_level = 0;
+                uint64_t previous_y = UINT64_MAX;
+                uint64_t previous_global_index = UINT64_MAX;
+
+                for (auto point = row_start; point != row_end; ++point) {
+                    if((uint64_t)(point->first >> (level_max - previous_level)) == previous_y){
+                        global_index[point->second] = previous_global_index;
+                        continue;
+                    }
+
+                    ParticleCell particle_cell;
+                    particle_cell.x = x_;
+                    particle_cell.y = point->first;
+                    particle_cell.z = z_;
+                    particle_cell.level = level_max;
+                    particle_cell.pc_offset = row;
+
+                    //then check from the highest level to lowest
+                    bool found = find_particle_cell(particle_cell,level_iterators[particle_cell.level]);
+                    while(!found && (particle_cell.level > level_min)){
+                        particle_cell.y = particle_cell.y/2;
+                        particle_cell.x = particle_cell.x/2;
+                        particle_cell.z = particle_cell.z/2;
+                        particle_cell.level--;
+
+                        particle_cell.pc_offset = x_num[particle_cell.level]*particle_cell.z + particle_cell.x;
+                        found = find_particle_cell(particle_cell,level_iterators[particle_cell.level]);
+                    }
+
+                    global_index[point->second] = found ? particle_cell.global_index : UINT64_MAX;
+
+                    if(found){
+                        previous_level = particle_cell.level;
+                        previous_y = particle_cell.y;
+                        previous_global_index = particle_cell.global_index;
+                    }
+                }
+            }
+        }
+    }
+
+    template<typename S,typename U>
+    void sample_particles_by_global_coordinate(const std::vector<float>& x,const std::vector<float>& y,const std::vector<float>& z,const ExtraParticleData<S>& parts,std::vector<U>& values,const U out_of_bounds_value = 0){
+        //
+        //  Samples the particle data at each point (x[i],y[i],z[i]) (piecewise constant), using the batch search
+        //
+
+        std::vector<uint64_t> global_index;
+        find_particles_by_global_coordinate(x,y,z,global_index);
+
+        values.resize(global_index.size());
+
+        int64_t i;
+#ifdef HAVE_OPENMP
+#pragma omp parallel for default(shared) schedule(static) private(i)
+#endif
+        for (i = 0; i < (int64_t)global_index.size(); ++i) {
+            values[i] = (global_index[i] != UINT64_MAX) ? (U) parts.data[global_index[i]] : out_of_bounds_value;
+        }
+    }
+
     template<typename T>
-    void initialize_structure_from_particle_cell_tree(APR<T>& apr,std::vector<MeshData<uint8_t>>& layers){
+    void initialize_structure_from_particle_cell_tree(APR<T>& apr,std::vector<MeshData<uint8_t>>& layers,ArenaPartCellData<std::pair<uint16_t,YGap_map>>* gap_scratch = nullptr){
        x_num.resize(level_max+1);
        y_num.resize(level_max+1);
        z_num.resize(level_max+1);
@@ -340,17 +928,23 @@ public:
         z_num[level_max] = org_dims[2];
 
         //transfer over data-structure to make the same (re-use of function for read-write)
-        std::vector<ArrayWrapper<uint8_t>> p_map(level_max);
-        for (size_t k = 0; k < level_max; ++k) {
+        const size_t number_layers = level_max;
+        std::vector<ArrayWrapper<uint8_t>> p_map(number_layers);
+        for (size_t k = 0; k < number_layers; ++k) {
             p_map[k].swap(layers[k].mesh);
         }
 
-        initialize_structure_from_particle_cell_tree(apr, p_map);
+        initialize_structure_from_particle_cell_tree(apr, p_map, gap_scratch);
+
+        //hand the memory back (level_max may have changed), so the particle cell tree can be re-used
+        for (size_t k = 0; k < number_layers; ++k) {
+            p_map[k].swap(layers[k].mesh);
+        }
     }
 
 
     template<typename T>
-    void initialize_structure_from_particle_cell_tree(const APR<T> &apr, std::vector<ArrayWrapper<uint8_t>> &p_map) {
+    void initialize_structure_from_particle_cell_tree(const APR<T> &apr, std::vector<ArrayWrapper<uint8_t>> &p_map,ArenaPartCellData<std::pair<uint16_t,YGap_map>>* gap_scratch = nullptr) {
         //
         //  Initialize the new structure;
         //
@@ -387,8 +981,79 @@ public:
         }
         apr_timer.stop_timer();
 
+        //the gaps of each row are found in two passes, the first counts them so all the rows of a level can be
+        //allocated in one buffer, the second fills them in
+        apr_timer.start_timer("count gaps");
+        //(gap_scratch keeps the buffers across calls, e.g. for converting a time series)
+        ArenaPartCellData<std::pair<uint16_t, YGap_map>> y_begin_local;
+        ArenaPartCellData<std::pair<uint16_t, YGap_map>>& y_begin = (gap_scratch != nullptr) ? *gap_scratch : y_begin_local;
+        y_begin.initialize(apr.level_min(),apr.level_max(),x_num,z_num);
+
+        for(size_t i = (apr.level_min());i < apr.level_max();i++) {
+            const size_t x_num_ = x_num[i];
+            const size_t z_num_ = z_num[i];
+            const size_t y_num_ = y_num[i];
+
+            #ifdef HAVE_OPENMP
+	        #pragma omp parallel for default(shared) if(z_num_*x_num_ > 100)
+            #endif
+            for (size_t z = 0; z < z_num_; ++z) {
+                for (size_t x = 0; x < x_num_; ++x) {
+                    const size_t offset_part_map = x * y_num_ + z * y_num_ * x_num_;
+                    uint16_t previous = 0;
+                    uint64_t counter = 0;
+
+                    for (size_t y = 0; y < y_num_; ++y) {
+                        uint8_t status = p_map[i][offset_part_map + y];
+                        const uint16_t current = ((status > 1) && (status < 5));
+                        counter += (current > previous);
+                        previous = current;
+                    }
+                    y_begin.set_row_size(i,x_num_ * z + x,counter);
+                }
+            }
+        }
+
+        {
+            //the highest level rows are given by the seed particle cells on the level below
+            const size_t i = apr.level_max()-1;
+
+            const size_t x_num_ = x_num[i];
+            const size_t z_num_ = z_num[i];
+            const size_t y_num_ = y_num[i];
+            const size_t x_num_us = x_num[i + 1];
+            const size_t z_num_us = z_num[i + 1];
+
+            #ifdef HAVE_OPENMP
+            #pragma omp parallel for default(shared) if(z_num_*x_num_ > 100)
+            #endif
+            for (size_t z_ = 0; z_ < z_num_; ++z_) {
+                for (size_t x_ = 0; x_ < x_num_; x_++) {
+                    const size_t offset_part_map = x_ * y_num_ + z_ * y_num_ * x_num_;
+                    uint16_t previous = 0;
+                    uint64_t counter = 0;
+
+                    for (size_t y_ = 0; y_ < y_num_; ++y_) {
+                        const uint16_t current = (p_map[i][offset_part_map + y_] == SEED_TYPE);
+                        counter += (current > previous);
+                        previous = current;
+                    }
+
+                    for (size_t dz = 0; dz < 2; ++dz) {
+                        for (size_t dx = 0; dx < 2; ++dx) {
+                            if (((2*z_ + dz) < z_num_us) && ((2*x_ + dx) < x_num_us)) {
+                                y_begin.set_row_size(i+1,x_num_us*(2*z_ + dz) + (2*x_ + dx),counter);
+                            }
+                        }
+                    }
+                }
+            }
+        }
+
+        y_begin.allocate();
+        apr_timer.stop_timer();
+
         apr_timer.start_timer("second_step");
-        ExtraPartCellData<std::pair<uint16_t, YGap_map>> y_begin(apr);
         for(size_t i = (apr.level_min());i < apr.level_max();i++) {
             const size_t x_num_ = x_num[i];
             const size_t z_num_ = z_num[i];
@@ -401,11 +1066,9 @@ public:
                 for (size_t x = 0; x < x_num_; ++x) {
                     const size_t offset_part_map = x * y_num_ + z * y_num_ * x_num_;
                     const size_t offset_pc_data = x_num_ * z + x;
+                    std::pair<uint16_t, YGap_map>* row = y_begin.row(i,offset_pc_data);
                     uint16_t current = 0;
                     uint16_t previous = 0;
-
-                    YGap_map gap;
-                    gap.global_index_begin = 0;
                     uint64_t counter = 0;
 
                     for (size_t y = 0; y < y_num_; ++y) {
@@ -413,13 +1076,13 @@ public:
                         if ((status > 1) && (status < 5)) {
                             current = 1;
                             if (previous == 0) {
-                                y_begin.data[i][offset_pc_data].push_back({y,gap});
+                                row[counter].first = y; //y_end is set at the end of the gap, the global index in the forth loop
                             }
                         }
                         else {
                             current = 0;
                             if (previous == 1) {
-                                (y_begin.data[i][offset_pc_data][counter]).second.y_end = (y-1);
+                                row[counter].second.y_end = (y-1);
                                 counter++;
                             }
                         }
@@ -428,7 +1091,7 @@ public:
                     }
                     //end node
                     if (previous == 1) {
-                        (y_begin.data[i][offset_pc_data][counter]).second.y_end = (y_num_-1);
+                        row[counter].second.y_end = (y_num_-1);
                     }
                 }
             }
@@ -452,12 +1115,10 @@ public:
         for (size_t z_ = 0; z_ < z_num_; ++z_) {
             for (size_t x_ = 0; x_ < x_num_; x_++) {
                 const size_t offset_part_map = x_ * y_num_ + z_ * y_num_ * x_num_;
-                const size_t offset_pc_data1 = std::min(x_num_us*(2*z_) + (2*x_), x_num_us*z_num_us - 1);
+                const size_t offset_pc_data1 = x_num_us*(2*z_) + (2*x_);
+                std::pair<uint16_t, YGap_map>* row = y_begin.row(i+1,offset_pc_data1);
                 uint16_t current = 0;
                 uint16_t previous = 0;
-
-                YGap_map gap;
-                gap.global_index_begin = 0;
                 uint64_t counter = 0;
 
                 for (size_t y_ = 0; y_ < y_num_; ++y_) {
@@ -465,13 +1126,13 @@ public:
                     if (status == SEED_TYPE) {
                         current = 1;
                         if (previous == 0) {
-                            y_begin.data[i+1][offset_pc_data1].push_back({2*y_,gap});
+                            row[counter].first = 2*y_;
                         }
                     }
                     else {
                         current = 0;
                         if (previous == 1) {
-                            y_begin.data[i+1][offset_pc_data1][counter].second.y_end = std::min((uint16_t)(2*(y_-1)+1),(uint16_t)(y_num_us-1));
+                            row[counter].second.y_end = std::min((uint16_t)(2*(y_-1)+1),(uint16_t)(y_num_us-1));
                             counter++;
                         }
                     }
@@ -480,89 +1141,85 @@ public:
                 }
                 //last gap
                 if (previous == 1) {
-                    y_begin.data[i+1][offset_pc_data1][counter].second.y_end = (y_num_us-1);
+                    row[counter].second.y_end = (y_num_us-1);
                 }
-            }
-        }
-
-        #ifdef HAVE_OPENMP
-        #pragma omp parallel for default(shared)  if(z_num_*x_num_ > 100)
-        #endif
-        for (size_t z_ = 0; z_ < z_num_; ++z_) {
-            for (size_t x_ = 0; x_ < x_num_; ++x_) {
-                const size_t offset_pc_data1 = std::min(x_num_us*(2*z_) + (2*x_), x_num_us*z_num_us - 1);
-                const size_t offset_pc_data2 = std::min(x_num_us*(2*z_) + (2*x_+1), x_num_us*z_num_us - 1);
-                const size_t offset_pc_data3 = std::min(x_num_us*(2*z_+1) + (2*x_), x_num_us*z_num_us - 1);
-                const size_t offset_pc_data4 = std::min(x_num_us*(2*z_+1) + (2*x_+1), x_num_us*z_num_us - 1);
 
-                size_t size_v = y_begin.data[i+1][offset_pc_data1].size();
-
-                y_begin.data[i+1][offset_pc_data2].resize(size_v);
-                std::copy(y_begin.data[i+1][offset_pc_data1].begin(),y_begin.data[i+1][offset_pc_data1].end(),y_begin.data[i+1][offset_pc_data2].begin());
-
-                y_begin.data[i+1][offset_pc_data3].resize(size_v);
-                std::copy(y_begin.data[i+1][offset_pc_data1].begin(),y_begin.data[i+1][offset_pc_data1].end(),y_begin.data[i+1][offset_pc_data3].begin());
-
-                y_begin.data[i+1][offset_pc_data4].resize(size_v);
-                std::copy(y_begin.data[i+1][offset_pc_data1].begin(),y_begin.data[i+1][offset_pc_data1].end(),y_begin.data[i+1][offset_pc_data4].begin());
+                //the other three child rows (if they are inside the domain) are the same
+                const size_t number_gaps = y_begin.row_size(i+1,offset_pc_data1);
+                for (size_t dz = 0; dz < 2; ++dz) {
+                    for (size_t dx = (1 - dz); dx < 2; ++dx) {
+                        if (((2*z_ + dz) < z_num_us) && ((2*x_ + dx) < x_num_us)) {
+                            std::copy(row,row + number_gaps,y_begin.row(i+1,x_num_us*(2*z_ + dz) + (2*x_ + dx)));
+                        }
+                    }
+                }
             }
         }
         apr_timer.stop_timer();
 
-        apr_timer.start_timer("forth loop");
-        //iteration helpers for by level
-        global_index_by_level_begin.resize(apr.level_max()+1,1);
-        global_index_by_level_end.resize(apr.level_max()+1,0);
+        //iteration helpers and global indices of the gaps, computed as a parallel two-pass prefix sum (count the
+        //particles of each z slice, scan the counts, then fill in the global index of each gap from the slice begin)
+        apr_timer.start_timer("forth loop (count)");
 
-        size_t cumsum= 0;
-        total_number_gaps=0;
+        std::vector<std::vector<uint64_t>> z_number_particles(apr.level_max()+1);
+        uint64_t number_gaps = 0;
 
         size_t min_level_find = apr.level_max();
         size_t max_level_find = apr.level_min();
 
-        //set up the iteration helpers for by zslice
-        global_index_by_level_and_z_begin.resize(apr.level_max()+1);
-        global_index_by_level_and_z_end.resize(apr.level_max()+1);
-
         for (size_t i = apr.level_min(); i <= apr.level_max(); ++i) {
-
             const size_t x_num_ = x_num[i];
-            const size_t z_num_ = z_num[i];
+            const int64_t z_num_ = z_num[i];
 
-            //set up the levels here.
-            uint64_t cumsum_begin = cumsum;
+            z_number_particles[i].resize(z_num_,0);
 
-            global_index_by_level_and_z_begin[i].resize(z_num_, (-1)); // TODO: -1 sets it to max UINT64, is it correct?
-            global_index_by_level_and_z_end[i].resize(z_num_, 0);
+            int64_t z_;
+            #ifdef HAVE_OPENMP
+            #pragma omp parallel for default(shared) schedule(dynamic) private(z_) reduction(+:number_gaps) if(z_num_*x_num_ > 100)
+            #endif
+            for (z_ = 0; z_ < z_num_; z_++) {
+                //the gaps of the z slice are contiguous in the buffer of the level
+                uint64_t counter = 0;
+                const uint64_t gap_end = y_begin.row_begin[i][x_num_ * (z_ + 1)];
+                for (uint64_t j = y_begin.row_begin[i][x_num_ * z_]; j < gap_end; ++j) {
+                    counter += (y_begin.data[i][j].second.y_end - y_begin.data[i][j].first) + 1;
+                    number_gaps++;
+                }
+                z_number_particles[i][z_] = counter;
+            }
 
-            for (size_t z_ = 0; z_ < z_num_; z_++) {
-                size_t cumsum_begin_z = cumsum;
-                for (size_t x_ = 0; x_ < x_num_; x_++) {
-                    const size_t offset_pc_data = x_num_ * z_ + x_;
-                    for (size_t j = 0; j < y_begin.data[i][offset_pc_data].size(); ++j) {
+            if (std::any_of(z_number_particles[i].begin(),z_number_particles[i].end(),[](const uint64_t n){ return n > 0; })) {
+                min_level_find = std::min(i,min_level_find);
+                max_level_find = std::max(i,max_level_find);
+            }
+        }
+        total_number_gaps = number_gaps;
+        apr_timer.stop_timer();
 
-                        min_level_find = std::min(i,min_level_find);
-                        max_level_find = std::max(i,max_level_find);
+        apr_timer.start_timer("forth loop (scan)");
+        initialize_iteration_helpers(apr.level_min(),apr.level_max(),z_number_particles);
+        apr_timer.stop_timer();
+
+        apr_timer.start_timer("forth loop (fill)");
+        for (size_t i = apr.level_min(); i <= apr.level_max(); ++i) {
+            const size_t x_num_ = x_num[i];
+            const int64_t z_num_ = z_num[i];
 
-                        y_begin.data[i][offset_pc_data][j].second.global_index_begin = cumsum;
-                        cumsum+=(y_begin.data[i][offset_pc_data][j].second.y_end-y_begin.data[i][offset_pc_data][j].first)+1;
-                        total_number_gaps++;
+            int64_t z_;
+            #ifdef HAVE_OPENMP
+            #pragma omp parallel for default(shared) schedule(dynamic) private(z_) if(z_num_*x_num_ > 100)
+            #endif
+            for (z_ = 0; z_ < z_num_; z_++) {
+                if (z_number_particles[i][z_] > 0) {
+                    uint64_t cumsum = global_index_by_level_and_z_begin[i][z_];
+                    const uint64_t gap_end = y_begin.row_begin[i][x_num_ * (z_ + 1)];
+                    for (uint64_t j = y_begin.row_begin[i][x_num_ * z_]; j < gap_end; ++j) {
+                        y_begin.data[i][j].second.global_index_begin = cumsum;
+                        cumsum += (y_begin.data[i][j].second.y_end - y_begin.data[i][j].first) + 1;
                     }
                 }
-                if (cumsum!=cumsum_begin_z) {
-                    global_index_by_level_and_z_end[i][z_] = cumsum - 1;
-                    global_index_by_level_and_z_begin[i][z_] = cumsum_begin_z;
-                }
-            }
-
-            if (cumsum != cumsum_begin) {
-                global_index_by_level_begin[i] = cumsum_begin;
-            }
-            if(cumsum != cumsum_begin){
-                global_index_by_level_end[i] = cumsum-1;
             }
         }
-        total_number_particles = cumsum;
         apr_timer.stop_timer();
 
         //set minimum level now to the first non-empty level.
@@ -571,6 +1228,8 @@ public:
         total_number_non_empty_rows=0;
 
         allocate_map_insert(apr,y_begin);
+        initialize_row_index();
+
         APRIterator<T> apr_iterator(*this);
 
         particle_cell_type.data.resize(global_index_by_level_end[level_max-1]+1,0);
@@ -588,33 +1247,53 @@ public:
     }
 
     template<typename T>
-    void allocate_map_insert(const APR<T> &apr, ExtraPartCellData<std::pair<uint16_t,YGap_map>>& y_begin) {
+    void allocate_map_insert(const APR<T> &apr, ArenaPartCellData<std::pair<uint16_t,YGap_map>>& y_begin) {
         //
         //  Seperated for checking memory allocation
         //
 
+        if(use_flat_map){
+            allocate_flat_map_insert(y_begin);
+            return;
+        }
+
         APRTimer apr_timer;
         apr_timer.start_timer("initialize map");
 
-        gap_map.initialize_structure_parts_empty(apr);
+        gap_map.initialize(apr.level_min(),apr.level_max(),x_num,z_num);
         uint64_t counter_rows = 0;
         uint64_t z_,x_;
 
+        //one map for each non-empty row
         for (uint64_t i = (apr.level_min()); i <= apr.level_max(); i++) {
             const unsigned int x_num_ = x_num[i];
             const unsigned int z_num_ = z_num[i];
 #ifdef HAVE_OPENMP
-#pragma omp parallel for default(shared) private(z_, x_) reduction(+:counter_rows)if(z_num_*x_num_ > 100)
+#pragma omp parallel for default(shared) private(z_, x_) if(z_num_*x_num_ > 100)
 #endif
             for (z_ = 0; z_ < z_num_; z_++) {
                 for (x_ = 0; x_ < x_num_; x_++) {
                     const size_t offset_pc_data = x_num_ * z_ + x_;
-                    if (y_begin.data[i][offset_pc_data].size() > 0) {
-                        gap_map.data[i][offset_pc_data].resize(1);
+                    gap_map.set_row_size(i,offset_pc_data,(y_begin.row_size(i,offset_pc_data) > 0));
+                }
+            }
+        }
 
+        gap_map.allocate();
 
-                        gap_map.data[i][offset_pc_data][0].map.insert(y_begin.data[i][offset_pc_data].begin(),
-                                                                      y_begin.data[i][offset_pc_data].end());
+        for (uint64_t i = (apr.level_min()); i <= apr.level_max(); i++) {
+            const unsigned int x_num_ = x_num[i];
+            const unsigned int z_num_ = z_num[i];
+#ifdef HAVE_OPENMP
+#pragma omp parallel for default(shared) private(z_, x_) reduction(+:counter_rows)if(z_num_*x_num_ > 100)
+#endif
+            for (z_ = 0; z_ < z_num_; z_++) {
+                for (x_ = 0; x_ < x_num_; x_++) {
+                    const size_t offset_pc_data = x_num_ * z_ + x_;
+                    const uint64_t number_gaps = y_begin.row_size(i,offset_pc_data);
+                    if (number_gaps > 0) {
+                        const std::pair<uint16_t,YGap_map>* row = y_begin.row(i,offset_pc_data);
+                        gap_map.row(i,offset_pc_data)[0].map.insert(row,row + number_gaps);
 
                         counter_rows++;
                     }
@@ -625,24 +1304,85 @@ public:
         apr_timer.stop_timer();
     }
 
+    void allocate_flat_map_insert(ArenaPartCellData<std::pair<uint16_t,YGap_map>>& y_begin) {
+        //
+        //  Fills the flat access structure from the per row gaps computed in initialize_structure_from_particle_cell_tree,
+        //  the rows of each level are already contiguous so only the level offsets have to be added
+        //
+
+        APRTimer apr_timer;
+        apr_timer.verbose_flag = false;
+        apr_timer.start_timer("initialize flat map");
+
+        gap_map.clear();
+        flat_map.row_gap_begin.clear();
+        flat_map.row_gap_begin.resize(level_max+1);
+
+        uint64_t counter_rows = 0;
+        uint64_t gap_counter = 0;
+
+        for (uint64_t i = level_min; i <= level_max; i++) {
+            const uint64_t number_rows = x_num[i]*z_num[i];
+            const std::vector<uint64_t>& y_begin_row_begin = y_begin.row_begin[i];
+            std::vector<uint64_t>& row_gap_begin = flat_map.row_gap_begin[i];
+            row_gap_begin.resize(number_rows+1);
+
+            for (uint64_t offset = 0; offset <= number_rows; ++offset) {
+                row_gap_begin[offset] = gap_counter + y_begin_row_begin[offset];
+            }
+            for (uint64_t offset = 0; offset < number_rows; ++offset) {
+                counter_rows += (y_begin_row_begin[offset+1] > y_begin_row_begin[offset]);
+            }
+
+            gap_counter += y_begin_row_begin.back();
+        }
+
+        flat_map.y_begin.resize(gap_counter);
+        flat_map.y_end.resize(gap_counter);
+        flat_map.global_index_begin.resize(gap_counter);
+
+        for (uint64_t i = level_min; i <= level_max; i++) {
+            const int64_t number_gaps = y_begin.data[i].size();
+            const uint64_t level_begin = flat_map.row_gap_begin[i][0];
+            int64_t j;
+#ifdef HAVE_OPENMP
+#pragma omp parallel for default(shared) schedule(static) private(j) if(number_gaps > 1000)
+#endif
+            for (j = 0; j < number_gaps; ++j) {
+                const std::pair<uint16_t,YGap_map>& element = y_begin.data[i][j];
+                flat_map.y_begin[level_begin + j] = element.first;
+                flat_map.y_end[level_begin + j] = element.second.y_end;
+                flat_map.global_index_begin[level_begin + j] = element.second.global_index_begin;
+            }
+        }
+
+        total_number_non_empty_rows = counter_rows;
+        apr_timer.stop_timer();
+    }
+
     template<typename T>
     void allocate_map(APR<T>& apr,MapStorageData& map_data,std::vector<uint64_t>& cumsum){
+        allocate_map(map_data,cumsum);
+    }
 
-        //first add the layers
-        gap_map.depth_max = level_max;
-        gap_map.depth_min = level_min;
+    void allocate_map(MapStorageData& map_data,std::vector<uint64_t>& cumsum){
 
-        gap_map.z_num.resize(gap_map.depth_max+1);
-        gap_map.x_num.resize(gap_map.depth_max+1);
-        gap_map.data.resize(gap_map.depth_max+1);
+        flat_map = FlatGapMap();
 
-        for(uint64_t i = gap_map.depth_min;i <= gap_map.depth_max;i++){
-            gap_map.z_num[i] = z_num[i];
-            gap_map.x_num[i] = x_num[i];
-            gap_map.data[i].resize(z_num[i]*x_num[i]);
-        }
+        //first add the layers, with one map for each non-empty row
+        gap_map.initialize(level_min,level_max,x_num,z_num);
 
         uint64_t j;
+#ifdef HAVE_OPENMP
+        #pragma omp parallel for default(shared) schedule(static) private(j)
+#endif
+        for (j = 0; j < total_number_non_empty_rows; ++j) {
+            const uint64_t level = map_data.level[j];
+            gap_map.set_row_size(level,x_num[level]* map_data.z[j] + map_data.x[j],1);
+        }
+
+        gap_map.allocate();
+
 #ifdef HAVE_OPENMP
         #pragma omp parallel for default(shared) schedule(static) private(j)
 #endif
@@ -655,28 +1395,186 @@ public:
 
             YGap_map gap;
 
-            gap_map.data[level][offset_pc_data].resize(1);
+            ParticleCellGapMap& row_map = gap_map.row(level,offset_pc_data)[0];
 
             for (uint64_t i = global_begin; i < (global_begin + number_gaps) ; ++i) {
                 gap.y_end = map_data.y_end[i];
                 gap.global_index_begin = map_data.global_index[i];
 
-                auto hint = gap_map.data[level][offset_pc_data][0].map.end();
-                gap_map.data[level][offset_pc_data][0].map.insert(hint,{map_data.y_begin[i],gap});
+                auto hint = row_map.map.end();
+                row_map.map.insert(hint,{map_data.y_begin[i],gap});
             }
         }
     }
 
+    void allocate_flat_map(MapStorageData& map_data){
+        //
+        //  Builds the flat access structure from the flattened storage, the rows are stored in level -> z -> x order
+        //  so the gap arrays are moved over as they are (map_data is left without them), only the row offsets have to be computed.
+        //
+
+        gap_map.clear();
+        flat_map.row_gap_begin.clear();
+        flat_map.row_gap_begin.resize(level_max+1);
+
+        for(uint64_t i = level_min;i <= level_max;i++){
+            flat_map.row_gap_begin[i].resize(x_num[i]*z_num[i]+1,0);
+        }
+
+        uint64_t j;
+#ifdef HAVE_OPENMP
+        #pragma omp parallel for default(shared) schedule(static) private(j)
+#endif
+        for (j = 0; j < total_number_non_empty_rows; ++j) {
+            const uint64_t level = map_data.level[j];
+            const uint64_t offset_pc_data =  x_num[level]* map_data.z[j] + map_data.x[j];
+            flat_map.row_gap_begin[level][offset_pc_data+1] = map_data.number_gaps[j];
+        }
+
+        uint64_t gap_counter = 0;
+        for(uint64_t i = level_min;i <= level_max;i++){
+            std::vector<uint64_t>& row_gap_begin = flat_map.row_gap_begin[i];
+            row_gap_begin[0] = gap_counter;
+            std::partial_sum(row_gap_begin.begin(),row_gap_begin.end(),row_gap_begin.begin());
+            gap_counter = row_gap_begin.back();
+        }
+
+        flat_map.y_begin.swap(map_data.y_begin);
+        flat_map.y_end.swap(map_data.y_end);
+        flat_map.global_index_begin.swap(map_data.global_index);
+    }
+
+    void initialize_iteration_helpers(const uint64_t level_begin,const uint64_t level_end,const std::vector<std::vector<uint64_t>>& z_number_particles){
+        //
+        //  Exclusive scan over the number of particles in each z slice (in level -> z order), sets the by level and
+        //  by z slice iteration helpers and the total number of particles. Empty levels have begin > end.
+        //
+
+        global_index_by_level_begin.assign(level_end+1,1);
+        global_index_by_level_end.assign(level_end+1,0);
+
+        global_index_by_level_and_z_begin.resize(level_end+1);
+        global_index_by_level_and_z_end.resize(level_end+1);
+
+        uint64_t cumsum = 0;
+
+        for (uint64_t i = level_begin; i <= level_end; ++i) {
+            const uint64_t z_num_ = z_num[i];
+            const uint64_t cumsum_begin = cumsum;
+
+            global_index_by_level_and_z_begin[i].assign(z_num_,(-1));
+            global_index_by_level_and_z_end[i].assign(z_num_,0);
+
+            for (uint64_t z_ = 0; z_ < z_num_; ++z_) {
+                if (z_number_particles[i][z_] > 0) {
+                    global_index_by_level_and_z_begin[i][z_] = cumsum;
+                    cumsum += z_number_particles[i][z_];
+                    global_index_by_level_and_z_end[i][z_] = cumsum - 1;
+                }
+            }
+
+            if (cumsum != cumsum_begin) {
+                global_index_by_level_begin[i] = cumsum_begin;
+                global_index_by_level_end[i] = cumsum - 1;
+            }
+        }
+
+        total_number_particles = cumsum;
+    }
+
+    void initialize_iteration_helpers_flat(){
+        //
+        //  With the flat structure the global indices of the gaps are already known, so the iteration helpers are
+        //  just read off the first and last gap of each z slice (in parallel), no cumulative sum is required.
+        //
+
+        global_index_by_level_begin.assign(level_max+1,1);
+        global_index_by_level_end.assign(level_max+1,0);
+
+        global_index_by_level_and_z_begin.resize(level_max+1);
+        global_index_by_level_and_z_end.resize(level_max+1);
+
+        for(uint64_t i = level_min;i <= level_max;i++) {
+            const uint64_t x_num_ = x_num[i];
+            const int64_t z_num_ = z_num[i];
+            const std::vector<uint64_t>& row_gap_begin = flat_map.row_gap_begin[i];
+
+            global_index_by_level_and_z_begin[i].assign(z_num_,(-1));
+            global_index_by_level_and_z_end[i].assign(z_num_,0);
+
+            int64_t z_;
+#ifdef HAVE_OPENMP
+#pragma omp parallel for default(shared) schedule(static) private(z_) if(z_num_ > 100)
+#endif
+            for (z_ = 0; z_ < z_num_; z_++) {
+                const uint64_t gap_begin = row_gap_begin[x_num_*z_];
+                const uint64_t gap_end = row_gap_begin[x_num_*(z_+1)];
+                if(gap_end > gap_begin) {
+                    global_index_by_level_and_z_begin[i][z_] = flat_map.global_index_begin[gap_begin];
+                    global_index_by_level_and_z_end[i][z_] = flat_map.global_index_begin[gap_end-1] + (flat_map.y_end[gap_end-1] - flat_map.y_begin[gap_end-1]);
+                }
+            }
+
+            const uint64_t gap_begin = row_gap_begin.front();
+            const uint64_t gap_end = row_gap_begin.back();
+            if(gap_end > gap_begin){
+                global_index_by_level_begin[i] = flat_map.global_index_begin[gap_begin];
+                global_index_by_level_end[i] = flat_map.global_index_begin[gap_end-1] + (flat_map.y_end[gap_end-1] - flat_map.y_begin[gap_end-1]);
+            }
+        }
+    }
+
+    void set_flat_map(bool flat){
+        //
+        //  Converts an initialized access structure to the flat (true) or std::map (false) version
+        //
+
+        if(flat == use_flat_map){
+            return;
+        }
+
+        MapStorageData map_data;
+        flatten_structure(map_data);
+
+        use_flat_map = flat;
+
+        if(use_flat_map){
+            allocate_flat_map(map_data);
+        } else {
+            std::vector<uint64_t> cumsum(total_number_non_empty_rows);
+            uint64_t counter = 0;
+            for (uint64_t j = 0; j < total_number_non_empty_rows; ++j) {
+                cumsum[j] = counter;
+                counter += map_data.number_gaps[j];
+            }
+            allocate_map(map_data,cumsum);
+        }
+    }
+
     template<typename T>
     void rebuild_map(APR<T>& apr,MapStorageData& map_data){
+        rebuild_map(map_data);
+    }
+
+    void rebuild_map(MapStorageData& map_data){
 
-        uint64_t z_;
-        uint64_t x_;
         APRTimer apr_timer;
         apr_timer.verbose_flag = false;
-        apr_timer.start_timer("rebuild map");
 
+        if(use_flat_map){
+            //zero-rebuild, the flattened arrays are used directly as the access structure
+            apr_timer.start_timer("allocate flat map");
+            allocate_flat_map(map_data);
+            apr_timer.stop_timer();
+
+            apr_timer.start_timer("iteration helpers");
+            initialize_iteration_helpers_flat();
+            initialize_row_index();
+            apr_timer.stop_timer();
+            return;
+        }
 
+        apr_timer.start_timer("rebuild map");
 
         std::vector<uint64_t> cumsum;
         cumsum.reserve(total_number_non_empty_rows);
@@ -689,69 +1587,115 @@ public:
             counter+=(map_data.number_gaps[j]);
         }
 
-        allocate_map(apr,map_data,cumsum);
+        allocate_map(map_data,cumsum);
+
+        apr_timer.stop_timer();
 
-        apr_timer.start_timer("forth loop");
         //////////////////
         ///
-        /// Recalculate the iteration helpers
+        /// Recalculate the iteration helpers (particles per z slice in parallel, then a scan)
         ///
         //////////////////////
 
-        //iteration helpers for by level
-        global_index_by_level_begin.resize(level_max+1,0);
-        global_index_by_level_end.resize(level_max+1,0);
-
-        uint64_t cumsum_parts= 0;
+        apr_timer.start_timer("forth loop (count)");
 
-        //set up the iteration helpers for by zslice
-        global_index_by_level_and_z_begin.resize(level_max+1);
-        global_index_by_level_and_z_end.resize(level_max+1);
+        std::vector<std::vector<uint64_t>> z_number_particles(level_max+1);
 
         for(uint64_t i = level_min;i <= level_max;i++) {
+            const uint64_t x_num_ = x_num[i];
+            const int64_t z_num_ = z_num[i];
 
-            const unsigned int x_num_ = x_num[i];
-            const unsigned int z_num_ = z_num[i];
-
-            //set up the levels here.
-            uint64_t cumsum_begin = cumsum_parts;
-
-            global_index_by_level_and_z_begin[i].resize(z_num_,(-1));
-            global_index_by_level_and_z_end[i].resize(z_num_,0);
+            z_number_particles[i].resize(z_num_,0);
 
+            int64_t z_;
+#ifdef HAVE_OPENMP
+#pragma omp parallel for default(shared) schedule(dynamic) private(z_) if(z_num_*x_num_ > 100)
+#endif
             for (z_ = 0; z_ < z_num_; z_++) {
-                uint64_t cumsum_begin_z = cumsum_parts;
-
-                for (x_ = 0; x_ < x_num_; x_++) {
-                    const size_t offset_pc_data = x_num_ * z_ + x_;
-                    if(gap_map.data[i][offset_pc_data].size() > 0) {
-                        for (auto const &element : gap_map.data[i][offset_pc_data][0].map) {
+                uint64_t counter = 0;
+                MapIterator it;
+                for (uint64_t x_ = 0; x_ < x_num_; x_++) {
+                    const uint64_t offset_pc_data = x_num_ * z_ + x_;
+                    if(!row_empty(i,offset_pc_data)) {
+                        set_row_begin(it,i,offset_pc_data);
+                        do {
                             //count the number of particles in each gap
-                            cumsum_parts += (element.second.y_end - element.first) + 1;
-                        }
+                            counter += (gap_y_end(it) - gap_y_begin(it)) + 1;
+                        } while(next_gap(it));
                     }
                 }
-                if(cumsum_parts!=cumsum_begin_z) {
-                    global_index_by_level_and_z_end[i][z_] = cumsum_parts - 1;
-                    global_index_by_level_and_z_begin[i][z_] = cumsum_begin_z;
-                }
+                z_number_particles[i][z_] = counter;
             }
+        }
+        apr_timer.stop_timer();
 
-            if(cumsum_parts!=cumsum_begin){
-                //cumsum_begin++;
-                global_index_by_level_begin[i] = cumsum_begin;
+        apr_timer.start_timer("forth loop (scan)");
+        initialize_iteration_helpers(level_min,level_max,z_number_particles);
+        apr_timer.stop_timer();
+
+        initialize_row_index();
+    }
+
+    void initialize_row_index(){
+        //
+        //  Builds the per level index over the non-empty rows used by find_row_by_particle_number
+        //
+
+        row_index_pc_offset.clear();
+        row_index_global_begin.clear();
+        row_index_pc_offset.resize(level_max+1);
+        row_index_global_begin.resize(level_max+1);
+
+        for(uint64_t i = level_min;i <= level_max;i++) {
+            const uint64_t x_num_ = x_num[i];
+            const int64_t z_num_ = z_num[i];
+
+            //count the non-empty rows in each z slice
+            std::vector<uint64_t> rows_z_begin(z_num_+1,0);
+            int64_t z_;
+
+#ifdef HAVE_OPENMP
+#pragma omp parallel for default(shared) schedule(static) private(z_) if(z_num_*x_num_ > 100)
+#endif
+            for (z_ = 0; z_ < z_num_; z_++) {
+                uint64_t counter = 0;
+                for (uint64_t x_ = 0; x_ < x_num_; x_++) {
+                    counter += !row_empty(i,x_num_*z_ + x_);
+                }
+                rows_z_begin[z_+1] = counter;
             }
 
-            if(cumsum_parts!=cumsum_begin){
-                global_index_by_level_end[i] = cumsum_parts-1;
+            std::partial_sum(rows_z_begin.begin(),rows_z_begin.end(),rows_z_begin.begin());
+
+            row_index_pc_offset[i].resize(rows_z_begin.back());
+            row_index_global_begin[i].resize(rows_z_begin.back());
+
+#ifdef HAVE_OPENMP
+#pragma omp parallel for default(shared) schedule(static) private(z_) if(z_num_*x_num_ > 100)
+#endif
+            for (z_ = 0; z_ < z_num_; z_++) {
+                uint64_t row = rows_z_begin[z_];
+                MapIterator it;
+                for (uint64_t x_ = 0; x_ < x_num_; x_++) {
+                    const uint64_t offset_pc_data = x_num_*z_ + x_;
+                    if(!row_empty(i,offset_pc_data)){
+                        set_row_begin(it,i,offset_pc_data);
+                        row_index_pc_offset[i][row] = offset_pc_data;
+                        row_index_global_begin[i][row] = gap_global_index_begin(it);
+                        row++;
+                    }
+                }
             }
         }
-        apr_timer.stop_timer();
     }
 
 
     template<typename T>
     void flatten_structure(const APR<T> &apr, MapStorageData &map_data)  {
+        flatten_structure(map_data);
+    }
+
+    void flatten_structure(MapStorageData &map_data)  {
         //
         //  Flatten the map access structure for writing the output
         //
@@ -769,7 +1713,7 @@ public:
         uint64_t z_;
         uint64_t x_;
 
-        for(uint64_t i = (apr.level_min());i <= apr.level_max();i++) {
+        for(uint64_t i = level_min;i <= level_max;i++) {
 
             const unsigned int x_num_ = x_num[i];
             const unsigned int z_num_ = z_num[i];
@@ -777,17 +1721,19 @@ public:
             for (z_ = 0; z_ < z_num_; z_++) {
                 for (x_ = 0; x_ < x_num_; x_++) {
                     const uint64_t offset_pc_data = x_num_ * z_ + x_;
-                    if(gap_map.data[i][offset_pc_data].size()>0) {
+                    if(!row_empty(i,offset_pc_data)) {
                         map_data.x.push_back(x_);
                         map_data.z.push_back(z_);
                         map_data.level.push_back(i);
-                        map_data.number_gaps.push_back(gap_map.data[i][offset_pc_data][0].map.size());
-
-                        for (auto const &element : gap_map.data[i][offset_pc_data][0].map) {
-                            map_data.y_begin.push_back(element.first);
-                            map_data.y_end.push_back(element.second.y_end);
-                            map_data.global_index.push_back(element.second.global_index_begin);
-                        }
+                        map_data.number_gaps.push_back(row_number_gaps(i,offset_pc_data));
+
+                        MapIterator it;
+                        set_row_begin(it,i,offset_pc_data);
+                        do {
+                            map_data.y_begin.push_back(gap_y_begin(it));
+                            map_data.y_end.push_back(gap_y_end(it));
+                            map_data.global_index.push_back(gap_global_index_begin(it));
+                        } while(next_gap(it));
                     }
 
                 }
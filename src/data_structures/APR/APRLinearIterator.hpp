@@ -0,0 +1,380 @@
+//
+// Read-only particle iterator without neighbour access
+//
+
+#ifndef PARTPLAY_APR_LINEAR_ITERATOR_HPP
+#define PARTPLAY_APR_LINEAR_ITERATOR_HPP
+
+#include "APRAccess.hpp"
+
+template<typename V> class APR;
+
+class APRLinearIterator {
+    //
+    //  Iterates the particles in their global index order (linear sweeps, row runs and random access by particle
+    //  number), it only holds a pointer to the access structure and its position, so it owns no heap memory and is
+    //  cheap to copy (e.g. firstprivate in OpenMP loops). Neighbour access is provided by APRIterator, which extends
+    //  it with the neighbour search state.
+    //
+
+protected:
+
+    ParticleCell current_particle_cell{0, 0, 0, 0, 0, UINT64_MAX, UINT64_MAX };
+
+    APRAccess* apr_access;
+
+    MapIterator current_gap;
+
+public:
+
+    explicit APRLinearIterator(APRAccess& apr_access_){
+        apr_access = &apr_access_;
+        current_particle_cell.global_index = UINT64_MAX;
+    }
+
+    template<typename T>
+    explicit APRLinearIterator(APR<T>& apr){
+        apr_access = &apr.apr_access;
+        current_particle_cell.global_index = UINT64_MAX;
+    }
+
+    uint64_t total_number_particles(){
+        return (apr_access)->total_number_particles;
+    }
+
+    bool set_iterator_to_particle_by_number(const uint64_t particle_number){
+        //
+        //  Moves the iterator to point to the particle number (global index of the particle)
+        //
+
+        if(particle_number==0){
+            current_particle_cell.level = level_min();
+            current_particle_cell.pc_offset=0;
+
+            if(move_iterator_to_next_non_empty_row(level_max())){
+                //found and set
+                return true;
+            } else{
+                return false; //no particle cells, something is wrong
+            }
+        } else if (particle_number < apr_access->total_number_particles) {
+
+            //iterating just move to next
+            if(particle_number == (current_particle_cell.global_index+1)){
+                return move_to_next_particle_cell();
+            }
+
+            current_particle_cell.level = level_min();
+            //otherwise now we have to figure out where to look for the next particle cell;
+
+            //first find the level
+            while((current_particle_cell.level <= level_max()) && (particle_number > apr_access->global_index_by_level_end[current_particle_cell.level])  ){
+                current_particle_cell.level++;
+            }
+
+            //then find the offset (zx row)
+            current_particle_cell.pc_offset = apr_access->find_row_by_particle_number(current_particle_cell.level,particle_number);
+
+            //back out your xz from the offset
+            current_particle_cell.z = (current_particle_cell.pc_offset)/spatial_index_x_max(current_particle_cell.level);
+            current_particle_cell.x = (current_particle_cell.pc_offset) - current_particle_cell.z*(spatial_index_x_max(current_particle_cell.level));
+
+            apr_access->set_row_begin(current_gap,current_particle_cell.level,current_particle_cell.pc_offset);
+            //then find the gap.
+            apr_access->find_gap_by_particle_number(current_gap,particle_number);
+
+            current_particle_cell.y = apr_access->gap_y_begin(current_gap) + (particle_number - apr_access->gap_global_index_begin(current_gap));
+            current_particle_cell.global_index = particle_number;
+            return true;
+
+        } else {
+            current_particle_cell.global_index = -1;
+            return false; // requested particle number exceeds the number of particles
+        }
+
+    }
+
+    inline uint64_t particles_level_begin(const uint16_t& level_){
+        //
+        //  Used for finding the starting particle on a given level
+        //
+        return apr_access->global_index_by_level_begin[level_];
+    }
+
+    inline uint64_t particles_level_end(const uint16_t& level_){
+        //
+        //  Find the last particle on a given level
+        //
+        return (apr_access->global_index_by_level_end[level_]+1l);
+    }
+
+    inline uint64_t particles_z_begin(const uint16_t& level_,const uint64_t& z_){
+        //
+        //  Used for finding the starting particle on a given level
+        //
+        return apr_access->global_index_by_level_and_z_begin[level_][z_];
+    }
+
+    inline uint64_t particles_z_end(const uint16_t& level_,const uint64_t& z_){
+        //
+        //  Used for finding the starting particle on a given level
+        //
+        return apr_access->global_index_by_level_and_z_end[level_][z_]+1l;
+    }
+
+    inline uint64_t particles_zx_begin(const uint16_t& level_,const uint64_t& z_,const uint64_t& x_){
+        //
+        //  Used for finding the starting particle on a given level
+        //
+
+        return apr_access->get_parts_start(x_,z_,level_);
+    }
+
+    inline uint64_t particles_zx_end(const uint16_t& level_,const uint64_t& z_,const uint64_t& x_){
+        //
+        //  Used for finding the starting particle on a given level
+        //
+
+        return apr_access->get_parts_end(x_,z_,level_)+1l;
+    }
+
+    inline uint64_t particles_offset_end(const uint16_t& level,const uint64_t& offset){
+        //
+        //  Used for finding the starting particle on a given level
+        //
+
+        return apr_access->row_global_index_end(level,offset);
+
+    }
+
+
+    inline uint16_t x(){
+        //get x
+       return current_particle_cell.x;
+    }
+
+    inline uint16_t y(){
+        //get x
+        return current_particle_cell.y;
+    }
+
+    inline uint16_t z(){
+        //get x
+        return current_particle_cell.z;
+    }
+
+    inline uint8_t type(){
+        //get type of the particle cell
+
+        if(current_particle_cell.level==level_max()){
+            return 1; //all highest resolution pcs are seed, when using the nieghborhood optimization/
+        } else {
+            return apr_access->particle_cell_type.data[current_particle_cell.global_index];
+        }
+
+    }
+
+    inline uint16_t level(){
+        //get x
+        return current_particle_cell.level;
+    }
+
+    inline uint64_t global_index() const {
+        //get x
+        return current_particle_cell.global_index;
+    }
+
+    inline ParticleCell get_current_particle_cell(){
+        return current_particle_cell;
+    }
+
+    inline unsigned int x_nearest_pixel(){
+        //get x
+        return floor((current_particle_cell.x+0.5)*pow(2, apr_access->level_max - current_particle_cell.level));
+    }
+
+    inline float x_global(){
+        //get x
+        return (current_particle_cell.x+0.5)*pow(2, apr_access->level_max - current_particle_cell.level);
+    }
+
+    inline unsigned int y_nearest_pixel(){
+        //get x
+        return floor((current_particle_cell.y+0.5)*pow(2, apr_access->level_max - current_particle_cell.level));
+    }
+
+    inline float y_global(){
+        //get x
+        return (current_particle_cell.y+0.5)*pow(2, apr_access->level_max - current_particle_cell.level);
+    }
+
+    inline unsigned int z_nearest_pixel(){
+        //get z nearest pixel
+        return floor((current_particle_cell.z+0.5)*pow(2, apr_access->level_max - current_particle_cell.level));
+    }
+
+    inline float z_global(){
+        //get z global coordinate
+        return (current_particle_cell.z+0.5)*pow(2, apr_access->level_max - current_particle_cell.level);
+    }
+
+    inline uint16_t level_min(){
+        return apr_access->level_min;
+    }
+
+    inline uint16_t level_max(){
+        return apr_access->level_max;
+    }
+
+    inline uint64_t spatial_index_x_max(const unsigned int level){
+        return apr_access->x_num[level];
+    }
+
+    inline uint64_t spatial_index_y_max(const unsigned int level){
+        return apr_access->y_num[level];
+    }
+
+    inline uint64_t spatial_index_z_max(const unsigned int level){
+        return apr_access->z_num[level];
+    }
+    /////////////////////////
+    /// Row-run iteration
+    ///
+    /////////////////////////
+
+    bool set_iterator_to_row_begin(const uint16_t& level_,const uint64_t& z_,const uint64_t& x_){
+        //
+        //  Sets the iterator to the first run of particles (and the first particle) of the (level,z,x) row, returns false if the row is empty.
+        //  The particles of a run are contiguous in y and global index, so they can be processed as a dense array.
+        //
+
+        const uint64_t offset = apr_access->x_num[level_]*z_ + x_;
+
+        if(apr_access->row_empty(level_,offset)){
+            return false;
+        }
+
+        current_particle_cell.level = level_;
+        current_particle_cell.z = z_;
+        current_particle_cell.x = x_;
+        current_particle_cell.pc_offset = offset;
+
+        apr_access->set_row_begin(current_gap,level_,offset);
+        current_particle_cell.y = apr_access->gap_y_begin(current_gap);
+        current_particle_cell.global_index = apr_access->gap_global_index_begin(current_gap);
+
+        return true;
+    }
+
+    bool move_to_next_run(){
+        //
+        //  Moves to the next run in the row, returns false at the end of the row
+        //
+
+        if(apr_access->next_gap(current_gap)){
+            current_particle_cell.y = apr_access->gap_y_begin(current_gap);
+            current_particle_cell.global_index = apr_access->gap_global_index_begin(current_gap);
+            return true;
+        } else {
+            return false;
+        }
+    }
+
+    inline uint16_t run_y_begin(){
+        return apr_access->gap_y_begin(current_gap);
+    }
+
+    inline uint16_t run_y_end(){
+        //last y in the run (inclusive)
+        return apr_access->gap_y_end(current_gap);
+    }
+
+    inline uint64_t run_global_index_begin(){
+        return apr_access->gap_global_index_begin(current_gap);
+    }
+
+    inline uint64_t run_length(){
+        return (apr_access->gap_y_end(current_gap) - apr_access->gap_y_begin(current_gap)) + 1;
+    }
+
+    inline ParticleRun get_current_run(){
+        return {current_particle_cell.level,current_particle_cell.x,current_particle_cell.z,run_y_begin(),run_y_end(),run_global_index_begin()};
+    }
+
+protected:
+    //protected methods
+
+    bool move_iterator_to_next_non_empty_row(const uint64_t maximum_level){
+
+        uint64_t offset_max = apr_access->x_num[current_particle_cell.level]*apr_access->z_num[current_particle_cell.level];
+
+        //iterate until you find the next row or hit the end of the level
+        while((current_particle_cell.pc_offset < offset_max) && apr_access->row_empty(current_particle_cell.level,current_particle_cell.pc_offset)){
+            current_particle_cell.pc_offset++;
+        }
+
+        if(current_particle_cell.pc_offset == offset_max){
+            //if within the level range, move to next level
+            if(current_particle_cell.level < maximum_level){
+                current_particle_cell.level++;
+                current_particle_cell.pc_offset=0;
+                return move_iterator_to_next_non_empty_row(maximum_level);
+            } else {
+                //reached last level
+                return false;
+            }
+        } else {
+            apr_access->set_row_begin(current_gap,current_particle_cell.level,current_particle_cell.pc_offset);
+            current_particle_cell.global_index = apr_access->gap_global_index_begin(current_gap);
+            current_particle_cell.y = apr_access->gap_y_begin(current_gap);
+
+            //compute x and z
+            current_particle_cell.z = (current_particle_cell.pc_offset)/spatial_index_x_max(current_particle_cell.level);
+            current_particle_cell.x = (current_particle_cell.pc_offset) - current_particle_cell.z*(spatial_index_x_max(current_particle_cell.level));
+
+            return true;
+        }
+
+    }
+
+
+    bool move_to_next_particle_cell(){
+        //  Assumes all state variabels are valid for the current particle cell
+        //
+        //  moves particles cell in y direction if possible on same level
+        //
+
+        if( (current_particle_cell.y+1) <= apr_access->gap_y_end(current_gap)){
+            //  Still in same y gap
+
+            current_particle_cell.global_index++;
+            current_particle_cell.y++;
+            return true;
+
+        } else {
+            //not in the same gap
+            if(apr_access->next_gap(current_gap)){
+                //I am in the next gap (move the iterator forward)
+                current_particle_cell.global_index++;
+                current_particle_cell.y = apr_access->gap_y_begin(current_gap); // the first y value for the gap
+                return true;
+            } else {
+                current_particle_cell.pc_offset++;
+                //reached the end of the row
+                if(move_iterator_to_next_non_empty_row(level_max())){
+                    //found the next row set the iterator to the begining and find the particle cell.
+
+                    return true;
+                } else {
+                    //reached the end of the particle cells
+                    current_particle_cell.global_index = UINT64_MAX;
+                    return false;
+                }
+            }
+        }
+    }
+
+};
+
+
+#endif //PARTPLAY_APR_LINEAR_ITERATOR_HPP
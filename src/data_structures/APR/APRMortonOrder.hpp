@@ -0,0 +1,224 @@
+//
+// Morton (Z-order) particle ordering and the permutations between it and the canonical (level -> z -> x -> y) ordering
+//
+
+#ifndef PARTPLAY_APRMORTONORDER_HPP
+#define PARTPLAY_APRMORTONORDER_HPP
+
+#include <algorithm>
+#include <numeric>
+#include <vector>
+#include "APR.hpp"
+#include "APRIterator.hpp"
+#include "APRNeighbourCache.hpp"
+
+#ifdef HAVE_OPENMP
+#include "omp.h"
+#endif
+
+class APRMortonOrder {
+    //
+    //  The particle data (ExtraParticleData) is normally stored in the canonical order of the access structure. In
+    //  Morton order particles close in x and z are also close in memory, either within each level (the levels stay
+    //  in separate blocks, so particles_level_begin/end are unchanged) or across levels (cells ordered by the Morton
+    //  code of their origin at the highest level).
+    //
+
+public:
+
+    std::vector<uint64_t> canonical_to_morton;
+    std::vector<uint64_t> morton_to_canonical;
+
+    bool across_levels = false;
+
+    static inline uint64_t spread_bits(uint64_t v){
+        //spreads the lower 21 bits so there are two zero bits between each
+        v &= 0x1fffff;
+        v = (v | (v << 32)) & 0x1f00000000ffffull;
+        v = (v | (v << 16)) & 0x1f0000ff0000ffull;
+        v = (v | (v << 8)) & 0x100f00f00f00f00full;
+        v = (v | (v << 4)) & 0x10c30c30c30c30c3ull;
+        v = (v | (v << 2)) & 0x1249249249249249ull;
+        return v;
+    }
+
+    static inline uint64_t morton_code(const uint64_t y,const uint64_t x,const uint64_t z){
+        return spread_bits(y) | (spread_bits(x) << 1) | (spread_bits(z) << 2);
+    }
+
+    template<typename T>
+    void initialize(APR<T>& apr,const bool across_levels_ = false){
+        //
+        //  Computes the Morton keys of all particles in parallel, and sorts by them (the level is put in the highest
+        //  bits of the key when ordering within levels)
+        //
+
+        across_levels = across_levels_;
+
+        const uint64_t total_number_particles = apr.total_number_particles();
+        std::vector<uint64_t> keys(total_number_particles);
+
+        APRLinearIterator apr_iterator(apr);
+
+        for (uint64_t level = apr_iterator.level_min(); level <= apr_iterator.level_max(); ++level) {
+            const int64_t z_num_ = apr_iterator.spatial_index_z_max(level);
+            const uint64_t x_num_ = apr_iterator.spatial_index_x_max(level);
+            const unsigned int shift = across_levels ? (apr_iterator.level_max() - level) : 0;
+            const uint64_t level_key = across_levels ? 0 : (level << 48);
+
+            int64_t z_;
+#ifdef HAVE_OPENMP
+#pragma omp parallel for schedule(dynamic) private(z_) firstprivate(apr_iterator)
+#endif
+            for (z_ = 0; z_ < z_num_; ++z_) {
+                for (uint64_t x_ = 0; x_ < x_num_; ++x_) {
+                    if(apr_iterator.set_iterator_to_row_begin(level,z_,x_)) {
+                        do {
+                            const uint64_t global_begin = apr_iterator.run_global_index_begin();
+                            const uint64_t y_begin = apr_iterator.run_y_begin();
+                            const uint64_t length = apr_iterator.run_length();
+                            for (uint64_t i = 0; i < length; ++i) {
+                                keys[global_begin + i] = level_key | morton_code((y_begin + i) << shift,x_ << shift,((uint64_t)z_) << shift);
+                            }
+                        } while(apr_iterator.move_to_next_run());
+                    }
+                }
+            }
+        }
+
+        morton_to_canonical.resize(total_number_particles);
+        std::iota(morton_to_canonical.begin(),morton_to_canonical.end(),0);
+
+        parallel_sort_by_key(morton_to_canonical,keys);
+
+        canonical_to_morton.resize(total_number_particles);
+
+        int64_t i;
+#ifdef HAVE_OPENMP
+#pragma omp parallel for schedule(static) private(i)
+#endif
+        for (i = 0; i < (int64_t)total_number_particles; ++i) {
+            canonical_to_morton[morton_to_canonical[i]] = i;
+        }
+    }
+
+    template<typename D>
+    void to_morton(const ExtraParticleData<D>& input,ExtraParticleData<D>& output) const {
+        //
+        //  Permutes particle data from the canonical to the Morton order (input and output have to be different)
+        //
+        output.data.resize(input.data.size());
+
+        int64_t i;
+#ifdef HAVE_OPENMP
+#pragma omp parallel for schedule(static) private(i)
+#endif
+        for (i = 0; i < (int64_t)morton_to_canonical.size(); ++i) {
+            output.data[i] = input.data[morton_to_canonical[i]];
+        }
+    }
+
+    template<typename D>
+    void to_canonical(const ExtraParticleData<D>& input,ExtraParticleData<D>& output) const {
+        //
+        //  Permutes particle data from the Morton to the canonical order (input and output have to be different)
+        //
+        output.data.resize(input.data.size());
+
+        int64_t i;
+#ifdef HAVE_OPENMP
+#pragma omp parallel for schedule(static) private(i)
+#endif
+        for (i = 0; i < (int64_t)canonical_to_morton.size(); ++i) {
+            output.data[i] = input.data[canonical_to_morton[i]];
+        }
+    }
+
+    void remap_neighbour_cache(const APRNeighbourCache& input,APRNeighbourCache& output) const {
+        //
+        //  Reorders a neighbour cache built in the canonical order, so the stencils can be applied to data in Morton order
+        //
+
+        const uint64_t total_number_particles = morton_to_canonical.size();
+
+        output.particle_offset.resize(total_number_particles+1);
+        output.number_neighbours.resize(6*total_number_particles);
+        output.level_delta.resize(6*total_number_particles);
+        output.neighbour_index.resize(input.neighbour_index.size());
+
+        int64_t i;
+#ifdef HAVE_OPENMP
+#pragma omp parallel for schedule(static) private(i)
+#endif
+        for (i = 0; i < (int64_t)total_number_particles; ++i) {
+            const uint64_t c = morton_to_canonical[i];
+            output.particle_offset[i+1] = input.particle_offset[c+1] - input.particle_offset[c];
+            for (int face = 0; face < 6; ++face) {
+                output.number_neighbours[6*i + face] = input.number_neighbours[6*c + face];
+                output.level_delta[6*i + face] = input.level_delta[6*c + face];
+            }
+        }
+
+        output.particle_offset[0] = 0;
+        std::partial_sum(output.particle_offset.begin(),output.particle_offset.end(),output.particle_offset.begin());
+
+#ifdef HAVE_OPENMP
+#pragma omp parallel for schedule(static) private(i)
+#endif
+        for (i = 0; i < (int64_t)total_number_particles; ++i) {
+            const uint64_t c = morton_to_canonical[i];
+            uint64_t current = output.particle_offset[i];
+            for (uint64_t n = input.particle_offset[c]; n < input.particle_offset[c+1]; ++n) {
+                output.neighbour_index[current] = canonical_to_morton[input.neighbour_index[n]];
+                current++;
+            }
+        }
+    }
+
+private:
+
+    static void parallel_sort_by_key(std::vector<uint64_t>& index,const std::vector<uint64_t>& keys){
+        //
+        //  Sorts blocks in parallel and then merges them pairwise
+        //
+
+        auto compare = [&keys](const uint64_t a,const uint64_t b){ return keys[a] < keys[b]; };
+
+        int number_blocks = 1;
+#ifdef HAVE_OPENMP
+        number_blocks = omp_get_max_threads();
+#endif
+        const uint64_t size = index.size();
+        if(size < 100000){
+            number_blocks = 1;
+        }
+
+        std::vector<uint64_t> block_begin(number_blocks+1);
+        for (int b = 0; b <= number_blocks; ++b) {
+            block_begin[b] = (size*b)/number_blocks;
+        }
+
+        int b;
+#ifdef HAVE_OPENMP
+#pragma omp parallel for schedule(static) private(b)
+#endif
+        for (b = 0; b < number_blocks; ++b) {
+            std::sort(index.begin() + block_begin[b],index.begin() + block_begin[b+1],compare);
+        }
+
+        for (int width = 1; width < number_blocks; width *= 2) {
+#ifdef HAVE_OPENMP
+#pragma omp parallel for schedule(dynamic) private(b)
+#endif
+            for (b = 0; b < number_blocks; b += 2*width) {
+                if((b + width) < number_blocks) {
+                    const int end = std::min(b + 2*width,number_blocks);
+                    std::inplace_merge(index.begin() + block_begin[b],index.begin() + block_begin[b+width],index.begin() + block_begin[end],compare);
+                }
+            }
+        }
+    }
+};
+
+
+#endif //PARTPLAY_APRMORTONORDER_HPP
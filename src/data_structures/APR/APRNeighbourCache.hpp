@@ -0,0 +1,160 @@
+//
+// Face neighbour cache for repeated stencil operations on the APR
+//
+
+#ifndef PARTPLAY_APRNEIGHBOURCACHE_HPP
+#define PARTPLAY_APRNEIGHBOURCACHE_HPP
+
+#include <numeric>
+#include <vector>
+#include "APR.hpp"
+#include "APRIterator.hpp"
+
+class APRNeighbourCache {
+    //
+    //  Stores the face neighbours of every particle in CSR form, so stencils can be applied repeatedly without
+    //  re-discovering the neighbours through the access structure.
+    //
+    //  The neighbours of particle p are neighbour_index[particle_offset[p] .. particle_offset[p+1]), ordered by face
+    //  [+y,-y,+x,-x,+z,-z] = [0,1,2,3,4,5] and then by the neighbour index on the face (0-4 neighbours per face).
+    //
+
+public:
+
+    std::vector<uint64_t> particle_offset;
+    std::vector<uint8_t> number_neighbours; //per particle and face (6 per particle)
+    std::vector<uint8_t> level_delta; //per particle and face (_LEVEL_SAME,_LEVEL_DECREASE,_LEVEL_INCREASE,_NO_NEIGHBOUR)
+    std::vector<uint64_t> neighbour_index;
+
+    template<typename T>
+    void initialize(APR<T>& apr){
+        //
+        //  Two passes in parallel, the first counts the neighbours on each face, the second fills in their global indices
+        //
+
+        APRTimer timer;
+        timer.verbose_flag = false;
+
+        const uint64_t total_number_particles = apr.total_number_particles();
+
+        particle_offset.resize(total_number_particles+1);
+        number_neighbours.resize(6*total_number_particles);
+        level_delta.resize(6*total_number_particles);
+
+        APRIterator<T> apr_iterator(apr);
+        APRIterator<T> neighbour_iterator(apr);
+
+        uint64_t particle_number;
+
+        timer.start_timer("count neighbours");
+
+#ifdef HAVE_OPENMP
+#pragma omp parallel for schedule(static) private(particle_number) firstprivate(apr_iterator,neighbour_iterator)
+#endif
+        for (particle_number = 0; particle_number < total_number_particles; ++particle_number) {
+            apr_iterator.set_iterator_to_particle_by_number(particle_number);
+
+            uint64_t count = 0;
+
+            for (uint8_t face = 0; face < 6; ++face) {
+                apr_iterator.find_neighbours_in_direction(face);
+
+                uint8_t found = 0;
+                uint8_t delta = _NO_NEIGHBOUR;
+
+                for (int index = 0; index < apr_iterator.number_neighbours_in_direction(face); ++index) {
+                    if (neighbour_iterator.set_neighbour_iterator(apr_iterator, face, index)) {
+                        found++;
+                        if(neighbour_iterator.level() == apr_iterator.level()){
+                            delta = _LEVEL_SAME;
+                        } else if (neighbour_iterator.level() < apr_iterator.level()){
+                            delta = _LEVEL_DECREASE;
+                        } else {
+                            delta = _LEVEL_INCREASE;
+                        }
+                    }
+                }
+
+                number_neighbours[6*particle_number + face] = found;
+                level_delta[6*particle_number + face] = delta;
+                count += found;
+            }
+
+            particle_offset[particle_number+1] = count;
+        }
+
+        timer.stop_timer();
+
+        particle_offset[0] = 0;
+        std::partial_sum(particle_offset.begin(),particle_offset.end(),particle_offset.begin());
+
+        neighbour_index.resize(particle_offset.back());
+
+        timer.start_timer("fill neighbours");
+
+#ifdef HAVE_OPENMP
+#pragma omp parallel for schedule(static) private(particle_number) firstprivate(apr_iterator,neighbour_iterator)
+#endif
+        for (particle_number = 0; particle_number < total_number_particles; ++particle_number) {
+            apr_iterator.set_iterator_to_particle_by_number(particle_number);
+
+            uint64_t current = particle_offset[particle_number];
+
+            for (uint8_t face = 0; face < 6; ++face) {
+                apr_iterator.find_neighbours_in_direction(face);
+
+                for (int index = 0; index < apr_iterator.number_neighbours_in_direction(face); ++index) {
+                    if (neighbour_iterator.set_neighbour_iterator(apr_iterator, face, index)) {
+                        neighbour_index[current] = neighbour_iterator.global_index();
+                        current++;
+                    }
+                }
+            }
+        }
+
+        timer.stop_timer();
+    }
+
+    inline uint64_t neighbours_begin(const uint64_t& particle_number,const uint8_t& face) const {
+        uint64_t begin = particle_offset[particle_number];
+        for (uint8_t f = 0; f < face; ++f) {
+            begin += number_neighbours[6*particle_number + f];
+        }
+        return begin;
+    }
+
+    inline uint64_t neighbours_end(const uint64_t& particle_number,const uint8_t& face) const {
+        return neighbours_begin(particle_number,face) + number_neighbours[6*particle_number + face];
+    }
+
+    inline uint8_t neighbour_level_delta(const uint64_t& particle_number,const uint8_t& face) const {
+        return level_delta[6*particle_number + face];
+    }
+
+    uint64_t memory_usage() const {
+        //
+        //  Memory used by the cache in bytes
+        //
+        return particle_offset.capacity()*sizeof(uint64_t) + number_neighbours.capacity()*sizeof(uint8_t) +
+               level_delta.capacity()*sizeof(uint8_t) + neighbour_index.capacity()*sizeof(uint64_t);
+    }
+
+    static uint64_t estimate_memory_usage(const uint64_t total_number_particles,const float average_number_neighbours = 6.0f){
+        //
+        //  Estimate (in bytes) of the memory required before building the cache, each particle has at least one
+        //  neighbour on most faces (up to 24 in total)
+        //
+        return total_number_particles*(sizeof(uint64_t) + 12*sizeof(uint8_t)) +
+               (uint64_t)(total_number_particles*average_number_neighbours)*sizeof(uint64_t);
+    }
+
+    void clear(){
+        std::vector<uint64_t>().swap(particle_offset);
+        std::vector<uint8_t>().swap(number_neighbours);
+        std::vector<uint8_t>().swap(level_delta);
+        std::vector<uint64_t>().swap(neighbour_index);
+    }
+};
+
+
+#endif //PARTPLAY_APRNEIGHBOURCACHE_HPP
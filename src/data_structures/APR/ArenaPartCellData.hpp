@@ -0,0 +1,104 @@
+//
+// Per row (level,z,x) data stored in one contiguous buffer per level
+//
+
+#ifndef PARTPLAY_ARENAPARTCELLDATA_HPP
+#define PARTPLAY_ARENAPARTCELLDATA_HPP
+
+#include <numeric>
+#include <vector>
+
+template<typename T>
+class ArenaPartCellData {
+    //
+    //  Same indexing as ExtraPartCellData ([level][x_num(level) * z + x] -> row of elements), but instead of a vector per
+    //  row all the rows of a level live in one buffer, so there are no per row allocations. It is filled in two passes:
+    //
+    //      initialize(...), set_row_size(level,offset,n) for the rows (can be done in parallel), allocate(),
+    //      then write the elements of each row through row(level,offset) (can be done in parallel).
+    //
+    //  row_begin[level][offset] is the index of the first element of the row in data[level], the row ends at
+    //  row_begin[level][offset+1].
+    //
+
+public:
+    uint64_t depth_max = 0;
+    uint64_t depth_min = 0;
+
+    std::vector<uint64_t> z_num;
+    std::vector<uint64_t> x_num;
+    std::vector<std::vector<T>> data; // [level][row_begin .. row_end)
+    std::vector<std::vector<uint64_t>> row_begin; // [level][x_num(level) * z + x] (x_num*z_num + 1 entries)
+
+    void initialize(const uint64_t level_min,const uint64_t level_max,const std::vector<uint64_t>& x_num_,const std::vector<uint64_t>& z_num_){
+        //
+        //  Sets up the rows of each level, all empty (the buffers of a previous use are kept, so re-using the arena
+        //  for a structure of the same size does not allocate)
+        //
+        depth_min = level_min;
+        depth_max = level_max;
+
+        z_num.assign(depth_max+1,0);
+        x_num.assign(depth_max+1,0);
+        data.resize(depth_max+1);
+        row_begin.resize(depth_max+1);
+
+        for (uint64_t i = 0; i <= depth_max; ++i) {
+            data[i].clear();
+            row_begin[i].clear();
+        }
+
+        for (uint64_t i = depth_min; i <= depth_max; ++i) {
+            z_num[i] = z_num_[i];
+            x_num[i] = x_num_[i];
+            row_begin[i].resize(z_num[i]*x_num[i]+1,0);
+        }
+    }
+
+    inline void set_row_size(const uint64_t& level,const uint64_t& offset,const uint64_t& size){
+        //the sizes are kept one entry ahead, so allocate() can turn them into the row offsets in place
+        row_begin[level][offset+1] = size;
+    }
+
+    void allocate(){
+        //
+        //  Turns the row sizes into row offsets and allocates the buffer of each level
+        //
+        for (uint64_t i = depth_min; i <= depth_max; ++i) {
+            row_begin[i][0] = 0;
+            std::partial_sum(row_begin[i].begin(),row_begin[i].end(),row_begin[i].begin());
+            data[i].resize(row_begin[i].back());
+        }
+    }
+
+    inline uint64_t row_size(const uint64_t& level,const uint64_t& offset) const {
+        return row_begin[level][offset+1] - row_begin[level][offset];
+    }
+
+    inline T* row(const uint64_t& level,const uint64_t& offset){
+        return data[level].data() + row_begin[level][offset];
+    }
+
+    inline const T* row(const uint64_t& level,const uint64_t& offset) const {
+        return data[level].data() + row_begin[level][offset];
+    }
+
+    uint64_t memory_usage() const {
+        //
+        //  Memory used by the buffers and the row offsets in bytes (not including memory owned by the elements)
+        //
+        uint64_t total = 0;
+        for (uint64_t i = 0; i < data.size(); ++i) {
+            total += data[i].capacity()*sizeof(T) + row_begin[i].capacity()*sizeof(uint64_t);
+        }
+        return total;
+    }
+
+    void clear(){
+        std::vector<std::vector<T>>().swap(data);
+        std::vector<std::vector<uint64_t>>().swap(row_begin);
+    }
+};
+
+
+#endif //PARTPLAY_ARENAPARTCELLDATA_HPP
@@ -47,6 +47,16 @@ public:
         return data[apr_iterator.global_index()];
     }
 
+    /**
+     * Access particle via any other iterator providing global_index() (e.g. APRLinearIterator)
+     * @param apr_iterator
+     * @return reference to stored particle
+     */
+    template<typename Iterator>
+    DataType& operator[](const Iterator& apr_iterator) {
+        return data[apr_iterator.global_index()];
+    }
+
     template<typename S>
     DataType get_particle(const APRIterator<S>& apr_iterator) const {
         return data[apr_iterator.global_index()];
@@ -67,8 +77,6 @@ public:
         //checking if its the right size, if it is, this should do nothing.
         data.resize(total_number_of_particles);
 
-        APRIterator<T> apr_iterator(apr);
-
         size_t particle_number_start;
         size_t particle_number_stop;
         if (level==0){
@@ -76,8 +84,8 @@ public:
             particle_number_stop = total_number_of_particles;
 
         } else {
-            particle_number_start = apr_iterator.particles_level_begin(level);
-            particle_number_stop = apr_iterator.particles_level_end(level);
+            particle_number_start = apr.apr_access.global_index_by_level_begin[level];
+            particle_number_stop = (apr.apr_access.global_index_by_level_end[level] + 1);
         }
 
         //determine if openMP should be used.
@@ -111,16 +119,14 @@ public:
      */
     template<typename V,class BinaryOperation,typename T>
     void zip_inplace(APR<T> &apr, const ExtraParticleData<V> &parts2, BinaryOperation op, uint64_t level = 0, unsigned int aNumberOfBlocks = 10) {
-        APRIterator<T> apr_iterator(apr);
-
         size_t particle_number_start;
         size_t particle_number_stop;
         if (level==0) {
             particle_number_start = 0;
             particle_number_stop = total_number_particles();
         } else {
-            particle_number_start = apr_iterator.particles_level_begin(level);
-            particle_number_stop = apr_iterator.particles_level_end(level);
+            particle_number_start = apr.apr_access.global_index_by_level_begin[level];
+            particle_number_stop = (apr.apr_access.global_index_by_level_end[level] + 1);
         }
 
         //determine if openMP should be used.
@@ -155,16 +161,14 @@ public:
     void zip(APR<T>& apr, const ExtraParticleData<V> &parts2, ExtraParticleData<V>& output, BinaryOperation op, uint64_t level = 0, unsigned int aNumberOfBlocks = 10) {
         output.data.resize(data.size());
 
-        APRIterator<T> apr_iterator(apr);
-
         size_t particle_number_start;
         size_t particle_number_stop;
         if (level==0) {
             particle_number_start = 0;
             particle_number_stop = total_number_particles();
         } else {
-            particle_number_start = apr_iterator.particles_level_begin(level);
-            particle_number_stop = apr_iterator.particles_level_end(level);
+            particle_number_start = apr.apr_access.global_index_by_level_begin[level];
+            particle_number_stop = (apr.apr_access.global_index_by_level_end[level] + 1);
         }
 
         //determine if openMP should be used.
@@ -200,16 +204,14 @@ public:
     void map(APR<T>& apr,ExtraParticleData<U>& output,UnaryOperator op,const uint64_t level = 0,unsigned int aNumberOfBlocks = 10){
         output.data.resize(data.size());
 
-        APRIterator<T> apr_iterator(apr);
-
         size_t particle_number_start;
         size_t particle_number_stop;
         if (level==0) {
             particle_number_start=0;
             particle_number_stop = total_number_particles();
         } else {
-            particle_number_start = apr_iterator.particles_level_begin(level);
-            particle_number_stop = apr_iterator.particles_level_end(level);
+            particle_number_start = apr.apr_access.global_index_by_level_begin[level];
+            particle_number_stop = (apr.apr_access.global_index_by_level_end[level] + 1);
         }
 
         //determine if openMP should be used.
@@ -242,16 +244,14 @@ public:
      */
     template<class UnaryOperator,typename T>
     void map_inplace(APR<T>& apr,UnaryOperator op,const uint64_t level = 0,unsigned int aNumberOfBlocks = 10){
-        APRIterator<T> apr_iterator(apr);
-
         size_t particle_number_start;
         size_t particle_number_stop;
         if (level==0) {
             particle_number_start=0;
             particle_number_stop = total_number_particles();
         } else {
-            particle_number_start = apr_iterator.particles_level_begin(level);
-            particle_number_stop = apr_iterator.particles_level_end(level);
+            particle_number_start = apr.apr_access.global_index_by_level_begin[level];
+            particle_number_stop = (apr.apr_access.global_index_by_level_end[level] + 1);
         }
 
         //determine if openMP should be used.
@@ -232,10 +232,8 @@ public :
         x_num = aSizeOfX;
         z_num = aSizeOfZ;
         size_t size = (size_t)y_num * x_num * z_num;
-        meshMemory.reset(new T[size]);
+        allocate(size);
         T *array = meshMemory.get();
-        if (array == nullptr) { std::cerr << "Could not allocate memory!" << size << std::endl; exit(-1); }
-        mesh.set(array, size);
 
         // Fill values of new buffer in parallel
         #ifdef HAVE_OPENMP
@@ -274,9 +272,23 @@ public :
         x_num = aSizeOfX;
         z_num = aSizeOfZ;
         size_t size = (size_t)y_num * x_num * z_num;
-        meshMemory.reset(new T[size]);
-        if (meshMemory.get() == nullptr) { std::cerr << "Could not allocate memory!" << size << std::endl; exit(-1); }
-        mesh.set(meshMemory.get(), size);
+        allocate(size);
+    }
+
+    /**
+     * Makes the mesh a view of memory owned by the caller (no copy), the memory has to outlive the use of the mesh.
+     * Elements are in the order of the mesh (y, then x, then z). A later init allocates new memory for the mesh.
+     * @param aData
+     * @param aSizeOfY
+     * @param aSizeOfX
+     * @param aSizeOfZ
+     */
+    void setView(T *aData, int aSizeOfY, int aSizeOfX, int aSizeOfZ) {
+        y_num = aSizeOfY;
+        x_num = aSizeOfX;
+        z_num = aSizeOfZ;
+        meshMemory.reset();
+        mesh.set(aData, (size_t)y_num * x_num * z_num);
     }
 
     /**
@@ -437,6 +449,19 @@ private:
     MeshData(const MeshData&) = delete; // make it noncopyable
     MeshData& operator=(const MeshData&) = delete; // make it not assignable
 
+    /**
+     * Allocates memory for aSize elements, an owned allocation of the same size is re-used (so buffers kept for
+     * same sized images, e.g. in APRConverter, are not allocated and page-faulted again)
+     * @param aSize
+     */
+    void allocate(size_t aSize) {
+        if (meshMemory && (mesh.get() == meshMemory.get()) && (mesh.size() == aSize)) return;
+
+        meshMemory.reset(new T[aSize]);
+        if (meshMemory.get() == nullptr) { std::cerr << "Could not allocate memory!" << aSize << std::endl; exit(-1); }
+        mesh.set(meshMemory.get(), aSize);
+    }
+
 };
 
 
@@ -71,7 +71,7 @@ class APRWriter {
 public:
 
     template<typename ImageType>
-    void read_apr(APR<ImageType>& apr, const std::string &file_name) {
+    void read_apr(APR<ImageType>& apr, const std::string &file_name, const bool flat_map = true) {
         AprFile f(file_name, AprFile::Operation::READ);
         if (!f.isOpened()) return;
 
@@ -162,6 +162,8 @@ public:
         apr.apr_access.particle_cell_type.data.resize(type_size);
         readData(AprTypes::ParticleCellType, f.objectId, apr.apr_access.particle_cell_type.data.data());
 
+        // with the flat access structure the flattened arrays are used directly (no map rebuild)
+        apr.apr_access.use_flat_map = flat_map;
         apr.apr_access.rebuild_map(apr, *map_data);
 
         // ------------ decompress if needed ---------------------
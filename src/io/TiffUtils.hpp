@@ -210,6 +210,39 @@ namespace TiffUtils {
         aInputMesh.x_num = aTiff.iImgHeight;
     }
 
+    /**
+    * Reads the z slices [aZBegin, aZEnd) of a TIFF file to provided mesh (resized to the slices)
+    * @tparam T type of mesh/image (uint8_t, uint16_t, float)
+    * @param aTiff TiffInfo class with opened image
+    * @param aZBegin first slice
+    * @param aZEnd end of the slices (exclusive)
+    * @param aInputMesh mesh for the slices
+    * @return true if the slices were read (false if a directory or strip could not be read, or the slices do not fill the mesh)
+    */
+    template<typename T>
+    bool getMeshSlices(const TiffInfo &aTiff, uint32_t aZBegin, uint32_t aZEnd, MeshData<T> &aInputMesh) {
+        if (!aTiff.isFileOpened() || (aZBegin >= aZEnd) || (aZEnd > aTiff.iNumberOfDirectories)) return false;
+
+        // (x and y are exchanged giving transpose w.r.t. original file, as in getMesh)
+        aInputMesh.init(aTiff.iImgWidth, aTiff.iImgHeight, aZEnd - aZBegin);
+
+        size_t currentOffset = 0;
+        for (uint32_t i = aZBegin; i < aZEnd; ++i) {
+            if (!TIFFSetDirectory(aTiff.iFile, i)) return false;
+
+            for (tstrip_t strip = 0; strip < TIFFNumberOfStrips(aTiff.iFile); ++strip) {
+                // strips are never read past the end of the mesh
+                const size_t remainingBytes = (aInputMesh.mesh.size() - currentOffset) * sizeof(T);
+                if (remainingBytes == 0) return false;
+                int64_t readLen = TIFFReadEncodedStrip(aTiff.iFile, strip, (&aInputMesh.mesh[0] + currentOffset), (tsize_t) remainingBytes);
+                if (readLen < 0) return false;
+                currentOffset += readLen/sizeof(T);
+            }
+        }
+
+        return currentOffset == aInputMesh.mesh.size();
+    }
+
     /**
      * Saves provided mesh as a TIFF file
      * @tparam T handled types are uint8_t, uint16_t and float
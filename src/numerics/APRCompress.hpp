@@ -13,6 +13,7 @@
 #include <cmath>
 #include "../data_structures/APR/APR.hpp"
 #include "../data_structures/APR/ExtraParticleData.hpp"
+#include "../data_structures/APR/APRNeighbourCache.hpp"
 
 template<typename ImageType>
 class APRCompress {
@@ -165,6 +166,11 @@ public:
         return q;
     }
 
+    void set_neighbour_cache(const APRNeighbourCache* neighbour_cache_){
+        //optional, the prediction then uses the precomputed neighbours (nullptr to go back to the iterators)
+        neighbour_cache = neighbour_cache_;
+    }
+
 private:
 
     unsigned int num_blocks = 4;
@@ -177,6 +183,8 @@ private:
 
     std::vector<unsigned int> predict_directions = {1,3,5};
 
+    const APRNeighbourCache* neighbour_cache = nullptr;
+
     template<typename S>
     S variance_stabilitzation(const S input);
 
@@ -306,7 +314,27 @@ void APRCompress<ImageType>::predict_particles_by_level(APR<U>& apr,const unsign
                 float temp = 0;
 
                 //Handle the z_blocking, neighbours shoudl not be used on the zblock begin
-                if(z != z_block_begin[z_block]) {
+                if((z != z_block_begin[z_block]) && (neighbour_cache != nullptr)) {
+
+                    for (unsigned int f = 0; f < predict_directions.size(); ++f) {
+                        const uint8_t face = predict_directions[f];
+
+                        //only neighbours on the same or a lower level are used
+                        if (neighbour_cache->neighbour_level_delta(particle_number,face) != _LEVEL_INCREASE) {
+                            const uint64_t neighbours_end = neighbour_cache->neighbours_end(particle_number,face);
+                            for (uint64_t n = neighbour_cache->neighbours_begin(particle_number,face); n < neighbours_end; ++n) {
+                                if(decode_encode_flag == 0) {
+                                    //Encode
+                                    temp += predict_input.data[neighbour_cache->neighbour_index[n]];
+                                } else if (decode_encode_flag == 1) {
+                                    //Decode
+                                    temp += predict_output.data[neighbour_cache->neighbour_index[n]];
+                                }
+                                count_neighbours++;
+                            }
+                        }
+                    }
+                } else if(z != z_block_begin[z_block]) {
 
                     //loop over all the neighbours and set the neighbour iterator to it
                     for (unsigned int f = 0; f < predict_directions.size(); ++f) {
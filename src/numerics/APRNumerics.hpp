@@ -6,6 +6,7 @@
 #define PARTPLAY_APRNUMERICS_HPP
 
 #include "../data_structures/APR/APR.hpp"
+#include "../data_structures/APR/APRNeighbourCache.hpp"
 
 
 class APRNumerics {
@@ -113,6 +114,27 @@ public:
         std::swap(output_data_2.data,output_data.data);
     }
 
+    template<typename T,typename S,typename U>
+    void seperable_smooth_filter(APR<T>& apr,const ExtraParticleData<S>& input_data,ExtraParticleData<U>& output_data,const std::vector<float>& filter,const APRNeighbourCache& neighbour_cache,unsigned int repeats = 1){
+        //
+        //  Same as above, using the precomputed face neighbours
+        //
+
+        output_data.init(apr);
+
+        ExtraParticleData<U> output_data_2(apr);
+        output_data_2.copy_parts(apr,input_data);
+
+        for (unsigned int i = 0; i < repeats; ++i) {
+            face_neighbour_filter(apr,output_data_2,output_data,filter,0,neighbour_cache);
+            face_neighbour_filter(apr,output_data,output_data_2,filter,1,neighbour_cache);
+            face_neighbour_filter(apr,output_data_2,output_data,filter,2,neighbour_cache);
+            std::swap(output_data_2.data,output_data.data);
+        }
+
+        std::swap(output_data_2.data,output_data.data);
+    }
+
 
     template<typename T,typename S,typename U>
     void face_neighbour_filter(APR<T> apr,ExtraParticleData<S>& input_data,ExtraParticleData<U>& output_data,const std::vector<float>& filter,const int direction){
@@ -167,6 +189,49 @@ public:
             }
         }
     }
+
+    template<typename T,typename S,typename U>
+    void face_neighbour_filter(APR<T>& apr,ExtraParticleData<S>& input_data,ExtraParticleData<U>& output_data,const std::vector<float>& filter,const int direction,const APRNeighbourCache& neighbour_cache){
+        //
+        //  Same as above, the neighbours are read from the cache so no iterators are required
+        //
+
+        const uint8_t faces[2] = {(uint8_t)(2*direction),(uint8_t)(2*direction+1)};
+
+        const float filter_t[2] = {filter[2],filter[0]};
+
+        uint64_t particle_number;
+
+#ifdef HAVE_OPENMP
+#pragma omp parallel for schedule(static) private(particle_number)
+#endif
+        for (particle_number = 0; particle_number < apr.total_number_particles(); ++particle_number) {
+
+            const float current_intensity = input_data.data[particle_number];
+            U output = current_intensity*filter[1];
+
+            for (int i = 0; i < 2; ++i) {
+                float intensity_sum = 0;
+
+                const uint64_t neighbours_begin = neighbour_cache.neighbours_begin(particle_number,faces[i]);
+                const uint64_t neighbours_end = neighbours_begin + neighbour_cache.number_neighbours[6*particle_number + faces[i]];
+
+                for (uint64_t n = neighbours_begin; n < neighbours_end; ++n) {
+                    intensity_sum += input_data.data[neighbour_cache.neighbour_index[n]];
+                }
+
+                const float count_neighbours = neighbours_end - neighbours_begin;
+
+                if(count_neighbours > 0) {
+                    output += filter_t[i]*intensity_sum/count_neighbours;
+                } else {
+                    output += filter_t[i]*current_intensity;
+                }
+            }
+
+            output_data.data[particle_number] = output;
+        }
+    }
 };
 
 
@@ -142,7 +142,7 @@ void APRRaycaster::perform_raycast(APR<U>& apr,ExtraParticleData<S>& particle_da
     ExtraParticleData<float> jitter_z;
 
     //initialize the iterator
-    APRIterator<U> apr_iterator(apr);
+    APRLinearIterator apr_iterator(apr);
     uint64_t particle_number;
 
     if(jitter){
@@ -20,44 +20,56 @@ public:
         //  Takes in a APR and creates piece-wise constant image
         //
 
-        APRIterator<S> apr_iterator(apr);
-        uint64_t particle_number;
+        APRLinearIterator apr_iterator(apr);
 
         img.init(apr.orginal_dimensions(0), apr.orginal_dimensions(1), apr.orginal_dimensions(2), 0);
 
+        const int64_t y_num = img.y_num;
+        const int64_t x_num = img.x_num;
+        const int64_t z_num = img.z_num;
+
         for (uint64_t level = apr_iterator.level_min(); level <= apr_iterator.level_max(); ++level) {
 
-            const float step_size = pow(2,apr_iterator.level_max() - level);
+            //particle cells on this level cover step_size = 2^level_shift pixels in each direction
+            const unsigned int level_shift = apr_iterator.level_max() - level;
+            const int64_t step_size = ((int64_t)1) << level_shift;
+            const int64_t x_num_ = apr_iterator.spatial_index_x_max(level);
+            const int64_t z_num_ = apr_iterator.spatial_index_z_max(level);
 
+            int64_t z_;
 #ifdef HAVE_OPENMP
-	#pragma omp parallel for schedule(static) private(particle_number) firstprivate(apr_iterator)
+	#pragma omp parallel for schedule(dynamic) private(z_) firstprivate(apr_iterator)
 #endif
-            for (particle_number = apr_iterator.particles_level_begin(level); particle_number <  apr_iterator.particles_level_end(level); ++particle_number) {
+            for (z_ = 0; z_ < z_num_; ++z_) {
                 //
-                //  Parallel loop over level
+                //  Parallel loop over the z slices of the level, each run of particles fills a dense block of y
                 //
-                apr_iterator.set_iterator_to_particle_by_number(particle_number);
-
-                int dim1 = apr_iterator.y() * step_size;
-                int dim2 = apr_iterator.x() * step_size;
-                int dim3 = apr_iterator.z() * step_size;
+                const int64_t dim3 = z_ * step_size;
+                const int64_t offset_max_dim3 = std::min(z_num, dim3 + step_size);
 
-                float temp_int;
-                //add to all the required rays
+                for (int64_t x_ = 0; x_ < x_num_; ++x_) {
 
-                temp_int = parts[apr_iterator];
-
-                const int offset_max_dim1 = std::min((int) img.y_num, (int) (dim1 + step_size));
-                const int offset_max_dim2 = std::min((int) img.x_num, (int) (dim2 + step_size));
-                const int offset_max_dim3 = std::min((int) img.z_num, (int) (dim3 + step_size));
-
-                for (int64_t q = dim3; q < offset_max_dim3; ++q) {
+                    if(!apr_iterator.set_iterator_to_row_begin(level,z_,x_)){
+                        continue;
+                    }
 
-                    for (int64_t k = dim2; k < offset_max_dim2; ++k) {
-                        for (int64_t i = dim1; i < offset_max_dim1; ++i) {
-                            img.mesh[i + (k) * img.y_num + q * img.y_num * img.x_num] = temp_int;
+                    const int64_t dim2 = x_ * step_size;
+                    const int64_t offset_max_dim2 = std::min(x_num, dim2 + step_size);
+
+                    do {
+                        const V* run_parts = &parts.data[apr_iterator.run_global_index_begin()];
+                        const int64_t dim1 = apr_iterator.run_y_begin() * step_size;
+                        const int64_t offset_max_dim1 = std::min(y_num, (apr_iterator.run_y_end() + 1) * step_size);
+
+                        for (int64_t q = dim3; q < offset_max_dim3; ++q) {
+                            for (int64_t k = dim2; k < offset_max_dim2; ++k) {
+                                U* img_row = &img.mesh[k * y_num + q * y_num * x_num];
+                                for (int64_t i = dim1; i < offset_max_dim1; ++i) {
+                                    img_row[i] = (float) run_parts[(i - dim1) >> level_shift];
+                                }
+                            }
                         }
-                    }
+                    } while(apr_iterator.move_to_next_run());
                 }
             }
         }
@@ -74,7 +86,7 @@ public:
         //get depth
         ExtraParticleData<U> depth_parts(apr);
 
-        APRIterator<S> apr_iterator(apr);
+        APRLinearIterator apr_iterator(apr);
         uint64_t particle_number;
 
 #ifdef HAVE_OPENMP
@@ -107,7 +119,7 @@ public:
         //get depth
         ExtraParticleData<U> level_parts(apr);
 
-        APRIterator<S> apr_iterator(apr);
+        APRLinearIterator apr_iterator(apr);
         uint64_t particle_number;
 
 #ifdef HAVE_OPENMP
@@ -135,7 +147,7 @@ public:
         ExtraParticleData<U> type_parts(apr);
 
 
-        APRIterator<S> apr_iterator(apr);
+        APRLinearIterator apr_iterator(apr);
         uint64_t particle_number;
 
 #ifdef HAVE_OPENMP
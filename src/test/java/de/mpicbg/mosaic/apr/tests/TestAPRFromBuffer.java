@@ -0,0 +1,91 @@
+package de.mpicbg.mosaic.apr.tests;
+
+
+import de.mpicbg.mosaic.apr.APRConverterStd;
+import de.mpicbg.mosaic.apr.APRStd;
+import de.mpicbg.mosaic.apr.Loader;
+import org.junit.Test;
+
+import java.io.IOException;
+import java.math.BigInteger;
+import java.nio.ByteBuffer;
+import java.nio.ByteOrder;
+import java.nio.ShortBuffer;
+
+import static org.junit.Assert.assertTrue;
+import static org.junit.Assert.fail;
+
+/**
+ * Converts frames passed as direct ShortBuffers, and checks that buffers too small for the dims are rejected
+ */
+public class TestAPRFromBuffer {
+  static {
+    try {
+      Loader.loadNatives();
+    } catch (IOException e) {
+      System.err.println("Could not load natives.");
+      e.printStackTrace();
+    }
+  }
+
+  private static final int size = 40;
+
+  /**
+   * A bright sphere on a noisy background, y fastest (as MeshData), starting at the given position of the buffer
+   */
+  private static ShortBuffer createFrame(int position) {
+    final ShortBuffer buffer = ByteBuffer.allocateDirect(2 * (position + size * size * size)).order(ByteOrder.nativeOrder()).asShortBuffer();
+    buffer.position(position);
+
+    for(int z = 0; z < size; z++) {
+      for(int x = 0; x < size; x++) {
+        for(int y = 0; y < size; y++) {
+          final int r2 = (x - size/2) * (x - size/2) + (y - size/2) * (y - size/2) + (z - size/2) * (z - size/2);
+          buffer.put((short) (100 + (r2 < 100 ? 1000 : 0) + (x * 7 + y * 13 + z * 3) % 11));
+        }
+      }
+    }
+
+    buffer.position(position);
+    return buffer;
+  }
+
+  @Test
+  public void convertBuffer() {
+    final APRConverterStd converter = new APRConverterStd();
+    final BigInteger dim = BigInteger.valueOf(size);
+
+    final APRStd apr = new APRStd();
+    assertTrue(converter.get_apr_from_buffer(apr, createFrame(0), dim, dim, dim));
+    final long numberParticles = apr.total_number_particles().longValue();
+    assertTrue(numberParticles > 0);
+
+    // the elements from the position of the buffer are converted
+    final APRStd aprPosition = new APRStd();
+    assertTrue(converter.get_apr_from_buffer(aprPosition, createFrame(7), dim, dim, dim));
+    assertTrue(aprPosition.total_number_particles().longValue() == numberParticles);
+  }
+
+  @Test
+  public void rejectShortBuffer() {
+    final APRConverterStd converter = new APRConverterStd();
+    final BigInteger dim = BigInteger.valueOf(size);
+
+    final ShortBuffer frame = createFrame(0);
+    frame.position(1);
+
+    try {
+      converter.get_apr_from_buffer(new APRStd(), frame, dim, dim, dim);
+      fail("A buffer with fewer elements than the image was accepted");
+    } catch (IllegalArgumentException e) {
+      System.out.println("Rejected: " + e.getMessage());
+    }
+
+    try {
+      converter.get_apr_from_buffer(new APRStd(), ShortBuffer.allocate(size * size * size), dim, dim, dim);
+      fail("A non-direct buffer was accepted");
+    } catch (IllegalArgumentException e) {
+      System.out.println("Rejected: " + e.getMessage());
+    }
+  }
+}
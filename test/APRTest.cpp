@@ -6,8 +6,11 @@
 #include "data_structures/APR/APR.hpp"
 #include "data_structures/Mesh/MeshData.hpp"
 #include "algorithm/APRConverter.hpp"
+#include "numerics/APRNumerics.hpp"
+#include "data_structures/APR/APRMortonOrder.hpp"
 #include <utility>
 #include <cmath>
+#include <type_traits>
 
 struct TestData{
 
@@ -21,6 +24,7 @@ struct TestData{
     MeshData<uint16_t> img_z;
 
     std::string filename;
+    std::string apr_filename;
     std::string output_name;
 
 };
@@ -84,6 +88,47 @@ bool check_neighbour_out_of_bounds(APRIterator<uint16_t>& current,uint8_t face){
     return true;
 }
 
+bool compare_apr(APR<uint16_t>& apr,APR<uint16_t>& check_apr){
+    //
+    //  Checks that the APRs have the same particles (level, position, type and intensity) in the same order
+    //
+
+    if(apr.total_number_particles() != check_apr.total_number_particles()){
+        return false;
+    }
+
+    APRIterator<uint16_t> apr_iterator(apr);
+    APRIterator<uint16_t> check_iterator(check_apr);
+
+    for (uint64_t particle_number = 0; particle_number < apr_iterator.total_number_particles(); ++particle_number) {
+        apr_iterator.set_iterator_to_particle_by_number(particle_number);
+        check_iterator.set_iterator_to_particle_by_number(particle_number);
+
+        if((apr_iterator.level() != check_iterator.level()) || (apr_iterator.x() != check_iterator.x()) ||
+           (apr_iterator.y() != check_iterator.y()) || (apr_iterator.z() != check_iterator.z()) ||
+           (apr_iterator.type() != check_iterator.type()) ||
+           (apr.particles_intensities[apr_iterator] != check_apr.particles_intensities[check_iterator])){
+            return false;
+        }
+    }
+
+    return true;
+}
+
+void set_test_parameters(APRParameters& par,TestData& test_data){
+    //
+    //  The parameters the test APR was converted with (without a mask), to convert the test image again, sigma_th and
+    //  sigma_th_max are used as they are (not re-computed from min_signal)
+    //
+
+    par = test_data.apr.parameters;
+    par.mask_file = "";
+    par.min_signal = -1;
+    par.SNR_min = -1;
+    par.input_image_name = test_data.filename;
+    par.input_dir = "";
+}
+
 bool test_apr_input_output(TestData& test_data){
 
     bool success = true;
@@ -644,59 +689,1510 @@ bool test_apr_pipeline(TestData& test_data){
     return success;
 }
 
-std::string get_source_directory_apr(){
-    // returns path to the directory where utils.cpp is stored
+bool test_apr_row_runs(TestData& test_data){
+    //
+    //  Checks the row-run iteration against the particle by particle iteration and the reconstruction using it
+    //
 
-    std::string tests_directory = std::string(__FILE__);
-    tests_directory = tests_directory.substr(0, tests_directory.find_last_of("\\/") + 1);
+    bool success = true;
 
-    return tests_directory;
+    APRIterator<uint16_t> apr_iterator(test_data.apr);
+    APRIterator<uint16_t> particle_iterator(test_data.apr);
+
+    uint64_t particle_counter = 0;
+
+    for (uint64_t level = apr_iterator.level_min(); level <= apr_iterator.level_max(); ++level) {
+        for (uint64_t z = 0; z < apr_iterator.spatial_index_z_max(level); ++z) {
+            for (uint64_t x = 0; x < apr_iterator.spatial_index_x_max(level); ++x) {
+                if(apr_iterator.set_iterator_to_row_begin(level,z,x)) {
+                    do {
+                        ParticleRun run = apr_iterator.get_current_run();
+
+                        if((run.level != level) || (run.z != z) || (run.x != x) || (run.global_index_begin != particle_counter)){
+                            success = false;
+                        }
+
+                        for (uint64_t i = 0; i < apr_iterator.run_length(); ++i) {
+                            particle_iterator.set_iterator_to_particle_by_number(run.global_index_begin + i);
+
+                            if((particle_iterator.level() != level) || (particle_iterator.z() != z) || (particle_iterator.x() != x) ||
+                               (particle_iterator.y() != (run.y_begin + i))){
+                                success = false;
+                            }
+                        }
+
+                        particle_counter += apr_iterator.run_length();
+                    } while(apr_iterator.move_to_next_run());
+                } else if(particle_iterator.particles_zx_end(level,z,x) != 1) {
+                    //empty rows have no particles
+                    success = false;
+                }
+            }
+        }
+    }
+
+    if(particle_counter != apr_iterator.total_number_particles()){
+        success = false;
+    }
+
+    //piecewise constant reconstruction
+    MeshData<uint16_t> recon_pc;
+    test_data.apr.interp_img(recon_pc,test_data.apr.particles_intensities);
+
+    for (size_t i = 0; i < recon_pc.mesh.size(); ++i) {
+        if(recon_pc.mesh[i] != test_data.img_pc.mesh[i]){
+            success = false;
+        }
+    }
+
+    //sampling the particles from the reconstruction gives back the same particles
+    std::vector<MeshData<uint16_t>> img_by_level(apr_iterator.level_max()+1);
+    for (uint64_t level = apr_iterator.level_min(); level <= apr_iterator.level_max(); ++level) {
+        img_by_level[level].init(apr_iterator.spatial_index_y_max(level),apr_iterator.spatial_index_x_max(level),apr_iterator.spatial_index_z_max(level),0);
+
+        for (uint64_t z = 0; z < img_by_level[level].z_num; ++z) {
+            for (uint64_t x = 0; x < img_by_level[level].x_num; ++x) {
+                for (uint64_t y = 0; y < img_by_level[level].y_num; ++y) {
+                    const uint64_t step_size = pow(2,apr_iterator.level_max() - level);
+                    img_by_level[level].at(y,x,z) = recon_pc.at(std::min(y*step_size,(uint64_t)recon_pc.y_num-1),std::min(x*step_size,(uint64_t)recon_pc.x_num-1),std::min(z*step_size,(uint64_t)recon_pc.z_num-1));
+                }
+            }
+        }
+    }
+
+    ExtraParticleData<uint16_t> sampled_parts;
+    test_data.apr.get_parts_from_img(img_by_level,sampled_parts);
+
+    if(sampled_parts.data != test_data.apr.particles_intensities.data){
+        success = false;
+    }
+
+    return success;
 }
 
+bool test_apr_linear_iterator(TestData& test_data){
+    //
+    //  Checks the linear iterator gives the same particles as the full iterator, both sequentially and by random access
+    //
 
-void CreateSmallSphereTest::SetUp(){
+    bool success = true;
 
+    if(!std::is_trivially_copyable<APRLinearIterator>::value){
+        success = false;
+    }
 
-    std::string file_name = get_source_directory_apr() + "files/Apr/sphere_120/sphere_apr.h5";
-    test_data.apr.read_apr(file_name);
+    APRIterator<uint16_t> apr_iterator(test_data.apr);
+    APRLinearIterator linear_iterator(test_data.apr);
 
-    file_name = get_source_directory_apr() + "files/Apr/sphere_120/sphere_level.tif";
-    test_data.img_level = TiffUtils::getMesh<uint16_t>(file_name);
-    file_name = get_source_directory_apr() + "files/Apr/sphere_120/sphere_type.tif";
-    test_data.img_type = TiffUtils::getMesh<uint16_t>(file_name);
-    file_name = get_source_directory_apr() + "files/Apr/sphere_120/sphere_original.tif";
-    test_data.img_original = TiffUtils::getMesh<uint16_t>(file_name);
-    file_name = get_source_directory_apr() + "files/Apr/sphere_120/sphere_pc.tif";
-    test_data.img_pc = TiffUtils::getMesh<uint16_t>(file_name);
-    file_name = get_source_directory_apr() + "files/Apr/sphere_120/sphere_x.tif";
-    test_data.img_x = TiffUtils::getMesh<uint16_t>(file_name);
-    file_name =  get_source_directory_apr() + "files/Apr/sphere_120/sphere_y.tif";
-    test_data.img_y = TiffUtils::getMesh<uint16_t>(file_name);
-    file_name =  get_source_directory_apr() + "files/Apr/sphere_120/sphere_z.tif";
-    test_data.img_z = TiffUtils::getMesh<uint16_t>(file_name);
+    if(linear_iterator.total_number_particles() != apr_iterator.total_number_particles()){
+        success = false;
+    }
 
-    test_data.filename = get_source_directory_apr() + "files/Apr/sphere_120/sphere_original.tif";
-    test_data.output_name = "sphere_small";
+    uint64_t particle_number;
+    for (particle_number = 0; particle_number < apr_iterator.total_number_particles(); ++particle_number) {
+        apr_iterator.set_iterator_to_particle_by_number(particle_number);
+        linear_iterator.set_iterator_to_particle_by_number(particle_number);
+
+        if((linear_iterator.x() != apr_iterator.x()) || (linear_iterator.y() != apr_iterator.y()) || (linear_iterator.z() != apr_iterator.z()) ||
+           (linear_iterator.level() != apr_iterator.level()) || (linear_iterator.type() != apr_iterator.type()) ||
+           (linear_iterator.global_index() != particle_number)){
+            success = false;
+        }
+
+        if(test_data.apr.particles_intensities[linear_iterator] != test_data.apr.particles_intensities[apr_iterator]){
+            success = false;
+        }
+    }
+
+    //random access, and copies keep their position independently
+    APRLinearIterator copy_iterator = linear_iterator;
+    std::srand(1);
+    for (int i = 0; i < 1000; ++i) {
+        particle_number = std::rand() % apr_iterator.total_number_particles();
+
+        apr_iterator.set_iterator_to_particle_by_number(particle_number);
+        linear_iterator.set_iterator_to_particle_by_number(particle_number);
+
+        if((linear_iterator.x() != apr_iterator.x()) || (linear_iterator.y() != apr_iterator.y()) || (linear_iterator.z() != apr_iterator.z()) ||
+           (linear_iterator.level() != apr_iterator.level())){
+            success = false;
+        }
+
+        copy_iterator = linear_iterator;
+        copy_iterator.set_iterator_to_particle_by_number((particle_number + 1) % apr_iterator.total_number_particles());
+
+        if(linear_iterator.global_index() != particle_number){
+            success = false;
+        }
+    }
+
+    return success;
 }
 
-TEST_F(CreateSmallSphereTest, APR_ITERATION) {
+bool test_apr_batch_random_access(TestData& test_data){
+    //
+    //  Checks the batch search by global coordinate gives the same particles as searching point by point
+    //
 
-//test iteration
-ASSERT_TRUE(test_apr_iterate(test_data));
+    bool success = true;
+
+    APRIterator<uint16_t> apr_iterator(test_data.apr);
+
+    const uint64_t number_points = 10000;
+    std::vector<float> x(number_points),y(number_points),z(number_points);
+
+    std::srand(5);
+    for (uint64_t i = 0; i < number_points; ++i) {
+        //fractions below 0.5 so the rounding stays inside the image
+        x[i] = (std::rand() % test_data.apr.orginal_dimensions(1)) + (std::rand() % 50)/100.0f;
+        y[i] = (std::rand() % test_data.apr.orginal_dimensions(0)) + (std::rand() % 50)/100.0f;
+        z[i] = (std::rand() % test_data.apr.orginal_dimensions(2)) + (std::rand() % 50)/100.0f;
+    }
+
+    //out of bounds points
+    x[0] = -1;
+    y[1] = test_data.apr.orginal_dimensions(0) + 1;
+    z[2] = test_data.apr.orginal_dimensions(2);
+
+    std::vector<uint64_t> global_index;
+    test_data.apr.apr_access.find_particles_by_global_coordinate(x,y,z,global_index);
+
+    std::vector<uint16_t> values;
+    test_data.apr.apr_access.sample_particles_by_global_coordinate(x,y,z,test_data.apr.particles_intensities,values);
+
+    if((global_index.size() != number_points) || (values.size() != number_points)){
+        return false;
+    }
+
+    for (uint64_t i = 0; i < 3; ++i) {
+        if((global_index[i] != UINT64_MAX) || (values[i] != 0)){
+            success = false;
+        }
+    }
+
+    for (uint64_t i = 3; i < number_points; ++i) {
+        if(!apr_iterator.set_iterator_by_global_coordinate(x[i],y[i],z[i])){
+            success = false;
+            continue;
+        }
+
+        ParticleCell particle_cell = apr_iterator.get_current_particle_cell();
+
+        if((global_index[i] != particle_cell.global_index) || (values[i] != test_data.apr.particles_intensities.data[particle_cell.global_index])){
+            success = false;
+        }
+    }
 
+    return success;
 }
 
-TEST_F(CreateSmallSphereTest, APR_NEIGHBOUR_ACCESS) {
+bool test_apr_roi(TestData& test_data){
+    //
+    //  Checks the particle runs of a region of interest against a sweep over all particles
+    //
 
-//test iteration
-ASSERT_TRUE(test_apr_neighbour_access(test_data));
+    bool success = true;
+
+    APRIterator<uint16_t> apr_iterator(test_data.apr);
+
+    const uint64_t y_num = test_data.apr.orginal_dimensions(0);
+    const uint64_t x_num = test_data.apr.orginal_dimensions(1);
+    const uint64_t z_num = test_data.apr.orginal_dimensions(2);
+
+    std::vector<ImageROI> rois = {{0,y_num,0,x_num,0,z_num},{10,31,5,60,17,18},{y_num/2,y_num+20,x_num/3,x_num,0,z_num/4},{3,3,0,x_num,0,z_num}};
+
+    std::srand(7);
+    for (int i = 0; i < 5; ++i) {
+        ImageROI roi;
+        roi.y_begin = std::rand() % y_num; roi.y_end = roi.y_begin + 1 + std::rand() % (y_num - roi.y_begin);
+        roi.x_begin = std::rand() % x_num; roi.x_end = roi.x_begin + 1 + std::rand() % (x_num - roi.x_begin);
+        roi.z_begin = std::rand() % z_num; roi.z_end = roi.z_begin + 1 + std::rand() % (z_num - roi.z_begin);
+        rois.push_back(roi);
+    }
+
+    for (auto const &roi : rois) {
+        std::vector<ParticleRun> runs;
+        test_data.apr.apr_access.find_particle_runs_in_roi(roi,runs);
+
+        //the particles whose particle cell intersects the box
+        std::vector<uint64_t> check_particles;
+        uint64_t particle_number;
+        for (particle_number = 0; particle_number < apr_iterator.total_number_particles(); ++particle_number) {
+            apr_iterator.set_iterator_to_particle_by_number(particle_number);
+            const unsigned int shift = apr_iterator.level_max() - apr_iterator.level();
+
+            const bool in_y = (((uint64_t)apr_iterator.y() << shift) < roi.y_end) && ((((uint64_t)apr_iterator.y() + 1) << shift) > roi.y_begin);
+            const bool in_x = (((uint64_t)apr_iterator.x() << shift) < roi.x_end) && ((((uint64_t)apr_iterator.x() + 1) << shift) > roi.x_begin);
+            const bool in_z = (((uint64_t)apr_iterator.z() << shift) < roi.z_end) && ((((uint64_t)apr_iterator.z() + 1) << shift) > roi.z_begin);
+
+            if(in_y && in_x && in_z && (roi.y_begin < roi.y_end)){
+                check_particles.push_back(particle_number);
+            }
+        }
+
+        std::vector<uint64_t> roi_particles;
+        for (auto const &run : runs) {
+            for (uint64_t y = run.y_begin; y <= run.y_end; ++y) {
+                const uint64_t global_index = run.global_index_begin + (y - run.y_begin);
+                roi_particles.push_back(global_index);
+
+                apr_iterator.set_iterator_to_particle_by_number(global_index);
+                if((apr_iterator.level() != run.level) || (apr_iterator.x() != run.x) || (apr_iterator.z() != run.z) || (apr_iterator.y() != y)){
+                    success = false;
+                }
+            }
+        }
+
+        if((roi_particles != check_particles) || (APRAccess::number_particles_in_runs(runs) != check_particles.size())){
+            success = false;
+        }
+    }
 
+    return success;
 }
 
-TEST_F(CreateSmallSphereTest, APR_INPUT_OUTPUT) {
+bool test_apr_crop(TestData& test_data){
+    //
+    //  Checks crops against the particle cells and the pixels of the original APR
+    //
 
-//test iteration
-    ASSERT_TRUE(test_apr_input_output(test_data));
+    bool success = true;
+
+    APRIterator<uint16_t> apr_iterator(test_data.apr);
+
+    const uint64_t y_num = test_data.apr.orginal_dimensions(0);
+    const uint64_t x_num = test_data.apr.orginal_dimensions(1);
+    const uint64_t z_num = test_data.apr.orginal_dimensions(2);
+    const uint64_t cell_size = ((uint64_t)1) << (apr_iterator.level_max() - apr_iterator.level_min());
+
+    std::vector<ImageROI> rois = {{0,y_num,0,x_num,0,z_num},{10,31,5,60,17,18},{y_num/2,y_num+20,x_num/3,x_num,0,z_num/4},{37,90,41,77,53,101},
+                                  {40,50,40,50,40,50}};
+
+    for (auto const &roi : rois) {
+        APR<uint16_t> apr_crop;
+        const ImageROI aligned = test_data.apr.crop(roi,apr_crop);
+
+        if((aligned.y_begin % cell_size) || (aligned.x_begin % cell_size) || (aligned.z_begin % cell_size) ||
+           (aligned.y_begin > roi.y_begin) || (aligned.y_end != std::min(roi.y_end,y_num))){
+            success = false;
+        }
+
+        std::vector<ParticleRun> runs;
+        test_data.apr.apr_access.find_particle_runs_in_roi(aligned,runs);
+
+        if((apr_crop.total_number_particles() != APRAccess::number_particles_in_runs(runs)) ||
+           (apr_crop.particles_intensities.data.size() != apr_crop.total_number_particles()) ||
+           (apr_crop.orginal_dimensions(0) != (aligned.y_end - aligned.y_begin))){
+            success = false;
+        }
+
+        //every particle cell of the crop is a particle cell of the original with the same intensity and type
+        APRIterator<uint16_t> crop_iterator(apr_crop);
+        uint64_t particle_number;
+        for (particle_number = 0; particle_number < crop_iterator.total_number_particles(); ++particle_number) {
+            crop_iterator.set_iterator_to_particle_by_number(particle_number);
+            const unsigned int shift = crop_iterator.level_max() - crop_iterator.level();
+
+            ParticleCell particle_cell;
+            particle_cell.level = crop_iterator.level();
+            particle_cell.y = crop_iterator.y() + (aligned.y_begin >> shift);
+            particle_cell.x = crop_iterator.x() + (aligned.x_begin >> shift);
+            particle_cell.z = crop_iterator.z() + (aligned.z_begin >> shift);
+
+            if(!apr_iterator.set_iterator_by_particle_cell(particle_cell)){
+                success = false;
+                continue;
+            }
+
+            if((test_data.apr.particles_intensities[apr_iterator] != apr_crop.particles_intensities[crop_iterator]) ||
+               (apr_iterator.type() != crop_iterator.type())){
+                success = false;
+            }
+        }
+
+        //the crop covers every pixel of the box with the particle cell covering it in the original
+        std::vector<float> x_crop,y_crop,z_crop,x_org,y_org,z_org;
+        for (uint64_t z = aligned.z_begin; z < aligned.z_end; z += 3) {
+            for (uint64_t x = aligned.x_begin; x < aligned.x_end; ++x) {
+                for (uint64_t y = aligned.y_begin; y < aligned.y_end; ++y) {
+                    x_org.push_back(x); y_org.push_back(y); z_org.push_back(z);
+                    x_crop.push_back(x - aligned.x_begin); y_crop.push_back(y - aligned.y_begin); z_crop.push_back(z - aligned.z_begin);
+                }
+            }
+        }
+
+        std::vector<uint16_t> values_org,values_crop;
+        test_data.apr.apr_access.sample_particles_by_global_coordinate(x_org,y_org,z_org,test_data.apr.particles_intensities,values_org,(uint16_t)0);
+        apr_crop.apr_access.sample_particles_by_global_coordinate(x_crop,y_crop,z_crop,apr_crop.particles_intensities,values_crop,(uint16_t)1);
+
+        if(values_org != values_crop){
+            success = false;
+        }
+
+        //the neighbours in the crop are the neighbours in the original that are inside the box (small crops have levels
+        //with fewer than 3 particle cells in x or z)
+        auto neighbour_in_box = [&aligned](APRIterator<uint16_t>& it) {
+            //(the particle cells of the crop are the ones starting inside the box)
+            const unsigned int shift = it.level_max() - it.level();
+            return ((((uint64_t)it.y()) << shift) >= aligned.y_begin) && ((((uint64_t)it.y()) << shift) < aligned.y_end) &&
+                   ((((uint64_t)it.x()) << shift) >= aligned.x_begin) && ((((uint64_t)it.x()) << shift) < aligned.x_end) &&
+                   ((((uint64_t)it.z()) << shift) >= aligned.z_begin) && ((((uint64_t)it.z()) << shift) < aligned.z_end);
+        };
+
+        APRIterator<uint16_t> crop_neighbour_iterator(apr_crop);
+        APRIterator<uint16_t> neighbour_iterator(test_data.apr);
+        for (particle_number = 0; particle_number < crop_iterator.total_number_particles(); ++particle_number) {
+            crop_iterator.set_iterator_to_particle_by_number(particle_number);
+            const unsigned int shift = crop_iterator.level_max() - crop_iterator.level();
+
+            ParticleCell particle_cell;
+            particle_cell.level = crop_iterator.level();
+            particle_cell.y = crop_iterator.y() + (aligned.y_begin >> shift);
+            particle_cell.x = crop_iterator.x() + (aligned.x_begin >> shift);
+            particle_cell.z = crop_iterator.z() + (aligned.z_begin >> shift);
+            apr_iterator.set_iterator_by_particle_cell(particle_cell);
+
+            for (int direction = 0; direction < 6; ++direction) {
+                crop_iterator.find_neighbours_in_direction(direction);
+                apr_iterator.find_neighbours_in_direction(direction);
+
+                std::vector<uint16_t> neighbours_org,neighbours_crop;
+
+                for (int index = 0; index < apr_iterator.number_neighbours_in_direction(direction); ++index) {
+                    if(neighbour_iterator.set_neighbour_iterator(apr_iterator, direction, index) &&
+                       neighbour_in_box(neighbour_iterator)){
+                        neighbours_org.push_back(test_data.apr.particles_intensities[neighbour_iterator]);
+                        neighbours_org.push_back(neighbour_iterator.level());
+                    }
+                }
+
+                for (int index = 0; index < crop_iterator.number_neighbours_in_direction(direction); ++index) {
+                    if(crop_neighbour_iterator.set_neighbour_iterator(crop_iterator, direction, index)){
+                        if((crop_neighbour_iterator.x() >= crop_neighbour_iterator.spatial_index_x_max(crop_neighbour_iterator.level())) ||
+                           (crop_neighbour_iterator.z() >= crop_neighbour_iterator.spatial_index_z_max(crop_neighbour_iterator.level()))){
+                            success = false;
+                        }
+                        neighbours_crop.push_back(apr_crop.particles_intensities[crop_neighbour_iterator]);
+                        neighbours_crop.push_back(crop_neighbour_iterator.level());
+                    }
+                }
+
+                if(neighbours_org != neighbours_crop){
+                    success = false;
+                }
+            }
+        }
+
+        ExtraParticleData<uint16_t> crop_parts;
+        test_data.apr.crop_parts(roi,test_data.apr.particles_intensities,crop_parts);
+
+        if(crop_parts.data != apr_crop.particles_intensities.data){
+            success = false;
+        }
+    }
+
+    return success;
+}
+
+bool test_apr_tiled_conversion(TestData& test_data){
+    //
+    //  Converts the image in tiles and compares with the APR of the full image
+    //
+
+    bool success = true;
+
+    APRConverter<uint16_t> apr_converter;
+    set_test_parameters(apr_converter.par,test_data);
+
+    const MeshData<uint16_t>& img = test_data.img_original;
+
+    std::function<bool(const APRTile&,MeshData<uint16_t>&)> load_tile = [&img](const APRTile& tile,MeshData<uint16_t>& tile_image){
+        tile_image.init(tile.box.y_end - tile.box.y_begin,tile.box.x_end - tile.box.x_begin,tile.box.z_end - tile.box.z_begin);
+        for (size_t z = 0; z < tile_image.z_num; ++z) {
+            for (size_t x = 0; x < tile_image.x_num; ++x) {
+                for (size_t y = 0; y < tile_image.y_num; ++y) {
+                    tile_image(y,x,z) = img.at(y + tile.box.y_begin,x + tile.box.x_begin,z + tile.box.z_begin);
+                }
+            }
+        }
+        return true;
+    };
+
+    //one tile, and tiles smaller than the image with an overlap covering the filters
+    std::vector<uint64_t> tile_sizes = {1000,32};
+
+    for (auto const tile_size : tile_sizes) {
+        APRTiling tiling = apr_converter.get_tiling(img.y_num,img.x_num,img.z_num,tile_size,tile_size,tile_size,32);
+
+        if(!tiling.valid() || ((tile_size < img.y_num) && (tiling.tiles.size() < 2))){
+            success = false;
+        }
+
+        APR<uint16_t> apr;
+        if(!apr_converter.get_apr_tiled(apr,tiling,load_tile)){
+            success = false;
+            continue;
+        }
+
+        if(!compare_apr(apr,test_data.apr)){
+            success = false;
+        }
+    }
+
+    //tiles not on the grid of the largest particle cells are rejected
+    APRTiling tiling = apr_converter.get_tiling(img.y_num,img.x_num,img.z_num,32,32,32,32);
+    tiling.tiles[1].core.y_begin += 1;
+    APR<uint16_t> apr;
+    if(tiling.valid() || apr_converter.get_apr_tiled(apr,tiling,load_tile)){
+        success = false;
+    }
+
+    //as are overlapping cores (with the same total number of pixels)
+    tiling = apr_converter.get_tiling(img.y_num,img.x_num,img.z_num,32,32,32,32);
+    tiling.tiles[1].core = tiling.tiles[0].core;
+    if(tiling.valid()){
+        success = false;
+    }
+
+    //a tile that can not be loaded stops the conversion, the converter can be used again afterwards
+    tiling = apr_converter.get_tiling(img.y_num,img.x_num,img.z_num,32,32,32,32);
+    std::function<bool(const APRTile&,MeshData<uint16_t>&)> fail_tile = [&load_tile,&tiling](const APRTile& tile,MeshData<uint16_t>& tile_image){
+        return (&tile != &tiling.tiles[1]) && load_tile(tile,tile_image);
+    };
+    APR<uint16_t> apr_failed;
+    if(apr_converter.get_apr_tiled(apr_failed,tiling,fail_tile)){
+        success = false;
+    }
+    APR<uint16_t> apr_again;
+    if(!apr_converter.get_apr_tiled(apr_again,tiling,load_tile) || !compare_apr(apr_again,test_data.apr)){
+        success = false;
+    }
+
+    return success;
+}
+
+bool test_apr_streaming_conversion(TestData& test_data){
+    //
+    //  Converts the tiff file in z-slabs within a memory budget and compares with converting the full image
+    //
+
+    bool success = true;
+
+    APRConverter<uint16_t> apr_converter;
+    set_test_parameters(apr_converter.par,test_data);
+
+    APR<uint16_t> apr_full;
+    if(!apr_converter.get_apr(apr_full)){
+        return false;
+    }
+
+    const MeshData<uint16_t>& img = test_data.img_original;
+
+    //the smallest budget (in steps of 64kB) that allows a slab, too small to convert the image in one slab
+    uint64_t memory_budget = 0;
+    APRTiling tiling;
+    while(tiling.tiles.empty() && (memory_budget < 100*img.mesh.size())){
+        memory_budget += 64*1024;
+        tiling = apr_converter.get_slab_tiling(img.y_num,img.x_num,img.z_num,memory_budget,sizeof(uint16_t));
+    }
+
+    if(!tiling.valid() || (tiling.tiles.size() < 2)){
+        success = false;
+    }
+
+    APR<uint16_t> apr;
+    if(!apr_converter.get_apr_streaming(apr,memory_budget)){
+        return false;
+    }
+
+    if(!compare_apr(apr,apr_full)){
+        success = false;
+    }
+
+    //a budget that does not fit a slab is rejected
+    APR<uint16_t> apr_small;
+    if(apr_converter.get_apr_streaming(apr_small,memory_budget - 64*1024)){
+        success = false;
+    }
+
+    //the automatic parameters from a few (non-adjacent) selected slices, or a single one, are the ones of the full image
+    for (const double number_slices : {1.0, 4.0}) {
+        APRConverter<uint16_t> converter_full;
+        set_test_parameters(converter_full.par,test_data);
+        converter_full.par.Ip_th = -1;
+        converter_full.par.lambda = -1;
+        converter_full.par.total_required_pixel = number_slices*img.y_num*img.x_num;
+
+        APRConverter<uint16_t> converter_streaming;
+        converter_streaming.par = converter_full.par;
+
+        APR<uint16_t> apr_auto_full;
+        APR<uint16_t> apr_auto_streaming;
+
+        if(!converter_full.get_apr(apr_auto_full) || !converter_streaming.get_apr_streaming(apr_auto_streaming,memory_budget)){
+            success = false;
+            continue;
+        }
+
+        const APRParameters& a = converter_full.par;
+        const APRParameters& b = converter_streaming.par;
+        if((a.Ip_th != b.Ip_th) || (a.sigma_th != b.sigma_th) || (a.lambda != b.lambda) ||
+           (a.noise_sd_estimate != b.noise_sd_estimate) || (a.background_intensity_estimate != b.background_intensity_estimate) ||
+           (apr_auto_full.total_number_particles() != apr_auto_streaming.total_number_particles())){
+            success = false;
+        }
+    }
+
+    return success;
+}
+
+bool test_apr_workspace_reuse(TestData& test_data){
+    //
+    //  Converts a series of images with one converter re-using its workspace, and compares with separate conversions
+    //
+
+    bool success = true;
+
+    const MeshData<uint16_t>& img = test_data.img_original;
+
+    //the frames, the second one smaller (so the buffers have to be re-allocated in between)
+    std::vector<MeshData<uint16_t>> frames(3);
+    frames[0].init(img);
+    std::copy(img.mesh.begin(),img.mesh.end(),frames[0].mesh.begin());
+    frames[1].init(img.y_num/2,img.x_num,img.z_num);
+    for (size_t z = 0; z < frames[1].z_num; ++z) {
+        for (size_t x = 0; x < frames[1].x_num; ++x) {
+            for (size_t y = 0; y < frames[1].y_num; ++y) {
+                frames[1].at(y,x,z) = img.at(y,x,z);
+            }
+        }
+    }
+    frames[2].init(img);
+    std::copy(img.mesh.begin(),img.mesh.end(),frames[2].mesh.begin());
+
+    APRConverter<uint16_t> apr_converter;
+    set_test_parameters(apr_converter.par,test_data);
+    apr_converter.reuse_workspace = true;
+
+    APR<uint16_t> apr;
+
+    for (size_t f = 0; f < frames.size(); ++f) {
+        MeshData<uint16_t> check_frame(frames[f],true);
+
+        APRConverter<uint16_t> check_converter;
+        check_converter.par = apr_converter.par;
+        APR<uint16_t> check_apr;
+        check_converter.get_apr_method(check_apr,check_frame);
+
+        if(!apr_converter.get_apr_method(apr,frames[f]) || !compare_apr(apr,check_apr)){
+            success = false;
+        }
+
+        //the input image is handed back unchanged
+        if(!std::equal(frames[f].mesh.begin(),frames[f].mesh.end(),check_frame.mesh.begin()) || (frames[f].y_num != check_frame.y_num)){
+            success = false;
+        }
+    }
+
+    //the first frame is the full image
+    apr_converter.get_apr_method(apr,frames[0]);
+    if(!compare_apr(apr,test_data.apr)){
+        success = false;
+    }
+
+    return success;
+}
+
+bool test_auto_parameters(TestData& test_data){
+    //
+    //  Checks that the automatic parameters do not depend on the number of threads, and that the number of pixels
+    //  they are estimated from can be set
+    //
+
+    bool success = true;
+
+    const MeshData<uint16_t>& img = test_data.img_original;
+
+    auto compute_parameters = [&img](const double total_required_pixel, const int number_threads) {
+#ifdef HAVE_OPENMP
+        const int max_threads = omp_get_max_threads();
+        omp_set_num_threads(number_threads);
+#else
+        (void) number_threads;
+#endif
+        APRConverter<uint16_t> apr_converter;
+        apr_converter.par.Ip_th = -1;
+        apr_converter.par.SNR_min = -1;
+        apr_converter.par.lambda = -1;
+        apr_converter.par.min_signal = -1;
+        apr_converter.par.total_required_pixel = total_required_pixel;
+
+        MeshData<uint16_t> input_image(img,true);
+        APR<uint16_t> apr;
+        apr_converter.get_apr(apr,input_image);
+#ifdef HAVE_OPENMP
+        omp_set_num_threads(max_threads);
+#endif
+        return apr_converter.par;
+    };
+
+    auto same_parameters = [](const APRParameters& a, const APRParameters& b) {
+        return (a.Ip_th == b.Ip_th) && (a.sigma_th == b.sigma_th) && (a.sigma_th_max == b.sigma_th_max) &&
+               (a.lambda == b.lambda) && (a.noise_sd_estimate == b.noise_sd_estimate) &&
+               (a.background_intensity_estimate == b.background_intensity_estimate);
+    };
+
+    const double all_slices = 1.0*img.y_num*img.x_num*img.z_num;
+    const double four_slices = 4.0*img.y_num*img.x_num;
+
+    const APRParameters all_par = compute_parameters(all_slices, 1);
+    const APRParameters four_par = compute_parameters(four_slices, 1);
+
+    //the default budget covers the whole (small) test image
+    if(!same_parameters(all_par, compute_parameters(APRParameters().total_required_pixel, 1))){
+        success = false;
+    }
+
+    //the histogram and the patches are computed in parallel, with the same results
+    for (int number_threads = 2; number_threads <= 4; ++number_threads) {
+        if(!same_parameters(all_par, compute_parameters(all_slices, number_threads)) ||
+           !same_parameters(four_par, compute_parameters(four_slices, number_threads))){
+            success = false;
+        }
+    }
+
+    if((four_par.Ip_th <= 0) || (four_par.sigma_th <= 0) || (four_par.noise_sd_estimate <= 0)){
+        success = false;
+    }
+
+    return success;
+}
+
+bool test_apr_from_buffer(TestData& test_data){
+    //
+    //  Converts the image from caller owned buffers (contiguous and strided) and compares with the APR of the image
+    //
+
+    bool success = true;
+
+    const MeshData<uint16_t>& img = test_data.img_original;
+
+    APRConverter<uint16_t> apr_converter;
+    set_test_parameters(apr_converter.par,test_data);
+
+    //contiguous buffer (used in place, and not modified)
+    std::vector<uint16_t> buffer(img.mesh.begin(),img.mesh.end());
+
+    APR<uint16_t> apr;
+    if(!apr_converter.get_apr_from_buffer(apr,buffer.data(),img.y_num,img.x_num,img.z_num,false) || !compare_apr(apr,test_data.apr)){
+        success = false;
+    }
+
+    if(!std::equal(buffer.begin(),buffer.end(),img.mesh.begin())){
+        success = false;
+    }
+
+    //x fastest (e.g. a C ordered [z][y][x] array), copied
+    std::vector<uint16_t> buffer_x_fastest(img.mesh.size());
+    for (size_t z = 0; z < img.z_num; ++z) {
+        for (size_t x = 0; x < img.x_num; ++x) {
+            for (size_t y = 0; y < img.y_num; ++y) {
+                buffer_x_fastest[z*img.x_num*img.y_num + y*img.x_num + x] = img.at(y,x,z);
+            }
+        }
+    }
+
+    APR<uint16_t> apr_strided;
+    if(!apr_converter.get_apr_from_buffer(apr_strided,buffer_x_fastest.data(),img.y_num,img.x_num,img.z_num,false,img.x_num,1,img.x_num*img.y_num) ||
+       !compare_apr(apr_strided,test_data.apr)){
+        success = false;
+    }
+
+    return success;
+}
+
+bool test_apr_odd_dimensions(TestData& test_data){
+    //
+    //  Converts sub-images with odd sizes (the highest level rows of the last particle cells lie partly outside the
+    //  image) and checks that the particle cells cover every pixel exactly once, and agree with the reconstruction
+    //
+
+    bool success = true;
+
+    const MeshData<uint16_t>& img = test_data.img_original;
+
+    APRConverter<uint16_t> apr_converter;
+    set_test_parameters(apr_converter.par,test_data);
+
+    const std::vector<std::vector<uint64_t>> sizes = {{64,53,45},{61,64,37},{57,39,64},{35,33,31}};
+
+    for (auto const &size : sizes) {
+        MeshData<uint16_t> input_image(size[0],size[1],size[2]);
+        for (size_t z = 0; z < input_image.z_num; ++z) {
+            for (size_t x = 0; x < input_image.x_num; ++x) {
+                for (size_t y = 0; y < input_image.y_num; ++y) {
+                    input_image(y,x,z) = img.at(y + 20,x + 20,z + 20);
+                }
+            }
+        }
+
+        APR<uint16_t> apr;
+        if(!apr_converter.get_apr(apr,input_image)){
+            success = false;
+            continue;
+        }
+
+        //the particle cells (clipped to the image) painted with their intensities
+        MeshData<uint16_t> coverage(size[0],size[1],size[2],0);
+        MeshData<uint16_t> painted(size[0],size[1],size[2],0);
+
+        APRIterator<uint16_t> apr_iterator(apr);
+        for (uint64_t particle_number = 0; particle_number < apr_iterator.total_number_particles(); ++particle_number) {
+            apr_iterator.set_iterator_to_particle_by_number(particle_number);
+            const unsigned int shift = apr_iterator.level_max() - apr_iterator.level();
+
+            if((apr_iterator.y() >= apr_iterator.spatial_index_y_max(apr_iterator.level())) ||
+               (apr_iterator.x() >= apr_iterator.spatial_index_x_max(apr_iterator.level())) ||
+               (apr_iterator.z() >= apr_iterator.spatial_index_z_max(apr_iterator.level()))){
+                success = false;
+                continue;
+            }
+
+            const uint64_t y_begin = ((uint64_t)apr_iterator.y()) << shift;
+            const uint64_t x_begin = ((uint64_t)apr_iterator.x()) << shift;
+            const uint64_t z_begin = ((uint64_t)apr_iterator.z()) << shift;
+            const uint64_t cell_size = ((uint64_t)1) << shift;
+
+            for (uint64_t z = z_begin; z < std::min(z_begin + cell_size,size[2]); ++z) {
+                for (uint64_t x = x_begin; x < std::min(x_begin + cell_size,size[1]); ++x) {
+                    for (uint64_t y = y_begin; y < std::min(y_begin + cell_size,size[0]); ++y) {
+                        coverage(y,x,z)++;
+                        painted(y,x,z) = apr.particles_intensities[apr_iterator];
+                    }
+                }
+            }
+        }
+
+        MeshData<uint16_t> recon;
+        apr.interp_img(recon,apr.particles_intensities);
+
+        for (size_t i = 0; i < coverage.mesh.size(); ++i) {
+            if((coverage.mesh[i] != 1) || (painted.mesh[i] != recon.mesh[i])){
+                success = false;
+                break;
+            }
+        }
+    }
+
+    return success;
+}
+
+bool test_apr_filter_cache(TestData& test_data){
+    //
+    //  Converts the image repeatedly with the filter cache while changing the parameters, and compares with converting
+    //  from scratch, the filters are only re-computed if the image or the parameters they depend on change
+    //
+
+    bool success = true;
+
+    MeshData<uint16_t> img(test_data.img_original,true);
+
+    APRConverter<uint16_t> apr_converter;
+    set_test_parameters(apr_converter.par,test_data);
+    apr_converter.cache_filters = true;
+
+    const APRParameters base_par = apr_converter.par;
+
+    auto number_filter_runs = [&apr_converter]() {
+        const auto& names = apr_converter.method_timer.timing_names;
+        return std::count(names.begin(), names.end(), "compute_gradient_magnitude_using_bsplines");
+    };
+
+    //parameter changes, and the number of filter runs expected after each conversion
+    struct SweepStep {
+        float rel_error;
+        float sigma_th_factor;
+        float Ip_th_offset;
+        bool change_image;
+        long filter_runs;
+    };
+    const std::vector<SweepStep> steps = {{base_par.rel_error, 1, 0, false, 1},
+                                          {base_par.rel_error*0.5f, 1, 0, false, 1},
+                                          {base_par.rel_error*2, 1, 0, false, 1},
+                                          {base_par.rel_error, 2, 0, false, 1},
+                                          {base_par.rel_error, 0.5, 0, false, 1},
+                                          {base_par.rel_error, 1, 10, false, 2},
+                                          {base_par.rel_error*0.5f, 1, 10, false, 2},
+                                          {base_par.rel_error, 1, 10, true, 3}};
+
+    for (auto const &step : steps) {
+        if(step.change_image){
+            img.mesh[img.mesh.size()/2] += 100;
+        }
+
+        apr_converter.par = base_par;
+        apr_converter.par.rel_error = step.rel_error;
+        apr_converter.par.sigma_th = base_par.sigma_th*step.sigma_th_factor;
+        apr_converter.par.Ip_th = base_par.Ip_th + step.Ip_th_offset;
+
+        APR<uint16_t> apr;
+        if(!apr_converter.get_apr_method(apr,img) || (number_filter_runs() != step.filter_runs)){
+            success = false;
+        }
+
+        APRConverter<uint16_t> check_converter;
+        check_converter.par = apr_converter.par;
+        APR<uint16_t> check_apr;
+        MeshData<uint16_t> check_img(img,true);
+        check_converter.get_apr_method(check_apr,check_img);
+
+        if(!compare_apr(apr,check_apr)){
+            success = false;
+        }
+    }
+
+    //without the cache the filters are always run
+    apr_converter.cache_filters = false;
+    APR<uint16_t> apr;
+    apr_converter.get_apr_method(apr,img);
+    apr_converter.get_apr_method(apr,img);
+    if(number_filter_runs() != 5){
+        success = false;
+    }
+
+    return success;
+}
+
+bool test_preprocess_input(TestData& test_data){
+    //
+    //  Checks the fused pre-pass (normalize, offset, threshold and convert) against the separate steps, and the normalized
+    //  conversion against normalizing the image first
+    //
+
+    bool success = true;
+
+    MeshData<uint16_t> img(test_data.img_original,true);
+    //pixels the offset takes past the maximum of the type
+    img.mesh[0] = 65535;
+    img.mesh[1] = 65500;
+
+    const float offset = 100;
+    const float threshold = 1000 + offset;
+
+    MeshData<uint16_t> image_temp(img.y_num,img.x_num,img.z_num);
+    preprocess_image<uint16_t,uint16_t,false>(img,image_temp,InputNormalization<uint16_t>{0,1,1},offset,threshold);
+
+    MeshData<float> image_temp_float(img.y_num,img.x_num,img.z_num);
+    preprocess_image<float,uint16_t,false>(img,image_temp_float,InputNormalization<uint16_t>{0,1,1},offset,threshold);
+
+    for (size_t i = 0; i < img.mesh.size(); ++i) {
+        const float value = std::min(img.mesh[i] + offset, 65535.0f);
+        if((image_temp.mesh[i] != (uint16_t) std::max(value, threshold)) ||
+           (image_temp_float.mesh[i] != std::max(img.mesh[i] + offset, threshold))){
+            success = false;
+        }
+    }
+
+    //normalized conversion, the input image is rescaled in place, also with the automatic parameters computed from a
+    //few (non-adjacent) slices or a single one
+    MeshData<uint16_t> check_image(test_data.img_original,true);
+    MinMax<uint16_t> mm = getMinMax(check_image);
+    const uint16_t max_value = 0.8*65535;
+    for (size_t i = 0; i < check_image.mesh.size(); ++i) {
+        check_image.mesh[i] = (check_image.mesh[i] - mm.min) * max_value / (mm.max - mm.min);
+    }
+
+    const double slice_size = 1.0*img.y_num*img.x_num;
+    for (const double total_required_pixel : {APRParameters().total_required_pixel, slice_size, 4*slice_size}) {
+        APRConverter<uint16_t> apr_converter;
+        apr_converter.par.normalized_input = true;
+        apr_converter.par.lambda = 3;
+        apr_converter.par.rel_error = 0.1;
+        apr_converter.par.total_required_pixel = total_required_pixel;
+
+        APRConverter<uint16_t> check_converter;
+        check_converter.par = apr_converter.par;
+        check_converter.par.normalized_input = false;
+
+        MeshData<uint16_t> input_image(test_data.img_original,true);
+        APR<uint16_t> apr;
+        apr_converter.get_apr(apr,input_image);
+
+        if(!std::equal(check_image.mesh.begin(),check_image.mesh.end(),input_image.mesh.begin())){
+            success = false;
+        }
+
+        MeshData<uint16_t> check_input(check_image,true);
+        APR<uint16_t> check_apr;
+        check_converter.get_apr(check_apr,check_input);
+
+        if((apr.total_number_particles() != check_apr.total_number_particles()) ||
+           !std::equal(apr.particles_intensities.data.begin(),apr.particles_intensities.data.end(),check_apr.particles_intensities.data.begin()) ||
+           (apr_converter.par.Ip_th != check_converter.par.Ip_th) || (apr_converter.par.sigma_th != check_converter.par.sigma_th) ||
+           (apr_converter.par.noise_sd_estimate != check_converter.par.noise_sd_estimate) ||
+           (apr_converter.par.background_intensity_estimate != check_converter.par.background_intensity_estimate)){
+            success = false;
+        }
+    }
+
+    return success;
+}
+
+bool test_fused_filter_passes(TestData& test_data){
+    //
+    //  Converts the image with the filter passes fused and separate, the APRs are the same, and the stages with their
+    //  memory traffic are recorded (fusing saves traffic)
+    //
+
+    bool success = true;
+
+    auto convert = [&test_data](const bool fuse_filter_passes, APR<uint16_t>& apr, uint64_t& bytes) {
+        APRConverter<uint16_t> apr_converter;
+        set_test_parameters(apr_converter.par,test_data);
+        apr_converter.fuse_filter_passes = fuse_filter_passes;
+
+        MeshData<uint16_t> input_image(test_data.img_original,true);
+        apr_converter.get_apr_method(apr,input_image);
+
+        bytes = 0;
+        for (auto const &stage : apr_converter.filter_stages) {
+            bytes += stage.bytes;
+        }
+    };
+
+    APR<uint16_t> apr;
+    APR<uint16_t> fused_apr;
+    uint64_t bytes;
+    uint64_t fused_bytes;
+    convert(false,apr,bytes);
+    convert(true,fused_apr,fused_bytes);
+
+    if(!compare_apr(apr,fused_apr)){
+        success = false;
+    }
+
+    if((fused_bytes == 0) || (fused_bytes >= bytes)){
+        success = false;
+    }
+
+    return success;
+}
+
+bool test_apr_particle_budget(TestData& test_data){
+    //
+    //  Converts the image to fractions of its number of particles, and compares with converting with the rel_error found
+    //
+
+    bool success = true;
+
+    MeshData<uint16_t> img(test_data.img_original,true);
+
+    const uint64_t number_particles = test_data.apr.total_number_particles();
+    const float tolerance = 0.05;
+
+    for (float fraction : {0.75f, 0.5f, 0.2f}) {
+        APRConverter<uint16_t> apr_converter;
+        set_test_parameters(apr_converter.par,test_data);
+
+        const uint64_t max_particles = fraction*number_particles;
+
+        APR<uint16_t> apr;
+        if(!apr_converter.get_apr_particle_budget(apr,img,max_particles,tolerance)){
+            success = false;
+            continue;
+        }
+
+        if((apr.total_number_particles() > max_particles) || (apr.total_number_particles() < (1 - tolerance)*max_particles)){
+            success = false;
+        }
+
+        //the same as a conversion from scratch with the rel_error found
+        APRConverter<uint16_t> check_converter;
+        check_converter.par = apr_converter.par;
+        APR<uint16_t> check_apr;
+        MeshData<uint16_t> check_img(img,true);
+        check_converter.get_apr_method(check_apr,check_img);
+
+        if(check_apr.total_number_particles() != apr.total_number_particles()){
+            success = false;
+        }
+    }
+
+    //not reachable (no rel_error gives no particles, or too few iterations to get below the budget), the parameters
+    //are left as they were
+    APRConverter<uint16_t> apr_converter;
+    set_test_parameters(apr_converter.par,test_data);
+    const float rel_error = apr_converter.par.rel_error;
+    APR<uint16_t> apr;
+    if(apr_converter.get_apr_particle_budget(apr,img,0) || (apr_converter.par.rel_error != rel_error)){
+        success = false;
+    }
+
+    if(apr_converter.get_apr_particle_budget(apr,img,number_particles/10,tolerance,1) || (apr_converter.par.rel_error != rel_error)){
+        success = false;
+    }
+
+    return success;
+}
+
+bool test_apr_neighbour_cache(TestData& test_data){
+    //
+    //  Checks the cached face neighbours against the iterator, and the stencils using them against the iterator versions
+    //
+
+    bool success = true;
+
+    APRNeighbourCache neighbour_cache;
+    neighbour_cache.initialize(test_data.apr);
+
+    if(neighbour_cache.memory_usage() == 0){
+        success = false;
+    }
+
+    APRIterator<uint16_t> apr_iterator(test_data.apr);
+    APRIterator<uint16_t> neighbour_iterator(test_data.apr);
+
+    for (uint64_t particle_number = 0; particle_number < apr_iterator.total_number_particles(); ++particle_number) {
+        apr_iterator.set_iterator_to_particle_by_number(particle_number);
+
+        for (uint8_t direction = 0; direction < 6; ++direction) {
+            apr_iterator.find_neighbours_in_direction(direction);
+
+            uint64_t neighbour = neighbour_cache.neighbours_begin(particle_number,direction);
+
+            for (int index = 0; index < apr_iterator.number_neighbours_in_direction(direction); ++index) {
+                if(neighbour_iterator.set_neighbour_iterator(apr_iterator, direction, index)){
+                    if((neighbour >= neighbour_cache.neighbours_end(particle_number,direction)) || (neighbour_cache.neighbour_index[neighbour] != neighbour_iterator.global_index())){
+                        success = false;
+                    }
+                    neighbour++;
+                }
+            }
+
+            if(neighbour != neighbour_cache.neighbours_end(particle_number,direction)){
+                success = false;
+            }
+        }
+    }
+
+    //filters
+    APRNumerics apr_numerics;
+    ExtraParticleData<float> smooth;
+    ExtraParticleData<float> smooth_cache;
+    std::vector<float> filter = {0.1f,0.8f,0.1f};
+
+    apr_numerics.seperable_smooth_filter(test_data.apr,test_data.apr.particles_intensities,smooth,filter,2);
+    apr_numerics.seperable_smooth_filter(test_data.apr,test_data.apr.particles_intensities,smooth_cache,filter,neighbour_cache,2);
+
+    if(smooth.data != smooth_cache.data){
+        success = false;
+    }
+
+    //compression prediction
+    for (int compress_type = 1; compress_type <= 2; ++compress_type) {
+        APRCompress<uint16_t> apr_compress;
+        apr_compress.set_compression_type(compress_type);
+
+        ExtraParticleData<uint16_t> symbols;
+        symbols.copy_parts(test_data.apr,test_data.apr.particles_intensities);
+        ExtraParticleData<uint16_t> symbols_cache;
+        symbols_cache.copy_parts(test_data.apr,test_data.apr.particles_intensities);
+
+        apr_compress.compress(test_data.apr,symbols);
+        apr_compress.set_neighbour_cache(&neighbour_cache);
+        apr_compress.compress(test_data.apr,symbols_cache);
+
+        if(symbols.data != symbols_cache.data){
+            success = false;
+        }
+
+        apr_compress.decompress(test_data.apr,symbols_cache);
+        apr_compress.set_neighbour_cache(nullptr);
+        apr_compress.decompress(test_data.apr,symbols);
+
+        if(symbols.data != symbols_cache.data){
+            success = false;
+        }
+    }
+
+    return success;
+}
+
+bool test_apr_morton_order(TestData& test_data){
+    //
+    //  Checks the permutations between the canonical and Morton orders, and filtering in the Morton order
+    //
+
+    bool success = true;
+
+    APRNeighbourCache neighbour_cache;
+    neighbour_cache.initialize(test_data.apr);
+
+    APRNumerics apr_numerics;
+    std::vector<float> filter = {0.1f,0.8f,0.1f};
+
+    ExtraParticleData<float> smooth;
+    apr_numerics.seperable_smooth_filter(test_data.apr,test_data.apr.particles_intensities,smooth,filter,neighbour_cache,2);
+
+    APRIterator<uint16_t> apr_iterator(test_data.apr);
+
+    for (int across_levels = 0; across_levels < 2; ++across_levels) {
+        APRMortonOrder morton_order;
+        morton_order.initialize(test_data.apr,across_levels);
+
+        //keys have to be increasing in the Morton order
+        uint64_t previous_key = 0;
+        for (uint64_t i = 0; i < morton_order.morton_to_canonical.size(); ++i) {
+            apr_iterator.set_iterator_to_particle_by_number(morton_order.morton_to_canonical[i]);
+            const unsigned int shift = across_levels ? (apr_iterator.level_max() - apr_iterator.level()) : 0;
+            uint64_t key = APRMortonOrder::morton_code(apr_iterator.y() << shift,apr_iterator.x() << shift,apr_iterator.z() << shift);
+            if(!across_levels){
+                key |= ((uint64_t)apr_iterator.level()) << 48;
+            }
+            if((i > 0) && (key <= previous_key)){
+                success = false;
+            }
+            previous_key = key;
+        }
+
+        ExtraParticleData<uint16_t> intensities_morton;
+        ExtraParticleData<uint16_t> intensities_canonical;
+        morton_order.to_morton(test_data.apr.particles_intensities,intensities_morton);
+        morton_order.to_canonical(intensities_morton,intensities_canonical);
+
+        if(intensities_canonical.data != test_data.apr.particles_intensities.data){
+            success = false;
+        }
+
+        //filtering in the Morton order gives the same result
+        APRNeighbourCache neighbour_cache_morton;
+        morton_order.remap_neighbour_cache(neighbour_cache,neighbour_cache_morton);
+
+        ExtraParticleData<float> smooth_morton;
+        ExtraParticleData<float> smooth_canonical;
+        apr_numerics.seperable_smooth_filter(test_data.apr,intensities_morton,smooth_morton,filter,neighbour_cache_morton,2);
+        morton_order.to_canonical(smooth_morton,smooth_canonical);
+
+        if(smooth_canonical.data != smooth.data){
+            success = false;
+        }
+    }
+
+    return success;
+}
+
+bool test_apr_load_default(TestData& test_data){
+    //
+    //  Loading with the default settings uses the gaps read from the file as the (flat) access structure, no per row
+    //  maps are built
+    //
+
+    bool success = true;
+
+    APR<uint16_t> apr;
+    apr.read_apr(test_data.apr_filename);
+
+    if(!apr.apr_access.use_flat_map || (apr.apr_access.flat_map.y_begin.size() != apr.apr_access.total_number_gaps)){
+        success = false;
+    }
+
+    for (auto const &level_rows : apr.apr_access.gap_map.data) {
+        if(!level_rows.empty()){
+            success = false;
+        }
+    }
+
+    if(!compare_apr(apr,test_data.apr)){
+        success = false;
+    }
+
+    //the std::map structure on request
+    APR<uint16_t> apr_map;
+    apr_map.read_apr(test_data.apr_filename,false);
+
+    if(apr_map.apr_access.use_flat_map || (apr_map.total_number_particles() != apr.total_number_particles())){
+        success = false;
+    }
+
+    return success;
+}
+
+bool test_apr_flat_map(TestData& test_data){
+    //
+    //  Compares the flat access structure against the std::map one, and then re-runs the iteration and neighbour tests on it
+    //
+
+    bool success = true;
+
+    APR<uint16_t> apr_flat;
+    apr_flat.read_apr(test_data.apr_filename,true);
+
+    if(apr_flat.total_number_particles() != test_data.apr.total_number_particles()){
+        return false;
+    }
+
+    //the iteration helpers are derived directly from the flat structure when loading
+    APRAccess& access = test_data.apr.apr_access;
+    APRAccess& access_flat = apr_flat.apr_access;
+
+    for (uint64_t level = access.level_min; level <= access.level_max; ++level) {
+        if((access.global_index_by_level_begin[level] != access_flat.global_index_by_level_begin[level]) ||
+           (access.global_index_by_level_end[level] != access_flat.global_index_by_level_end[level]) ||
+           (access.global_index_by_level_and_z_begin[level] != access_flat.global_index_by_level_and_z_begin[level]) ||
+           (access.global_index_by_level_and_z_end[level] != access_flat.global_index_by_level_and_z_end[level]) ||
+           (access.row_index_global_begin[level] != access_flat.row_index_global_begin[level])){
+            success = false;
+        }
+    }
+
+    APRIterator<uint16_t> apr_iterator(test_data.apr);
+    APRIterator<uint16_t> flat_iterator(apr_flat);
+
+    uint64_t particle_number;
+
+    for (particle_number = 0; particle_number < apr_iterator.total_number_particles(); ++particle_number) {
+        apr_iterator.set_iterator_to_particle_by_number(particle_number);
+        flat_iterator.set_iterator_to_particle_by_number(particle_number);
+
+        if((apr_iterator.x() != flat_iterator.x()) || (apr_iterator.y() != flat_iterator.y()) || (apr_iterator.z() != flat_iterator.z()) ||
+           (apr_iterator.level() != flat_iterator.level()) || (apr_iterator.type() != flat_iterator.type())){
+            success = false;
+        }
+
+        for (int direction = 0; direction < 6; ++direction) {
+            bool found = apr_iterator.find_neighbours_in_direction(direction);
+            bool found_flat = flat_iterator.find_neighbours_in_direction(direction);
+
+            if((found != found_flat) || (apr_iterator.get_neigh_particle_cell().global_index != flat_iterator.get_neigh_particle_cell().global_index)){
+                success = false;
+            }
+        }
+    }
+
+    //random access in reverse order
+    for (particle_number = apr_iterator.total_number_particles(); particle_number-- > 0;) {
+        apr_iterator.set_iterator_to_particle_by_number(particle_number);
+
+        ParticleCell particle_cell = apr_iterator.get_current_particle_cell();
+
+        if(!flat_iterator.set_iterator_by_particle_cell(particle_cell) || (flat_iterator.global_index() != particle_number)){
+            success = false;
+        }
+
+        //random access by particle number
+        flat_iterator.set_iterator_to_particle_by_number(apr_iterator.total_number_particles() - 1 - particle_number);
+        apr_iterator.set_iterator_to_particle_by_number(apr_iterator.total_number_particles() - 1 - particle_number);
+
+        if((apr_iterator.x() != flat_iterator.x()) || (apr_iterator.y() != flat_iterator.y()) || (apr_iterator.z() != flat_iterator.z()) ||
+           (apr_iterator.level() != flat_iterator.level())){
+            success = false;
+        }
+    }
+
+    //the structure can also be converted at run time
+    test_data.apr.apr_access.set_flat_map(true);
+
+    if(!test_apr_iterate(test_data) || !test_apr_neighbour_access(test_data)){
+        success = false;
+    }
+
+    test_data.apr.apr_access.set_flat_map(false);
+
+    if(!test_apr_iterate(test_data)){
+        success = false;
+    }
+
+    return success;
+}
+
+std::string get_source_directory_apr(){
+    // returns path to the directory where utils.cpp is stored
+
+    std::string tests_directory = std::string(__FILE__);
+    tests_directory = tests_directory.substr(0, tests_directory.find_last_of("\\/") + 1);
+
+    return tests_directory;
+}
+
+
+void CreateSmallSphereTest::SetUp(){
+
+
+    std::string file_name = get_source_directory_apr() + "files/Apr/sphere_120/sphere_apr.h5";
+    //(the access structure of the build, so the tests cover both)
+    test_data.apr.read_apr(file_name,APR_FLAT_MAP_DEFAULT);
+    test_data.apr_filename = file_name;
+
+    file_name = get_source_directory_apr() + "files/Apr/sphere_120/sphere_level.tif";
+    test_data.img_level = TiffUtils::getMesh<uint16_t>(file_name);
+    file_name = get_source_directory_apr() + "files/Apr/sphere_120/sphere_type.tif";
+    test_data.img_type = TiffUtils::getMesh<uint16_t>(file_name);
+    file_name = get_source_directory_apr() + "files/Apr/sphere_120/sphere_original.tif";
+    test_data.img_original = TiffUtils::getMesh<uint16_t>(file_name);
+    file_name = get_source_directory_apr() + "files/Apr/sphere_120/sphere_pc.tif";
+    test_data.img_pc = TiffUtils::getMesh<uint16_t>(file_name);
+    file_name = get_source_directory_apr() + "files/Apr/sphere_120/sphere_x.tif";
+    test_data.img_x = TiffUtils::getMesh<uint16_t>(file_name);
+    file_name =  get_source_directory_apr() + "files/Apr/sphere_120/sphere_y.tif";
+    test_data.img_y = TiffUtils::getMesh<uint16_t>(file_name);
+    file_name =  get_source_directory_apr() + "files/Apr/sphere_120/sphere_z.tif";
+    test_data.img_z = TiffUtils::getMesh<uint16_t>(file_name);
+
+    test_data.filename = get_source_directory_apr() + "files/Apr/sphere_120/sphere_original.tif";
+    test_data.output_name = "sphere_small";
+}
+
+TEST_F(CreateSmallSphereTest, APR_ITERATION) {
+
+//test iteration
+ASSERT_TRUE(test_apr_iterate(test_data));
+
+}
+
+TEST_F(CreateSmallSphereTest, APR_NEIGHBOUR_ACCESS) {
+
+//test iteration
+ASSERT_TRUE(test_apr_neighbour_access(test_data));
+
+}
+
+TEST_F(CreateSmallSphereTest, APR_INPUT_OUTPUT) {
+
+//test iteration
+    ASSERT_TRUE(test_apr_input_output(test_data));
+
+}
+
+TEST_F(CreateSmallSphereTest, APR_ROW_RUNS) {
+
+//test the row-run iteration
+    ASSERT_TRUE(test_apr_row_runs(test_data));
+
+}
+
+TEST_F(CreateSmallSphereTest, APR_LINEAR_ITERATOR) {
+
+//test the linear iterator against the full iterator
+    ASSERT_TRUE(test_apr_linear_iterator(test_data));
+
+}
+
+TEST_F(CreateSmallSphereTest, APR_BATCH_RANDOM_ACCESS) {
+
+//test the batch random access against the scalar random access
+    ASSERT_TRUE(test_apr_batch_random_access(test_data));
+
+}
+
+TEST_F(CreateSmallSphereTest, APR_ROI) {
+
+//test the region of interest queries
+    ASSERT_TRUE(test_apr_roi(test_data));
+
+}
+
+TEST_F(CreateSmallSphereTest, APR_CROP) {
+
+//test extracting crops as standalone APRs
+    ASSERT_TRUE(test_apr_crop(test_data));
+
+}
+
+TEST_F(CreateSmallSphereTest, APR_TILED_CONVERSION) {
+
+//test converting in tiles
+    ASSERT_TRUE(test_apr_tiled_conversion(test_data));
+
+}
+
+TEST_F(CreateSmallSphereTest, APR_STREAMING_CONVERSION) {
+
+//test converting in z-slabs within a memory budget
+    ASSERT_TRUE(test_apr_streaming_conversion(test_data));
+
+}
+
+TEST_F(CreateSmallSphereTest, APR_WORKSPACE_REUSE) {
+
+//test converting a series of images re-using the converter workspace
+    ASSERT_TRUE(test_apr_workspace_reuse(test_data));
+
+}
+
+TEST_F(CreateSmallSphereTest, APR_FROM_BUFFER) {
+
+//test converting from caller owned buffers
+    ASSERT_TRUE(test_apr_from_buffer(test_data));
+
+}
+
+TEST_F(CreateSmallSphereTest, APR_ODD_DIMENSIONS) {
+
+//test conversion of images with odd sizes
+ASSERT_TRUE(test_apr_odd_dimensions(test_data));
+
+}
+
+TEST_F(CreateSmallSphereTest, APR_FILTER_CACHE) {
+
+//test re-converting an image with changed parameters using the cached filter results
+    ASSERT_TRUE(test_apr_filter_cache(test_data));
+
+}
+
+TEST_F(CreateSmallSphereTest, APR_PREPROCESS_INPUT) {
+
+//test the fused pre-processing of the input image
+    ASSERT_TRUE(test_preprocess_input(test_data));
+
+}
+
+TEST_F(CreateSmallSphereTest, APR_FUSED_FILTER_PASSES) {
+
+//test fusing the passes of the filters
+    ASSERT_TRUE(test_fused_filter_passes(test_data));
+
+}
+
+TEST_F(CreateSmallSphereTest, APR_PARTICLE_BUDGET) {
+
+//test converting to a target number of particles
+    ASSERT_TRUE(test_apr_particle_budget(test_data));
+
+}
+
+TEST_F(CreateSmallSphereTest, APR_AUTO_PARAMETERS) {
+
+//test the automatic parameters with different numbers of threads and sampled pixels
+    ASSERT_TRUE(test_auto_parameters(test_data));
+
+}
+
+TEST_F(CreateSmallSphereTest, APR_NEIGHBOUR_CACHE) {
+
+//test the face neighbour cache
+    ASSERT_TRUE(test_apr_neighbour_cache(test_data));
+
+}
+
+TEST_F(CreateSmallSphereTest, APR_MORTON_ORDER) {
+
+//test the Morton ordering
+    ASSERT_TRUE(test_apr_morton_order(test_data));
+
+}
+
+TEST_F(CreateSmallSphereTest, APR_LOAD_DEFAULT) {
+
+//test loading an APR without rebuilding the access structure
+ASSERT_TRUE(test_apr_load_default(test_data));
+
+}
+
+TEST_F(CreateSmallSphereTest, APR_FLAT_MAP) {
+
+//test the flat access structure
+    ASSERT_TRUE(test_apr_flat_map(test_data));
 
 }
 
@@ -31,6 +31,121 @@ namespace {
         return true;
     }
 
+    /**
+     * The x b-spline recursion as it was before the passes were tiled (one x-line of y-values at a time, the boundary
+     * conditions initialised over min(k0, z_num) pixels), to check the tiled pass against
+     */
+    template<typename T>
+    void bspline_filt_rec_x_reference(MeshData<T> &image, float lambda, float tol) {
+        ComputeGradient cg;
+
+        float xi = 1 - 96*lambda + 24*lambda*sqrt(3 + 144*lambda);
+        float rho = (24*lambda - 1 - sqrt(xi))/(24*lambda)*sqrt((1/xi)*(48*lambda + 24*lambda*sqrt(3 + 144*lambda)));
+        float omg = atan(sqrt((1/xi)*(144*lambda - 1)));
+        float c0 = (1+ pow(rho,2))/(1-pow(rho,2)) * (1 - 2*rho*cos(omg) + pow(rho,2))/(1 + 2*rho*cos(omg) + pow(rho,2));
+        float gamma = (1-pow(rho,2))/(1+pow(rho,2)) * (1/tan(omg));
+
+        const float b1 = 2*rho*cos(omg);
+        const float b2 = -pow(rho,2.0);
+
+        const size_t z_num = image.z_num;
+        const size_t x_num = image.x_num;
+        const size_t y_num = image.y_num;
+
+        const size_t k0 = std::min((size_t)(ceil(std::abs(log(tol)/log(rho)))),z_num);
+        const float norm_factor = pow((1 - 2.0*rho*cos(omg) + pow(rho,2)),2);
+
+        std::vector<float> impulse_resp_vec_f(k0+3);
+        std::vector<float> impulse_resp_vec_b(k0+3);
+        for (size_t k = 0; k < (k0+3); k++) {
+            impulse_resp_vec_f[k] = cg.impulse_resp(k,rho,omg);
+            impulse_resp_vec_b[k] = cg.impulse_resp_back(k,rho,omg,gamma,c0);
+        }
+
+        //(bc1_vec[1] was written past the end for k0 = 1, it is not used then)
+        std::vector<float> bc1_vec(std::max(k0,(size_t)2), 0);
+        bc1_vec[1] = impulse_resp_vec_f[0];
+        for (size_t k = 0; k < k0; k++) {
+            bc1_vec[k] += impulse_resp_vec_f[k+1];
+        }
+
+        std::vector<float> bc2_vec(k0, 0);
+        for (size_t k = 0; k < k0; k++) {
+            bc2_vec[k] = impulse_resp_vec_f[k];
+        }
+
+        std::vector<float> bc3_vec(k0, 0);
+        bc3_vec[0] = impulse_resp_vec_b[1];
+        for (size_t k = 0; k < (k0-1); k++) {
+            bc3_vec[k+1] += impulse_resp_vec_b[k] + impulse_resp_vec_b[k+2];
+        }
+
+        std::vector<float> bc4_vec(k0, 0);
+        bc4_vec[0] = impulse_resp_vec_b[0];
+        for (size_t k = 1; k < k0; k++) {
+            bc4_vec[k] += 2*impulse_resp_vec_b[k];
+        }
+
+        std::vector<float> temp_vec1(y_num,0);
+        std::vector<float> temp_vec2(y_num,0);
+        std::vector<float> temp_vec3(y_num,0);
+        std::vector<float> temp_vec4(y_num,0);
+
+        for (size_t j = 0; j < z_num; ++j) {
+            std::fill(temp_vec1.begin(), temp_vec1.end(), 0);
+            std::fill(temp_vec2.begin(), temp_vec2.end(), 0);
+            std::fill(temp_vec3.begin(), temp_vec3.end(), 0);
+            std::fill(temp_vec4.begin(), temp_vec4.end(), 0);
+
+            size_t jxnumynum = j * y_num * x_num;
+
+            for (size_t i = 0; i < k0; ++i) {
+                for (size_t k = 0; k < y_num; ++k) {
+                    temp_vec1[k] += bc1_vec[i]*image.mesh[jxnumynum + i*y_num + k];
+                    temp_vec2[k] += bc2_vec[i]*image.mesh[jxnumynum + i*y_num + k];
+                    temp_vec3[k] += bc3_vec[i]*image.mesh[jxnumynum + (x_num - 1 - i)*y_num + k];
+                    temp_vec4[k] += bc4_vec[i]*image.mesh[jxnumynum + (x_num - 1 - i)*y_num + k];
+                }
+            }
+
+            for (size_t k = 0; k < y_num; ++k) {
+                image.mesh[jxnumynum + k] = temp_vec2[k];
+                image.mesh[jxnumynum + y_num + k] = temp_vec1[k];
+            }
+
+            for (size_t i = 2; i < x_num; ++i) {
+                size_t index = i * y_num + jxnumynum;
+                for (size_t k = 0; k < y_num; k++) {
+                    temp_vec2[k] = image.mesh[index + k] + b1*temp_vec1[k] + b2*temp_vec2[k];
+                }
+                std::swap(temp_vec1, temp_vec2);
+                std::copy(temp_vec1.begin(), temp_vec1.begin() + y_num, image.mesh.begin() + index);
+            }
+
+            for (size_t k = 0; k < y_num; ++k) {
+                image.mesh[jxnumynum + (x_num - 1)*y_num + k] = temp_vec4[k]*norm_factor;
+                image.mesh[jxnumynum + (x_num - 2)*y_num + k] = temp_vec3[k]*norm_factor;
+            }
+
+            for (int64_t i = x_num - 3; i >= 0; --i) {
+                size_t index = jxnumynum + i*y_num;
+                for (size_t k = 0; k < y_num; k++) {
+                    float temp = (image.mesh[index + k] + b1*temp_vec3[k] + b2*temp_vec4[k]);
+                    image.mesh[index + k] = temp*norm_factor;
+                    temp_vec4[k] = temp_vec3[k];
+                    temp_vec3[k] = temp;
+                }
+            }
+        }
+    }
+
+    template<typename T>
+    void fill_test_pattern(MeshData<T> &m) {
+        for (size_t i = 0; i < m.mesh.size(); ++i) {
+            m.mesh[i] = 100 + (i*7919) % 1000;
+        }
+    }
+
     TEST(ComputeGradientTest, 2D_XY) {
         {   // Corner points
             MeshData<float> m(6, 6, 1, 0);
@@ -104,6 +219,151 @@ namespace {
         cg.calc_bspline_fd_ds_mag(m, grad, 1, 1, 1);
         ASSERT_TRUE(compare(grad, expect, 0.01));
     }
+
+    TEST(ComputeGradientTest, BsplineYLines) {
+        // The y recursion on interleaved blocks of lines gives the same as filtering one line at a time (x_num is not
+        // a multiple of the block size, so the remaining lines are filtered on their own)
+        MeshData<float> m(53, 37, 5, 0);
+        for (size_t i = 0; i < m.mesh.size(); ++i) {
+            m.mesh[i] = 100 + (i*7919) % 1000;
+        }
+
+        MeshData<float> m1(m, true);
+        MeshData<float> m8(m, true);
+        MeshData<float> m16(m, true);
+
+        ComputeGradient cg;
+        cg.bspline_filt_rec_y_lines<1>(m1, 3, 0.0001);
+        cg.bspline_filt_rec_y_lines<8>(m8, 3, 0.0001);
+        cg.bspline_filt_rec_y_lines<16>(m16, 3, 0.0001);
+
+        for (size_t i = 0; i < m.mesh.size(); ++i) {
+            ASSERT_NEAR(m1.mesh[i], m8.mesh[i], 0.001);
+            ASSERT_NEAR(m1.mesh[i], m16.mesh[i], 0.001);
+        }
+
+        // lines shorter than the boundary initialisation
+        MeshData<uint16_t> s(3, 20, 40, 0);
+        for (size_t i = 0; i < s.mesh.size(); ++i) {
+            s.mesh[i] = 100 + (i*7919) % 1000;
+        }
+        MeshData<uint16_t> s1(s, true);
+        MeshData<uint16_t> s16(s, true);
+        cg.bspline_filt_rec_y_lines<1>(s1, 3, 0.0001);
+        cg.bspline_filt_rec_y_lines<16>(s16, 3, 0.0001);
+        for (size_t i = 0; i < s.mesh.size(); ++i) {
+            ASSERT_NEAR(s1.mesh[i], s16.mesh[i], 1);
+        }
+    }
+
+    TEST(ComputeGradientTest, BsplineXZTiles) {
+        // The x and z passes (on y-tiles, long enough for several tiles and a partial one) give the same as the y pass
+        // on the transposed image
+        ComputeGradient cg;
+
+        MeshData<float> m(4500, 600, 2, 0);
+        MeshData<float> t(600, 4500, 2, 0);
+        for (size_t z = 0; z < m.z_num; ++z) {
+            for (size_t x = 0; x < m.x_num; ++x) {
+                for (size_t y = 0; y < m.y_num; ++y) {
+                    m(y, x, z) = 100 + ((y + x*m.y_num + z*m.x_num*m.y_num)*7919) % 1000;
+                    t(x, y, z) = m(y, x, z);
+                }
+            }
+        }
+        MeshData<float> mi(m, true);
+        MeshData<float> ti(t, true);
+
+        cg.bspline_filt_rec_x(m, 3, 0.0001);
+        cg.bspline_filt_rec_y(t, 3, 0.0001);
+        cg.calc_inv_bspline_x(mi);
+        cg.calc_inv_bspline_y(ti);
+        for (size_t z = 0; z < m.z_num; ++z) {
+            for (size_t x = 0; x < m.x_num; ++x) {
+                for (size_t y = 0; y < m.y_num; ++y) {
+                    ASSERT_NEAR(m(y, x, z), t(x, y, z), 0.01);
+                    ASSERT_NEAR(mi(y, x, z), ti(x, y, z), 0.01);
+                }
+            }
+        }
+
+        MeshData<float> n(4500, 2, 600, 0);
+        MeshData<float> u(600, 2, 4500, 0);
+        for (size_t z = 0; z < n.z_num; ++z) {
+            for (size_t x = 0; x < n.x_num; ++x) {
+                for (size_t y = 0; y < n.y_num; ++y) {
+                    n(y, x, z) = 100 + ((y + x*n.y_num + z*n.x_num*n.y_num)*7919) % 1000;
+                    u(z, x, y) = n(y, x, z);
+                }
+            }
+        }
+        MeshData<float> ni(n, true);
+        MeshData<float> ui(u, true);
+
+        cg.bspline_filt_rec_z(n, 3, 0.0001);
+        cg.bspline_filt_rec_y(u, 3, 0.0001);
+        cg.calc_inv_bspline_z(ni);
+        cg.calc_inv_bspline_y(ui);
+        for (size_t z = 0; z < n.z_num; ++z) {
+            for (size_t x = 0; x < n.x_num; ++x) {
+                for (size_t y = 0; y < n.y_num; ++y) {
+                    ASSERT_NEAR(n(y, x, z), u(z, x, y), 0.01);
+                    ASSERT_NEAR(ni(y, x, z), ui(z, x, y), 0.01);
+                }
+            }
+        }
+    }
+
+    TEST(ComputeGradientTest, BsplineXReference) {
+        // The tiled x pass gives the same as the x pass before tiling, for 2D images (the boundary conditions are
+        // initialised from a single pixel) and for lines shorter than z. The operations are the same, the results are
+        // identical unless the compiler re-orders them (-ffast-math), then uint16 values can round differently.
+        ComputeGradient cg;
+
+        const std::vector<std::vector<size_t>> sizes = {{37, 64, 1}, {300, 25, 1}, {33, 20, 31}, {300, 40, 45}};
+
+        for (auto const &size : sizes) {
+            MeshData<float> m(size[0], size[1], size[2], 0);
+            fill_test_pattern(m);
+            MeshData<float> expected(m, true);
+            cg.bspline_filt_rec_x(m, 3, 0.0001);
+            bspline_filt_rec_x_reference(expected, 3, 0.0001);
+            for (size_t i = 0; i < m.mesh.size(); ++i) {
+                ASSERT_FLOAT_EQ(m.mesh[i], expected.mesh[i]) << "float " << size[0] << "x" << size[1] << "x" << size[2] << " index " << i;
+            }
+
+            MeshData<uint16_t> u(size[0], size[1], size[2], 0);
+            fill_test_pattern(u);
+            MeshData<uint16_t> expected_u(u, true);
+            cg.bspline_filt_rec_x(u, 3, 0.0001);
+            bspline_filt_rec_x_reference(expected_u, 3, 0.0001);
+            for (size_t i = 0; i < u.mesh.size(); ++i) {
+                ASSERT_NEAR(u.mesh[i], expected_u.mesh[i], 1) << "uint16 " << size[0] << "x" << size[1] << "x" << size[2] << " index " << i;
+            }
+        }
+
+        // lines shorter than the boundary initialisation (where the pass before tiling read past the end of the line)
+        // are initialised over the line, as the y pass
+        MeshData<float> m(33, 10, 40, 0);
+        MeshData<float> t(10, 33, 40, 0);
+        fill_test_pattern(m);
+        for (size_t z = 0; z < m.z_num; ++z) {
+            for (size_t x = 0; x < m.x_num; ++x) {
+                for (size_t y = 0; y < m.y_num; ++y) {
+                    t(x, y, z) = m(y, x, z);
+                }
+            }
+        }
+        cg.bspline_filt_rec_x(m, 3, 0.0001);
+        cg.bspline_filt_rec_y(t, 3, 0.0001);
+        for (size_t z = 0; z < m.z_num; ++z) {
+            for (size_t x = 0; x < m.x_num; ++x) {
+                for (size_t y = 0; y < m.y_num; ++y) {
+                    ASSERT_NEAR(m(y, x, z), t(x, y, z), 0.01);
+                }
+            }
+        }
+    }
 }
 
 int main(int argc, char **argv) {
@@ -0,0 +1,172 @@
+/*
+ * Tests of the SAT mean filters of LocalIntensityScale
+ */
+
+#include <gtest/gtest.h>
+#include <random>
+#include "data_structures/Mesh/MeshData.hpp"
+#include "algorithm/LocalIntensityScale.hpp"
+
+namespace {
+    /**
+     * Line by line SAT mean in y (the scalar version the blocked one has to reproduce)
+     */
+    template<typename T>
+    void calc_sat_mean_y_reference(MeshData<T>& input, const size_t offset) {
+        const size_t y_num = input.y_num;
+        std::vector<T> temp_vec(y_num, 0);
+        float divisor = 2 * offset + 1;
+
+        for (size_t j = 0; j < input.z_num; ++j) {
+            for (size_t i = 0; i < input.x_num; ++i) {
+                size_t index = j * input.x_num * y_num + i * y_num;
+
+                float temp = 0;
+                for (size_t k = 0; k < y_num; ++k) {
+                    temp += input.mesh[index + k];
+                    temp_vec[k] = temp;
+                }
+
+                input.mesh[index] = 0;
+                for (size_t k = 1; k <= (offset + 1); ++k) {
+                    input.mesh[index + k] = -temp_vec[0] / divisor;
+                }
+                for (size_t k = offset + 1; k < y_num; ++k) {
+                    input.mesh[index + k] = -temp_vec[k - offset - 1] / divisor;
+                }
+                for (size_t k = 0; k < (y_num - offset); ++k) {
+                    input.mesh[index + k] += temp_vec[k + offset] / divisor;
+                }
+
+                float counter = 0;
+                for (size_t k = (y_num - offset); k < (y_num); ++k) {
+                    counter++;
+                    input.mesh[index + k] *= divisor;
+                    input.mesh[index + k] += temp_vec[y_num - 1];
+                    input.mesh[index + k] *= 1.0 / (divisor - counter);
+                }
+
+                for (size_t k = 1; k < (offset + 1); ++k) {
+                    input.mesh[index + k] *= divisor / (1.0 * k + offset);
+                }
+
+                input.mesh[index] *= divisor / (offset + 1);
+            }
+        }
+    }
+
+    /**
+     * Mean over the window [-offset, offset] (clipped to the image) in x (dim == 1) or z (dim == 2)
+     */
+    template<typename T>
+    void window_mean_reference(const MeshData<T>& input, MeshData<T>& output, const size_t offset, const int dim) {
+        output.init(input.y_num, input.x_num, input.z_num);
+        const int64_t len = (dim == 1) ? input.x_num : input.z_num;
+
+        for (size_t z = 0; z < input.z_num; ++z) {
+            for (size_t x = 0; x < input.x_num; ++x) {
+                for (size_t y = 0; y < input.y_num; ++y) {
+                    const int64_t c = (dim == 1) ? x : z;
+                    const int64_t b = std::max(c - (int64_t)offset, (int64_t)0);
+                    const int64_t e = std::min(c + (int64_t)offset, len - 1);
+                    double sum = 0;
+                    for (int64_t i = b; i <= e; ++i) {
+                        sum += (dim == 1) ? input.mesh[(z * input.x_num + i) * input.y_num + y] : input.mesh[(i * input.x_num + x) * input.y_num + y];
+                    }
+                    output(y, x, z) = sum / (e - b + 1);
+                }
+            }
+        }
+    }
+
+    template<typename T>
+    void fill_random(MeshData<T>& m, const size_t y_num, const size_t x_num, const size_t z_num, const unsigned int seed = 0) {
+        std::mt19937 gen(seed + y_num * 10000 + x_num * 100 + z_num);
+        std::uniform_real_distribution<float> dist(0, 100);
+        m.init(y_num, x_num, z_num);
+        for (size_t i = 0; i < m.mesh.size(); ++i) {
+            m.mesh[i] = dist(gen);
+        }
+    }
+
+    TEST(LocalIntensityScaleTest, SatMeanY) {
+        // blocks of lines and the remaining lines (x_num not a multiple of the block), short lines use the scalar path
+        LocalIntensityScale lis;
+        for (size_t offset = 1; offset <= 6; ++offset) {
+            for (size_t y_num : {2 * offset + 1, 2 * offset + 2, (size_t)37, (size_t)130}) {
+                for (size_t x_num : {1, 7, 19, 33}) {
+                    MeshData<float> m;
+                    fill_random(m, y_num, x_num, 3);
+                    MeshData<float> expected(m, true);
+
+                    lis.calc_sat_mean_y(m, offset);
+                    calc_sat_mean_y_reference(expected, offset);
+
+                    for (size_t i = 0; i < m.mesh.size(); ++i) {
+                        ASSERT_NEAR(m.mesh[i], expected.mesh[i], 0.01) << "offset " << offset << " y_num " << y_num << " x_num " << x_num << " index " << i;
+                    }
+                }
+            }
+        }
+    }
+
+    TEST(LocalIntensityScaleTest, SatMeanYFused) {
+        // the fused copy / abs diff versions give the same results as the separate passes
+        LocalIntensityScale lis;
+        for (size_t offset : {1, 4}) {
+            MeshData<float> image;
+            fill_random(image, 29, 21, 4);
+            MeshData<float> smooth;
+            fill_random(smooth, 29, 21, 4, 1);
+
+            MeshData<float> var(smooth, true);
+            lis.calc_abs_diff(image, var);
+            lis.calc_sat_mean_y(var, offset);
+
+            MeshData<float> var_fused(smooth, true);
+            lis.calc_abs_diff_sat_mean_y(image, var_fused, offset);
+
+            MeshData<float> mean(image, true);
+            lis.calc_sat_mean_y(mean, offset);
+
+            MeshData<float> mean_fused(image, true);
+            MeshData<float> copy;
+            copy.init(image.y_num, image.x_num, image.z_num);
+            lis.copy_calc_sat_mean_y(mean_fused, copy, offset);
+
+            for (size_t i = 0; i < image.mesh.size(); ++i) {
+                ASSERT_EQ(var.mesh[i], var_fused.mesh[i]);
+                ASSERT_EQ(mean.mesh[i], mean_fused.mesh[i]);
+                ASSERT_EQ(copy.mesh[i], image.mesh[i]);
+            }
+        }
+    }
+
+    TEST(LocalIntensityScaleTest, SatMeanXZ) {
+        LocalIntensityScale lis;
+        for (size_t offset = 1; offset <= 6; ++offset) {
+            for (size_t len : {2 * offset + 2, (size_t)23}) {
+                MeshData<float> m;
+                fill_random(m, 13, len, 3);
+                MeshData<float> expected;
+                window_mean_reference(m, expected, offset, 1);
+                lis.calc_sat_mean_x(m, offset);
+                for (size_t i = 0; i < m.mesh.size(); ++i) {
+                    ASSERT_NEAR(m.mesh[i], expected.mesh[i], 0.01) << "x offset " << offset << " len " << len << " index " << i;
+                }
+
+                fill_random(m, 13, 3, len);
+                window_mean_reference(m, expected, offset, 2);
+                lis.calc_sat_mean_z(m, offset);
+                for (size_t i = 0; i < m.mesh.size(); ++i) {
+                    ASSERT_NEAR(m.mesh[i], expected.mesh[i], 0.01) << "z offset " << offset << " len " << len << " index " << i;
+                }
+            }
+        }
+    }
+}
+
+int main(int argc, char **argv) {
+    testing::InitGoogleTest(&argc, argv);
+    return RUN_ALL_TESTS();
+}
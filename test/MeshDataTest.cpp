@@ -170,6 +170,56 @@ namespace {
         }
     }
 
+    TEST(MeshDataSimpleTest, ReInitializeTest) {
+        {   // Same number of elements - memory is re-used, values are set if given
+            MeshData<int> md(3, 4, 5, 1);
+            const int *memory = md.mesh.get();
+            md.init(5, 4, 3, 2);
+            ASSERT_EQ(md.mesh.get(), memory);
+            ASSERT_EQ(md.y_num, 5);
+            ASSERT_EQ(md.z_num, 3);
+            for (size_t i = 0; i < md.mesh.size(); ++i) ASSERT_EQ(md.mesh[i], 2);
+            md.init(3, 4, 5);
+            ASSERT_EQ(md.mesh.get(), memory);
+        }
+        {   // Different number of elements - new memory
+            MeshData<int> md(3, 4, 5);
+            md.init(3, 4, 6);
+            ASSERT_EQ(md.mesh.size(), 3 * 4 * 6);
+            ASSERT_EQ(md.mesh.get(), md.meshMemory.get());
+        }
+        {   // Memory not owned by the mesh is never re-used
+            MeshData<int> md(3, 4, 5);
+            std::vector<int> external(3 * 4 * 5);
+            md.mesh.set(external.data(), external.size());
+            md.init(3, 4, 5);
+            ASSERT_NE(md.mesh.get(), external.data());
+            ASSERT_EQ(md.mesh.get(), md.meshMemory.get());
+        }
+    }
+
+    TEST(MeshDataSimpleTest, ViewTest) {
+        std::vector<int> external(3 * 4 * 5);
+        for (size_t i = 0; i < external.size(); ++i) external[i] = i;
+
+        MeshData<int> md(2, 2, 2);
+        md.setView(external.data(), 3, 4, 5);
+        ASSERT_EQ(md.y_num, 3);
+        ASSERT_EQ(md.x_num, 4);
+        ASSERT_EQ(md.z_num, 5);
+        ASSERT_EQ(md.mesh.get(), external.data());
+        ASSERT_EQ(md.at(2, 1, 3), external[3 * 12 + 1 * 3 + 2]);
+
+        // writes go to the external memory
+        md.at(0, 0, 0) = -1;
+        ASSERT_EQ(external[0], -1);
+
+        // init detaches from the view
+        md.init(3, 4, 5, 7);
+        ASSERT_NE(md.mesh.get(), external.data());
+        ASSERT_EQ(external[1], 1);
+    }
+
     TEST_F(MeshDataTest, InitDownsampledTest) {
         {
             MeshData<int> md;
@@ -59,6 +59,24 @@ namespace {
         }
     }
 
+    TEST(TiffTest, LoadSlices) {
+        TiffUtils::TiffInfo t1(testFilesDirectory() + "files/tiffTest/3x2x4x16bit.tif");
+
+        MeshData<uint16_t> mesh;
+        ASSERT_TRUE(TiffUtils::getMeshSlices(t1, 1, 3, mesh));
+        ASSERT_EQ(mesh.z_num, 2);
+        ASSERT_EQ(mesh.mesh.size(), 12);
+        for (int i = 0; i < 12; ++i) {
+            ASSERT_EQ(mesh.mesh[i], i + 7);
+        }
+
+        ASSERT_FALSE(TiffUtils::getMeshSlices(t1, 3, 5, mesh));
+
+        // 16 bit strips do not fit in the 8 bit mesh, they are not read past its end
+        MeshData<uint8_t> mesh8;
+        ASSERT_FALSE(TiffUtils::getMeshSlices(t1, 0, 4, mesh8));
+    }
+
     TEST(TiffTest, NotExistingFile) {
         TiffUtils::TiffInfo t("/tmp/forSureThisFileDoesNotExists.tiff666");
         ASSERT_STREQ(t.toString().c_str(), "<File not opened>");